@@ -0,0 +1,389 @@
+#include "BufferAdvisor.h"
+
+#include <cmath>
+
+namespace {
+
+const char MAGIC[8] = "DSPYEVI";
+
+// On-disk layout of an evidence file: one per (sample rate, device
+// period), little-endian, always this size.
+struct EvidenceFile {
+  char magic[8];             // "DSPYEVI\0"
+  uint32 version;
+  int32 samples_per_block;   // The device period.
+  double sample_rate;
+  int64 dropouts;
+  uint64 counts[LogLinearHistogram::NUM_BUCKETS];  // Lateness histogram, ns.
+};
+
+const double MAX_SHAPE = 0.5;
+
+// Share of the histogram's values above x, counting the bucket x falls in
+// pro rata.
+double EmpiricalSurvival(const LogLinearHistogram& histo, double x) {
+  const int64 total = histo.GetTotalCount();
+  if (total == 0) return 0;
+  const int bucket = LogLinearHistogram::BucketIndex(int64(x));
+  const double low = double(LogLinearHistogram::BucketLow(bucket));
+  const double high = double(LogLinearHistogram::BucketHigh(bucket));
+  double above = histo.GetCount(bucket) * jlimit(0.0, 1.0, (high - x) / (high - low));
+  for (int i = bucket + 1; i < LogLinearHistogram::NUM_BUCKETS; i++) above += histo.GetCount(i);
+  return above / total;
+}
+
+}  // namespace
+
+// Does the evidence file work for every BufferAdvisor in the process, so
+// the drain thread they share never waits on the disk or on another
+// process holding the file lock. Jobs run in the order they were submitted.
+class EvidenceStore : public Thread {
+public:
+  EvidenceStore() : Thread("dropoutspy evidence") {
+    startThread(2);
+  }
+
+  // Finishes the jobs already submitted first.
+  ~EvidenceStore() {
+    signalThreadShouldExit();
+    notify();
+    stopThread(STOP_TIMEOUT_MS);
+  }
+
+  // Drain thread. Queues a merge of delta into the file for the format
+  // (just a read, if delta is empty), whose result goes to
+  // advisor->EvidenceStored() unless advisor is null. Returns the job's ID,
+  // never 0.
+  uint32 Submit(BufferAdvisor* advisor, double sample_rate, int period_samples,
+                const LogLinearHistogram& delta, int64 dropouts) {
+    Job* job = new Job;
+    job->advisor = advisor;
+    job->sample_rate = sample_rate;
+    job->period_samples = period_samples;
+    job->delta = delta;
+    job->dropouts = dropouts;
+    uint32 id;
+    {
+      ScopedLock l(lock_);
+      if (++last_id_ == 0) last_id_ = 1;
+      id = job->id = last_id_;
+      jobs_.add(job);
+    }
+    notify();
+    return id;
+  }
+
+  // After this returns, no more results are delivered to advisor. Its jobs
+  // still run.
+  void Cancel(BufferAdvisor* advisor) {
+    ScopedLock l(lock_);
+    for (int i = 0; i < jobs_.size(); i++) {
+      if (jobs_[i]->advisor == advisor) jobs_[i]->advisor = nullptr;
+    }
+    if (current_ != nullptr && current_->advisor == advisor) current_->advisor = nullptr;
+  }
+
+  void run() override {
+    for (;;) {
+      for (;;) {
+        ScopedPointer<Job> job;
+        {
+          ScopedLock l(lock_);
+          if (jobs_.size() == 0) break;
+          job = jobs_.removeAndReturn(0);
+          current_ = job;
+        }
+        const bool written = Merge(*job);
+        ScopedLock l(lock_);
+        if (job->advisor != nullptr) job->advisor->EvidenceStored(job->id, stored_, stored_dropouts_, written);
+        current_ = nullptr;
+      }
+      if (threadShouldExit()) return;
+      wait(-1);
+    }
+  }
+
+private:
+  enum { STOP_TIMEOUT_MS = 10000 };
+
+  struct Job {
+    uint32 id;
+    BufferAdvisor* advisor;
+    double sample_rate;
+    int period_samples;
+    LogLinearHistogram delta;   // Not in the file yet.
+    int64 dropouts;
+  };
+
+  // Fills stored_ with what the file holds, or nothing if it doesn't hold
+  // evidence for the job's format.
+  void Load(const Job& job, const File& path) {
+    stored_.Clear();
+    stored_dropouts_ = 0;
+    EvidenceFile file;
+    FileInputStream in(path);
+    if (!in.openedOk() || in.read(&file, sizeof(file)) != int(sizeof(file))) return;
+    if (memcmp(file.magic, MAGIC, sizeof(file.magic)) != 0 || file.version != BufferAdvisor::VERSION ||
+        file.sample_rate != job.sample_rate || file.samples_per_block != job.period_samples) {
+      return;
+    }
+    for (int i = 0; i < LogLinearHistogram::NUM_BUCKETS; i++) stored_.AddCount(i, file.counts[i]);
+    stored_dropouts_ = file.dropouts;
+  }
+
+  // Adds the job's delta to the file, rereading it under the lock so other
+  // instances and processes at the same format add to it rather than
+  // overwrite it. Leaves the file's contents in stored_; false if the delta
+  // couldn't be written.
+  bool Merge(const Job& job) {
+    const File path = BufferAdvisor::GetFile(job.sample_rate, job.period_samples);
+    if (job.delta.GetTotalCount() == 0) {
+      // replaceWithData() renames a whole file into place, so a read needs
+      // no lock.
+      Load(job, path);
+      return true;
+    }
+    stored_.Clear();
+    stored_dropouts_ = 0;
+    if (BufferAdvisor::GetDefaultDirectory().createDirectory().failed()) return false;
+    if (!file_lock_.enter(BufferAdvisor::LOCK_TIMEOUT_MS)) return false;
+    Load(job, path);
+
+    EvidenceFile file;
+    zerostruct(file);
+    memcpy(file.magic, MAGIC, sizeof(file.magic));
+    file.version = BufferAdvisor::VERSION;
+    file.samples_per_block = job.period_samples;
+    file.sample_rate = job.sample_rate;
+    file.dropouts = stored_dropouts_ + job.dropouts;
+    for (int i = 0; i < LogLinearHistogram::NUM_BUCKETS; i++) {
+      file.counts[i] = stored_.GetCount(i) + job.delta.GetCount(i);
+    }
+    const bool written = path.replaceWithData(&file, sizeof(file));
+    file_lock_.exit();
+    if (written) {
+      stored_.Add(job.delta);
+      stored_dropouts_ += job.dropouts;
+    }
+    return written;
+  }
+
+  CriticalSection lock_;
+  OwnedArray<Job> jobs_;
+  Job* current_ = nullptr;      // Taken off jobs_, result not delivered yet.
+  uint32 last_id_ = 0;
+
+  // Evidence thread.
+  LogLinearHistogram stored_;
+  int64 stored_dropouts_ = 0;
+  InterProcessLock file_lock_{"dropoutspy-evidence"};
+};
+
+BufferAdvisor::BufferAdvisor(int64 ticks_per_second) : ticks_per_second_(ticks_per_second) {
+  BufferAdvice advice;
+  zerostruct(advice);
+  advice_.Write(advice);
+}
+
+BufferAdvisor::~BufferAdvisor() {
+  store_->Cancel(this);
+  SaveAndForget();
+}
+
+File BufferAdvisor::GetDefaultDirectory() {
+  return File::getSpecialLocation(File::userApplicationDataDirectory)
+      .getChildFile("dropoutspy").getChildFile("evidence");
+}
+
+File BufferAdvisor::GetFile(double sample_rate, int period_samples) {
+  return GetDefaultDirectory().getChildFile(String(int(sample_rate)) + "-" + String(period_samples) + ".dse");
+}
+
+// Saves the evidence so far and moves on to another format's, starting
+// from just this run's until the file has been read; a period of 0 until
+// one is found.
+void BufferAdvisor::SetEvidenceFormat(double sample_rate, int period_samples, int64 ticks) {
+  if (sample_rate == format_sample_rate_ && period_samples == format_period_samples_) return;
+  SaveAndForget();
+  evidence_.Clear();
+  evidence_dropouts_ = 0;
+  unsaved_.Clear();
+  unsaved_dropouts_ = 0;
+  saving_.Clear();
+  saving_dropouts_ = 0;
+  awaited_job_ = 0;
+  format_sample_rate_ = sample_rate;
+  format_period_samples_ = period_samples;
+  ns_per_period_ = sample_rate > 0 ? period_samples * 1e9 / sample_rate : 0;
+  if (ns_per_period_ > 0) awaited_job_ = store_->Submit(this, sample_rate, period_samples, unsaved_, 0);
+  Advise();
+  last_advice_ticks_ = last_save_ticks_ = ticks;
+}
+
+// A device period of samples has ended: a new size counts once
+// PERIODS_TO_AGREE in a row have it, as in DevicePeriodTracker.
+void BufferAdvisor::PeriodFinished(int samples, int64 ticks) {
+  if (samples == candidate_samples_) {
+    candidate_count_++;
+  } else {
+    candidate_samples_ = samples;
+    candidate_count_ = 1;
+  }
+  if (candidate_count_ == PERIODS_TO_AGREE) SetEvidenceFormat(format_sample_rate_, samples, ticks);
+}
+
+void BufferAdvisor::TimingRecordsReceived(const TimingRecord* records, int count) {
+  const int64 advice_ticks = ADVICE_INTERVAL_S * ticks_per_second_;
+  const int64 save_ticks = SAVE_INTERVAL_S * ticks_per_second_;
+  TakeStored();
+  for (int i = 0; i < count; i++) {
+    const TimingRecord& record = records[i];
+    if (record.flags & TIMING_FLAG_RESET) {
+      // The detector starts finding the period over, from the host's hint.
+      group_samples_ = 0;
+      candidate_samples_ = 0;
+      candidate_count_ = 0;
+      const double rate = sample_rate_.load(std::memory_order_relaxed);
+      if (rate != format_sample_rate_) SetEvidenceFormat(rate, 0, record.ticks);
+    }
+    if (record.flags & TIMING_FLAG_SUB_BLOCK) {
+      group_samples_ += record.num_samples;
+      continue;
+    }
+    if (group_samples_ > 0) PeriodFinished(group_samples_, record.ticks);
+    group_samples_ = record.num_samples;
+    // Until the period is settled, the detector may be measuring delta in
+    // some other one.
+    if (candidate_count_ < PERIODS_TO_AGREE || ns_per_period_ <= 0) continue;
+
+    const int64 lateness_ns = int64(jmax(0.0f, record.delta) * ns_per_period_);
+    evidence_.Record(lateness_ns);
+    unsaved_.Record(lateness_ns);
+    if (record.flags & TIMING_FLAG_DROPOUT) {
+      evidence_dropouts_++;
+      unsaved_dropouts_++;
+    }
+
+    if (record.ticks - last_advice_ticks_ >= advice_ticks) {
+      last_advice_ticks_ = record.ticks;
+      Advise();
+    }
+    if (record.ticks - last_save_ticks_ >= save_ticks) {
+      last_save_ticks_ = record.ticks;
+      Save();
+    }
+  }
+}
+
+// Hands what is new since the last save to the evidence thread. One save
+// at a time: until the last one's result is back, the next waits.
+void BufferAdvisor::Save() {
+  if (awaited_job_ != 0 || unsaved_.GetTotalCount() == 0 || ns_per_period_ <= 0) return;
+  saving_ = unsaved_;
+  saving_dropouts_ = unsaved_dropouts_;
+  unsaved_.Clear();
+  unsaved_dropouts_ = 0;
+  awaited_job_ = store_->Submit(this, format_sample_rate_, format_period_samples_, saving_, saving_dropouts_);
+}
+
+// The format is changing, or this is going away: hands over what hasn't
+// been saved without waiting for the result. Whatever a save still in
+// flight fails to write is lost, as it would be at the next format anyway.
+void BufferAdvisor::SaveAndForget() {
+  if (unsaved_.GetTotalCount() == 0 || ns_per_period_ <= 0) return;
+  store_->Submit(nullptr, format_sample_rate_, format_period_samples_, unsaved_, unsaved_dropouts_);
+}
+
+// Picks up the result of the job being waited for: the file's contents,
+// plus what has been recorded since it was handed over.
+void BufferAdvisor::TakeStored() {
+  if (!stored_ready_.load(std::memory_order_acquire)) return;
+  const ScopedLock l(stored_lock_);
+  stored_ready_.store(false, std::memory_order_relaxed);
+  if (awaited_job_ == 0 || stored_job_ != awaited_job_) return;  // From before a format change.
+  awaited_job_ = 0;
+  if (stored_written_) {
+    evidence_ = stored_;
+    evidence_dropouts_ = stored_dropouts_;
+    evidence_.Add(unsaved_);
+    evidence_dropouts_ += unsaved_dropouts_;
+  } else {
+    // The next save tries again.
+    unsaved_.Add(saving_);
+    unsaved_dropouts_ += saving_dropouts_;
+  }
+  saving_.Clear();
+  saving_dropouts_ = 0;
+  Advise();
+}
+
+void BufferAdvisor::EvidenceStored(uint32 job, const LogLinearHistogram& stored, int64 dropouts, bool written) {
+  const ScopedLock l(stored_lock_);
+  stored_job_ = job;
+  stored_ = stored;
+  stored_dropouts_ = dropouts;
+  stored_written_ = written;
+  stored_ready_.store(true, std::memory_order_release);
+}
+
+void BufferAdvisor::Advise() {
+  BufferAdvice advice;
+  zerostruct(advice);
+  advice.sample_rate = format_sample_rate_;
+  advice.samples_per_block = format_period_samples_;
+  advice.periods = evidence_.GetTotalCount();
+  advice.dropouts = evidence_dropouts_;
+  advice.target_per_hour = float(GetTargetPerDay() / 24);
+  if (format_sample_rate_ <= 0 || advice.periods == 0) {
+    advice_.Write(advice);
+    return;
+  }
+  advice.hours = advice.periods * (format_period_samples_ / format_sample_rate_) / 3600;
+
+  // Exceedances of the top of the TAIL_PERCENTILE bucket, at bucket
+  // midpoints.
+  const int threshold_bucket = LogLinearHistogram::BucketIndex(evidence_.GetValueAtPercentile(TAIL_PERCENTILE));
+  const double threshold = double(LogLinearHistogram::BucketHigh(threshold_bucket));
+  double n = 0, sum = 0, sum_squares = 0;
+  for (int i = threshold_bucket + 1; i < LogLinearHistogram::NUM_BUCKETS; i++) {
+    const double count = double(evidence_.GetCount(i));
+    if (count == 0) continue;
+    const double y = 0.5 * (LogLinearHistogram::BucketLow(i) + LogLinearHistogram::BucketHigh(i)) - threshold;
+    n += count;
+    sum += count * y;
+    sum_squares += count * y * y;
+  }
+  const bool fitted = n >= MIN_TAIL_PERIODS;
+  double shape = 0, scale = 0, tail_share = 0;
+  if (fitted) {
+    // Generalized Pareto by moments: mean = scale / (1 - shape), and
+    // mean^2 / variance = 1 - 2 shape.
+    const double mean = sum / n;
+    const double variance = jmax(1e-9, sum_squares / n - mean * mean);
+    shape = jlimit(0.0, MAX_SHAPE, 0.5 * (1 - mean * mean / variance));
+    scale = jmax(1.0, mean * (1 - shape));
+    tail_share = n / double(advice.periods);
+    advice.threshold_us = float(threshold * 1e-3);
+    advice.scale_us = float(scale * 1e-3);
+    advice.shape = float(shape);
+    advice.tail_periods = int64(n);
+  }
+
+  const double target = advice.target_per_hour;
+  for (int i = 0; i < NUM_ADVICE_SIZES; i++) {
+    const double period_ns = ADVICE_SIZES[i] * 1e9 / format_sample_rate_;
+    double survival;
+    if (fitted && period_ns > threshold) {
+      const double z = (period_ns - threshold) / scale;
+      survival = tail_share * (shape > 0 ? std::pow(1 + shape * z, -1 / shape) : std::exp(-z));
+    } else {
+      survival = EmpiricalSurvival(evidence_, period_ns);
+    }
+    advice.dropouts_per_hour[i] = float(3600 * format_sample_rate_ / ADVICE_SIZES[i] * survival);
+    // Without a tail fit, no dropouts beyond the worst seen says nothing.
+    if (fitted && advice.recommended == 0 && advice.dropouts_per_hour[i] <= target) {
+      advice.recommended = ADVICE_SIZES[i];
+    }
+  }
+  advice_.Write(advice);
+}
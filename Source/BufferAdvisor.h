@@ -0,0 +1,160 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LogLinearHistogram.h"
+#include "SeqLock.h"
+#include "TimingRecord.h"
+
+#include <atomic>
+
+// Buffer sizes the advisor predicts for; powers of two from 32 to 2048.
+const int ADVICE_SIZES[] = { 32, 64, 128, 256, 512, 1024, 2048 };
+const int NUM_ADVICE_SIZES = int(sizeof(ADVICE_SIZES) / sizeof(ADVICE_SIZES[0]));
+
+// What BufferAdvisor makes of the evidence for the current format.
+struct BufferAdvice {
+  double sample_rate;
+  int32 samples_per_block;      // The evidence is from this device period.
+  int32 recommended;            // Smallest of ADVICE_SIZES that meets the target; 0 if none, or too little evidence.
+  double hours;                 // Of evidence at this rate and size, this run and earlier ones.
+  int64 periods;
+  int64 dropouts;
+  float target_per_hour;
+
+  // Generalized Pareto fit of the lateness above the threshold. Zero until
+  // there is enough of a tail.
+  float threshold_us;
+  float scale_us;
+  float shape;
+  int64 tail_periods;
+
+  float dropouts_per_hour[NUM_ADVICE_SIZES];  // Predicted, for each of ADVICE_SIZES.
+};
+
+// Recommends a buffer size: the smallest one the machine can be expected
+// to run at with fewer dropouts than the target (1 a day by default).
+//
+// Fits a tail model to how late device periods start, in absolute time,
+// at the current device period. A period starting later than a whole period
+// is a dropout, so a candidate size B at sample rate R expects
+//   dropouts per hour = 3600 R / B * P(lateness > B / R)
+// on the assumption that the lateness (scheduler and driver latency, not
+// the processing the block needs) doesn't depend on the block size. Below
+// the 99th percentile P comes straight from the histogram; above it, from
+// a generalized Pareto fit by moments of the exceedances. The shape is
+// kept at 0 or above: a tail that looks bounded in a few hours may not be
+// in a few days.
+//
+// The period is the one the detector works in, found from the records the
+// way DevicePeriodTracker finds it, not the maximum block size the host
+// passes to prepareToPlay: the records' delta is in periods.
+//
+// Evidence accumulates: the lateness histogram and counts for each (sample
+// rate, device period) are kept in a small file under GetDefaultDirectory(),
+// merged with every run at that format, by every instance. A
+// TimingRecordStream listener, so the recording and fitting are on the
+// drain thread. The file work is on a thread of its own, one per process:
+// the drain thread hands it what is new, and picks up the merged file's
+// contents at a later batch.
+class EvidenceStore;
+
+class BufferAdvisor : public TimingRecordStream::Listener {
+public:
+  enum {
+    VERSION = 2,  // 1 scaled lateness by the host's maximum block size.
+    ADVICE_INTERVAL_S = 10,
+    SAVE_INTERVAL_S = 60,
+    MIN_TAIL_PERIODS = 50,  // Exceedances needed for a fit.
+    PERIODS_TO_AGREE = 3,   // As DevicePeriodTracker.
+    LOCK_TIMEOUT_MS = 500,  // Most the evidence thread waits for another process's save.
+  };
+  static constexpr double DEFAULT_TARGET_PER_DAY = 1;
+  static constexpr double TAIL_PERCENTILE = 99;
+
+  explicit BufferAdvisor(int64 ticks_per_second);
+
+  // Hands whatever hasn't been saved to the evidence thread. Remove this
+  // from the stream's listeners first.
+  ~BufferAdvisor();
+
+  // <user application data>/dropoutspy/evidence.
+  static File GetDefaultDirectory();
+
+  // Sample rate of the records to come. Any thread; applied at the next
+  // TIMING_FLAG_RESET record, as prepareToPlay always makes one.
+  void SetSampleRate(double sample_rate) {
+    sample_rate_.store(sample_rate, std::memory_order_relaxed);
+  }
+
+  // Any thread.
+  void SetTargetPerDay(double dropouts) {
+    target_per_day_.store(jmax(1e-3, dropouts), std::memory_order_relaxed);
+  }
+
+  double GetTargetPerDay() const {
+    return target_per_day_.load(std::memory_order_relaxed);
+  }
+
+  // Any thread.
+  void GetAdvice(BufferAdvice* advice) const {
+    advice_.Read(advice);
+  }
+
+  // Drain thread.
+  void TimingRecordsReceived(const TimingRecord* records, int count) override;
+
+private:
+  friend class EvidenceStore;
+
+  static File GetFile(double sample_rate, int period_samples);
+  void SetEvidenceFormat(double sample_rate, int period_samples, int64 ticks);
+  void PeriodFinished(int samples, int64 ticks);
+  void Save();
+  void SaveAndForget();
+  void TakeStored();
+  void Advise();
+
+  // Evidence thread. The file's contents once job has been merged into it,
+  // or written false if it couldn't be.
+  void EvidenceStored(uint32 job, const LogLinearHistogram& stored, int64 dropouts, bool written);
+
+  const int64 ticks_per_second_;
+  std::atomic<double> sample_rate_{0};
+  std::atomic<double> target_per_day_{DEFAULT_TARGET_PER_DAY};
+
+  // Drain thread. The samples since the latest period start, and the
+  // period size the latest ones agree on.
+  int group_samples_ = 0;
+  int candidate_samples_ = 0;
+  int candidate_count_ = 0;
+
+  // Drain thread. evidence_ is everything known at this format; unsaved_
+  // is the part that hasn't been handed to the evidence thread, and saving_
+  // the part that has, in job awaited_job_ (0 if none).
+  double format_sample_rate_ = 0;
+  int format_period_samples_ = 0;
+  double ns_per_period_ = 0;
+  LogLinearHistogram evidence_;
+  int64 evidence_dropouts_ = 0;
+  LogLinearHistogram unsaved_;
+  int64 unsaved_dropouts_ = 0;
+  LogLinearHistogram saving_;
+  int64 saving_dropouts_ = 0;
+  uint32 awaited_job_ = 0;
+  int64 last_advice_ticks_ = 0;
+  int64 last_save_ticks_ = 0;
+
+  // The latest job's result, from the evidence thread to the drain thread.
+  CriticalSection stored_lock_;
+  std::atomic<bool> stored_ready_{false};
+  uint32 stored_job_ = 0;
+  LogLinearHistogram stored_;
+  int64 stored_dropouts_ = 0;
+  bool stored_written_ = false;
+
+  SharedResourcePointer<EvidenceStore> store_;
+
+  SeqLock<BufferAdvice> advice_;
+
+  JUCE_DECLARE_NON_COPYABLE(BufferAdvisor)
+};
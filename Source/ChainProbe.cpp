@@ -0,0 +1,147 @@
+#include "ChainProbe.h"
+
+// Where the two ends of a chain meet. start_seq is a sequence lock around
+// start_ticks: odd while FIRST is writing it, two more for every block.
+struct ChainLink {
+  std::atomic<int64> start_ticks{0};
+  std::atomic<uint32> start_seq{0};
+  std::atomic<int> firsts{0};
+  std::atomic<int> lasts{0};
+};
+
+// Process-wide table of links, one per ID. Links live as long as the
+// registry, so an audio thread holding one never sees it freed.
+class ChainRegistry {
+public:
+  ChainLink* Get(int id) {
+    return &links_[jlimit(1, int(ChainProbe::MAX_ID), id) - 1];
+  }
+
+private:
+  ChainLink links_[ChainProbe::MAX_ID];
+};
+
+namespace {
+
+// Anything longer than this isn't the same block going down the chain.
+const double MAX_FRACTION = 4.0;
+
+// FIRST writes once a block, so a retry is rare and a second one rarer.
+const int READ_ATTEMPTS = 4;
+
+// A consistent start_seq and start_ticks pair. False if FIRST kept
+// writing.
+bool ReadStart(const ChainLink& link, uint32* seq, int64* start) {
+  for (int i = 0; i < READ_ATTEMPTS; i++) {
+    const uint32 before = link.start_seq.load(std::memory_order_acquire);
+    if (before & 1) continue;
+    *start = link.start_ticks.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (link.start_seq.load(std::memory_order_relaxed) == before) {
+      *seq = before;
+      return true;
+    }
+  }
+  return false;
+}
+
+void AddRole(ChainLink* link, ChainProbe::Role role, int delta) {
+  if (link == nullptr) return;
+  if (role == ChainProbe::FIRST) link->firsts += delta;
+  if (role == ChainProbe::LAST) link->lasts += delta;
+}
+
+}  // namespace
+
+ChainProbe::ChainProbe() {
+}
+
+ChainProbe::~ChainProbe() {
+  SetRole(OFF, id_);
+}
+
+void ChainProbe::SetRole(Role role, int id) {
+  id = jlimit(1, int(MAX_ID), id);
+  AddRole(link_.load(), GetRole(), -1);
+  ChainLink* link = role == OFF ? nullptr : registry_->Get(id);
+  AddRole(link, role, 1);
+  id_ = id;
+  link_.store(link, std::memory_order_release);
+  role_.store(role, std::memory_order_release);
+}
+
+void ChainProbe::Prepare(double sample_rate) {
+  inv_ticks_per_sample_ = sample_rate > 0 ? sample_rate / Time::getHighResolutionTicksPerSecond() : 0;
+  Reset();
+}
+
+void ChainProbe::Reset() {
+  seen_link_ = nullptr;
+  histo_.Clear();
+  blocks_.store(0, std::memory_order_relaxed);
+  unpaired_.store(0, std::memory_order_relaxed);
+  last_fraction_.store(0, std::memory_order_relaxed);
+  max_fraction_.store(0, std::memory_order_relaxed);
+  max_ticks_.store(0, std::memory_order_relaxed);
+}
+
+void ChainProbe::Process(int64 now, int num_samples) {
+  const int role = role_.load(std::memory_order_acquire);
+  if (role == OFF) return;
+  ChainLink* link = link_.load(std::memory_order_acquire);
+  if (link == nullptr) return;
+
+  if (role == FIRST) {
+    // Rounded down, so a second FIRST on the same ID (a mistake the UI
+    // shows) can't leave the sequence odd for good.
+    const uint32 seq = link->start_seq.load(std::memory_order_relaxed) & ~1u;
+    link->start_seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    link->start_ticks.store(now, std::memory_order_relaxed);
+    link->start_seq.store(seq + 2, std::memory_order_release);
+    return;
+  }
+
+  uint32 seq;
+  int64 start;
+  if (!ReadStart(*link, &seq, &start)) {
+    unpaired_.store(unpaired_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return;
+  }
+  if (link != seen_link_) {
+    // New pairing; wait for a fresh start.
+    seen_link_ = link;
+    last_seq_ = seq;
+    return;
+  }
+  if (seq == last_seq_) {
+    // FIRST hasn't run since our last block: bypassed, or not upstream of us.
+    unpaired_.store(unpaired_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return;
+  }
+  last_seq_ = seq;
+
+  const double fraction = double(now - start) * inv_ticks_per_sample_ / jmax(1, num_samples);
+  if (fraction < 0 || fraction > MAX_FRACTION) {
+    unpaired_.store(unpaired_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return;
+  }
+  histo_.Record(int64(fraction * 1e6));
+  blocks_.store(blocks_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  last_fraction_.store(float(fraction), std::memory_order_relaxed);
+  if (fraction > max_fraction_.load(std::memory_order_relaxed)) {
+    max_fraction_.store(float(fraction), std::memory_order_relaxed);
+    max_ticks_.store(now, std::memory_order_relaxed);
+  }
+}
+
+void ChainProbe::GetStats(ChainProbeStats* stats) const {
+  stats->blocks = blocks_.load(std::memory_order_relaxed);
+  stats->unpaired = unpaired_.load(std::memory_order_relaxed);
+  stats->last_fraction = last_fraction_.load(std::memory_order_relaxed);
+  stats->max_fraction = max_fraction_.load(std::memory_order_relaxed);
+  stats->max_ticks = max_ticks_.load(std::memory_order_relaxed);
+  ChainLink* link = link_.load(std::memory_order_acquire);
+  stats->firsts = link ? link->firsts.load() : 0;
+  stats->lasts = link ? link->lasts.load() : 0;
+}
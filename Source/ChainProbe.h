@@ -0,0 +1,88 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LogLinearHistogram.h"
+
+#include <atomic>
+
+class ChainRegistry;
+struct ChainLink;
+
+// What the last instance of a chain has measured.
+struct ChainProbeStats {
+  int64 blocks;           // Blocks measured.
+  int64 unpaired;         // Blocks where no matching first-instance entry was seen.
+  float last_fraction;    // Of the block period, for the latest block.
+  float max_fraction;
+  int64 max_ticks;        // When max_fraction happened.
+  int firsts;             // Instances registered under this ID, per role.
+  int lasts;
+};
+
+// Measures how long the plugins between two dropoutspy instances take.
+//
+// One instance is set to FIRST and placed at the top of a track or graph,
+// another to LAST at the bottom, both with the same ID. They meet in a
+// process-wide registry. FIRST stamps the time of each processBlock entry
+// into the shared link; LAST, on its own entry, takes the difference and
+// records it as a fraction of the block's duration. Both sides are
+// wait-free: one atomic timestamp and a sequence number.
+class ChainProbe {
+public:
+  enum Role {
+    OFF,
+    FIRST,
+    LAST,
+  };
+
+  enum { MAX_ID = 16 };
+
+  ChainProbe();
+  ~ChainProbe();
+
+  // Message thread.
+  void SetRole(Role role, int id);
+
+  Role GetRole() const {
+    return Role(role_.load(std::memory_order_relaxed));
+  }
+
+  int GetId() const {
+    return id_;
+  }
+
+  // Audio thread (or prepareToPlay).
+  void Prepare(double sample_rate);
+  void Reset();
+
+  // Audio thread, at processBlock entry, with the block's timestamp.
+  void Process(int64 now, int num_samples);
+
+  // Any thread.
+  void GetStats(ChainProbeStats* stats) const;
+
+  // Elapsed fraction of the block period, in parts per million. Any thread.
+  void GetHistogram(LogLinearHistogram* snapshot) const {
+    histo_.GetSnapshot(snapshot);
+  }
+
+private:
+  SharedResourcePointer<ChainRegistry> registry_;
+  std::atomic<ChainLink*> link_{nullptr};
+  std::atomic<int> role_{OFF};
+  int id_ = 1;
+
+  // Audio thread.
+  ChainLink* seen_link_ = nullptr;
+  uint32 last_seq_ = 0;
+  double inv_ticks_per_sample_ = 0;
+
+  HistogramRecorder histo_;
+  std::atomic<int64> blocks_{0};
+  std::atomic<int64> unpaired_{0};
+  std::atomic<float> last_fraction_{0};
+  std::atomic<float> max_fraction_{0};
+  std::atomic<int64> max_ticks_{0};
+
+  JUCE_DECLARE_NON_COPYABLE(ChainProbe)
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+// Where processBlock gets its timestamps from. Everything downstream
+// (ticks_per_block_, TimingRecord::ticks) is in Time::getHighResolutionTicks()
+// units, so every implementation must return ticks in those units.
+class ClockSource {
+public:
+  virtual ~ClockSource() {}
+
+  // Called on the audio thread once per block; must not block or allocate.
+  virtual int64 GetTicks() = 0;
+};
+
+// The default: JUCE's high resolution timer.
+class HighResolutionClock : public ClockSource {
+public:
+  int64 GetTicks() override {
+    return Time::getHighResolutionTicks();
+  }
+};
+
+// Deterministic clock for benchmarks and offline tests: every call returns
+// the previous value plus a fixed step.
+class SteppingClock : public ClockSource {
+public:
+  explicit SteppingClock(int64 step, int64 start = 0) : step_(step), now_(start) {
+  }
+
+  int64 GetTicks() override {
+    now_ += step_;
+    return now_;
+  }
+
+  void SetStep(int64 step) {
+    step_ = step;
+  }
+
+private:
+  int64 step_;
+  int64 now_;
+};
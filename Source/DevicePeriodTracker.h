@@ -0,0 +1,95 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+// Works out which processBlock calls start a new device period.
+//
+// Hosts may split one device buffer into several sub-blocks (for sample
+// accurate automation, or because their graph runs at a different size), or
+// hand us a different size on every callback. Only the first callback of a
+// device period says anything about driver timing; the rest of the group
+// arrives as soon as the host gets round to it. A callback continues the
+// current group if it arrived within a quarter of a period of the group's
+// first callback and, once the period is known, the group is still short of
+// a whole period.
+//
+// The device period starts as the prepareToPlay block size and switches to
+// the observed group size once three groups in a row agree. Until then
+// groups are split by arrival time alone, so a hint smaller than the real
+// period (a host that splits a 256 sample buffer into 64 sample sub-blocks
+// and passes 64) still finds the whole period, as long as the sub-blocks
+// arrive within a quarter of the hint apart from the first. After that the
+// size check also splits the catch-up burst that follows a stall into its
+// periods. A host that starts splitting larger periods later on is only
+// picked up at the next Reset(). Update() is O(1) with no division.
+class DevicePeriodTracker {
+public:
+  void Reset(int hint_samples, double ticks_per_sample) {
+    ticks_per_sample_ = ticks_per_sample;
+    group_samples_ = 0;
+    group_start_ticks_ = 0;
+    candidate_samples_ = 0;
+    candidate_count_ = 0;
+    confirmed_ = false;
+    SetPeriod(jmax(1, hint_samples));
+  }
+
+  // Returns true if this callback starts a new device period.
+  bool Update(int64 now, int num_samples) {
+    bool new_group = group_samples_ == 0 ||
+                     (confirmed_ && group_samples_ >= period_samples_) ||
+                     now - group_start_ticks_ >= quarter_period_ticks_;
+    if (new_group) {
+      if (group_samples_ > 0) GroupFinished(group_samples_);
+      group_start_ticks_ = now;
+      group_samples_ = 0;
+    }
+    group_samples_ += num_samples;
+    return new_group;
+  }
+
+  int GetPeriodSamples() const {
+    return period_samples_;
+  }
+
+  // True once after the device period estimate has changed.
+  bool TakePeriodChanged() {
+    bool changed = period_changed_;
+    period_changed_ = false;
+    return changed;
+  }
+
+private:
+  enum { GROUPS_TO_AGREE = 3 };
+
+  void GroupFinished(int samples) {
+    if (samples == candidate_samples_) {
+      candidate_count_++;
+    } else {
+      candidate_samples_ = samples;
+      candidate_count_ = 1;
+    }
+    if (candidate_count_ >= GROUPS_TO_AGREE) {
+      confirmed_ = true;
+      if (candidate_samples_ != period_samples_) SetPeriod(candidate_samples_);
+    }
+  }
+
+  void SetPeriod(int samples) {
+    period_samples_ = samples;
+    quarter_period_ticks_ = int64(samples * ticks_per_sample_ * 0.25);
+    period_changed_ = true;
+  }
+
+  double ticks_per_sample_ = 0;
+  int period_samples_ = 1;
+  int64 quarter_period_ticks_ = 0;
+  bool period_changed_ = false;
+  bool confirmed_ = false;   // Some group size has been seen GROUPS_TO_AGREE times in a row.
+
+  int group_samples_ = 0;
+  int64 group_start_ticks_ = 0;
+
+  int candidate_samples_ = 0;
+  int candidate_count_ = 0;
+};
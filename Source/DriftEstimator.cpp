@@ -0,0 +1,119 @@
+#include "DriftEstimator.h"
+
+constexpr double DriftEstimator::WINDOW_SECONDS;
+constexpr double DriftEstimator::FORGET;
+
+DriftEstimator::DriftEstimator(int64 ticks_per_second)
+  : ticks_per_second_(double(ticks_per_second)) {
+  Reset();
+}
+
+void DriftEstimator::Reset() {
+  have_origin_ = false;
+  origin_ticks_ = 0;
+  sw_ = sx_ = sy_ = sxx_ = sxy_ = 0;
+  fit_windows_ = 0;
+  slope_ = 0;
+  window_has_min_ = false;
+  history_count_ = 0;
+  history_next_ = 0;
+  history_level_ = 0;
+  pending_shift_ = false;
+  level_before_shift_ = 0;
+}
+
+void DriftEstimator::Reanchor() {
+  if (!pending_shift_ && fit_windows_ > 0) {
+    // Remember where the stream was, so the regression can be moved by the
+    // size of the step once we know where the stream is now.
+    level_before_shift_ = history_count_ > 0 ? history_level_ : window_min_det_;
+    pending_shift_ = true;
+  }
+  window_has_min_ = false;
+  history_count_ = 0;
+  history_next_ = 0;
+}
+
+void DriftEstimator::Update(int64 start_ticks, double device_seconds,
+                            double* lateness_ticks, double* spread_ticks) {
+  if (!have_origin_) {
+    origin_ticks_ = start_ticks;
+    have_origin_ = true;
+  }
+  const double x = device_seconds;
+  const double y = double(start_ticks - origin_ticks_);
+
+  if (window_has_min_ && x - window_start_x_ >= WINDOW_SECONDS) {
+    FinishWindow();
+  }
+
+  const double det = y - slope_ * x;
+  if (!window_has_min_) {
+    window_start_x_ = x;
+  }
+  if (!window_has_min_ || det < window_min_det_) {
+    window_min_det_ = det;
+    window_min_x_ = x;
+    window_min_y_ = y;
+    window_has_min_ = true;
+  }
+
+  double level = window_min_det_;
+  double top = det;
+  if (history_count_ > 0) {
+    level = jmin(level, history_level_);
+    top = jmax(top, history_level_);
+  }
+  *lateness_ticks = det - level;
+  *spread_ticks = top - level;
+}
+
+void DriftEstimator::FinishWindow() {
+  const double x = window_min_x_;
+  const double y = window_min_y_;
+
+  if (pending_shift_) {
+    // Every point already in the fit is from before the step; moving them
+    // all by the step keeps the slope estimate intact across it.
+    double step = (y - slope_ * x) - level_before_shift_;
+    sy_ += step * sw_;
+    sxy_ += step * sx_;
+    pending_shift_ = false;
+  }
+
+  sw_ = sw_ * FORGET + 1;
+  sx_ = sx_ * FORGET + x;
+  sy_ = sy_ * FORGET + y;
+  sxx_ = sxx_ * FORGET + x * x;
+  sxy_ = sxy_ * FORGET + x * y;
+  fit_windows_++;
+  if (fit_windows_ >= MIN_FIT_WINDOWS) {
+    double det = sw_ * sxx_ - sx_ * sx_;
+    if (det > 0) {
+      slope_ = (sw_ * sxy_ - sx_ * sy_) / det;
+    }
+  }
+
+  history_x_[history_next_] = x;
+  history_y_[history_next_] = y;
+  history_next_ = (history_next_ + 1) % HISTORY_WINDOWS;
+  if (history_count_ < HISTORY_WINDOWS) history_count_++;
+  RecomputeLevel();
+
+  window_has_min_ = false;
+}
+
+void DriftEstimator::RecomputeLevel() {
+  // Detrend with the current slope, which may have moved since these
+  // windows were recorded.
+  history_level_ = history_y_[0] - slope_ * history_x_[0];
+  for (int i = 1; i < history_count_; i++) {
+    history_level_ = jmin(history_level_, history_y_[i] - slope_ * history_x_[i]);
+  }
+}
+
+double DriftEstimator::GetDriftPpm() const {
+  // A fast device clock delivers samples early, so implied start times
+  // move backwards: negative slope.
+  return -slope_ / ticks_per_second_ * 1e6;
+}
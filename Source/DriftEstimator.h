@@ -0,0 +1,78 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+// Tracks the device sample clock against the host clock, so lateness can be
+// measured against a drift-corrected baseline instead of against a window
+// that has to be thrown away every hour.
+//
+// processBlock feeds it the implied stream start time of each callback
+// (now minus the time the samples delivered so far should have taken). If
+// the device and host clocks agreed exactly, on-time callbacks would all
+// imply the same start time; in practice that value drifts linearly at the
+// clocks' ppm difference, and late callbacks sit above the line.
+//
+// The estimator takes the earliest (least delayed) callback in each
+// one-second window, and fits a line through those minima with
+// exponentially-forgotten least squares. The slope is the drift; the level
+// is the lower envelope of the detrended start times over the last few
+// windows. Per-block work is O(1).
+class DriftEstimator {
+public:
+  explicit DriftEstimator(int64 ticks_per_second);
+
+  // Forget everything, including the drift rate. For a new stream.
+  void Reset();
+
+  // Keep the drift rate but forget the level, e.g. after a dropout has
+  // shifted the stream by a whole block.
+  void Reanchor();
+
+  // start_ticks: implied stream start for this callback.
+  // device_seconds: stream position of the callback, in device time.
+  // Returns lateness above the baseline, and the spread between this
+  // callback and the recent baseline (either direction), both in ticks.
+  void Update(int64 start_ticks, double device_seconds,
+              double* lateness_ticks, double* spread_ticks);
+
+  // Positive when the device clock runs fast relative to the host clock.
+  double GetDriftPpm() const;
+
+private:
+  void FinishWindow();
+  void RecomputeLevel();
+
+  enum { HISTORY_WINDOWS = 8, MIN_FIT_WINDOWS = 2 };
+  static constexpr double WINDOW_SECONDS = 1.0;
+  static constexpr double FORGET = 0.999;  // Per window; ~17 minute memory.
+
+  const double ticks_per_second_;
+
+  bool have_origin_ = false;
+  int64 origin_ticks_ = 0;
+
+  // Weighted least squares sums over window minima (x: seconds, y: ticks
+  // relative to origin_ticks_).
+  double sw_ = 0, sx_ = 0, sy_ = 0, sxx_ = 0, sxy_ = 0;
+  int fit_windows_ = 0;
+  double slope_ = 0;  // Ticks per device second.
+
+  // Window minimum in progress, raw (not detrended).
+  double window_start_x_ = 0;
+  double window_min_x_ = 0;
+  double window_min_y_ = 0;
+  double window_min_det_ = 0;
+  bool window_has_min_ = false;
+
+  // Raw minima of the last few windows, for the level.
+  double history_x_[HISTORY_WINDOWS];
+  double history_y_[HISTORY_WINDOWS];
+  int history_count_ = 0;
+  int history_next_ = 0;
+  double history_level_ = 0;
+
+  // Set by Reanchor(): the next completed window is used to shift the
+  // regression sums by the step the stream just took.
+  bool pending_shift_ = false;
+  double level_before_shift_ = 0;
+};
@@ -0,0 +1,142 @@
+#include "DropoutDetector.h"
+
+DropoutDetector::DropoutDetector(int64 ticks_per_second)
+  : ticks_per_second_(ticks_per_second),
+    ns_per_tick_(1e9 / ticks_per_second),
+    drift_(ticks_per_second),
+    rolling_(ticks_per_second) {
+  Reset();
+}
+
+void DropoutDetector::SetFormat(double sample_rate, int samples_per_block) {
+  sample_rate_ = sample_rate;
+  samples_per_block_ = samples_per_block;
+  ResetTracking();
+}
+
+void DropoutDetector::ResetTracking() {
+  drift_.Reset();
+  total_samples_ = 0;
+  spread_ = 0;
+  last_delta_ = 0;
+  have_period_start_ = false;
+  // Precompute reciprocals so Process only multiplies.
+  seconds_per_sample_ = sample_rate_ > 0 ? 1.0 / sample_rate_ : 0;
+  ticks_per_sample_ = ticks_per_second_ * seconds_per_sample_;
+  period_.Reset(samples_per_block_, ticks_per_sample_);
+  period_.TakePeriodChanged();
+  UpdateDevicePeriod();
+}
+
+void DropoutDetector::Reset() {
+  ResetTracking();
+  warning_count_ = 0;
+  overflow_count_ = 0;
+  last_overflow_ticks_ = 0;
+  lateness_histo_.Clear();
+  interval_histo_.Clear();
+  rolling_.Reset();
+}
+
+void DropoutDetector::Restore(const DetectorState& state, int64 shift_seconds) {
+  warning_count_ = state.warning_count;
+  overflow_count_ = state.overflow_count;
+  last_overflow_ticks_ = 0;
+  lateness_histo_.Restore(state.lateness);
+  interval_histo_.Restore(state.interval);
+  rolling_.Restore(state.windows, shift_seconds);
+}
+
+void DropoutDetector::Reanchor() {
+  drift_.Reanchor();
+  have_period_start_ = false;
+}
+
+void DropoutDetector::UpdateDevicePeriod() {
+  ticks_per_block_ = jmax<int64>(1, int64(period_.GetPeriodSamples() * ticks_per_sample_));
+  inv_ticks_per_block_ = 1.0 / ticks_per_block_;
+}
+
+void DropoutDetector::GetStats(DropoutStats* stats) const {
+  stats->warning_count = warning_count_;
+  stats->overflow_count = overflow_count_;
+  stats->last_overflow_ticks = last_overflow_ticks_;
+  stats->spread = spread_;
+  stats->last_delta = last_delta_;
+  stats->drift_ppm = float(drift_.GetDriftPpm());
+  stats->samples_per_block = period_.GetPeriodSamples();
+  stats->period_ms = float(ticks_per_block_ * ns_per_tick_ * 1e-6);
+}
+
+// Timing for the first callback of a device period.
+void DropoutDetector::TrackPeriodStart(TimingRecord* record) {
+  const int64 now = record->ticks;
+
+  // Implied start time of the stream, if this callback were on time. The
+  // drift estimator fits a line through the earliest of these, so the
+  // device/host clock rate difference doesn't build up as spread.
+  double seconds0 = total_samples_ * seconds_per_sample_;
+  int64 computed_start = now - int64(total_samples_ * ticks_per_sample_);
+
+  double lateness_ticks, spread_ticks;
+  drift_.Update(computed_start, seconds0, &lateness_ticks, &spread_ticks);
+
+  // Compute spread values.
+  spread_ = float(spread_ticks * inv_ticks_per_block_);
+  last_delta_ = float(lateness_ticks * inv_ticks_per_block_);
+
+  // Update histograms.
+  last_lateness_ns_ = int64(lateness_ticks * ns_per_tick_);
+  lateness_histo_.Record(last_lateness_ns_);
+  if (have_period_start_) {
+    interval_histo_.Record(int64((now - last_period_start_) * ns_per_tick_));
+  }
+  have_period_start_ = true;
+  last_period_start_ = now;
+
+  int bucket = int(last_delta_ * (METER_BUCKETS - 1));
+  if (bucket < 0) bucket = 0;
+  if (bucket >= METER_BUCKETS) bucket = METER_BUCKETS - 1;
+
+  record->delta = last_delta_;
+  record->spread = spread_;
+
+  if (spread_ > 1.0f) {
+    // Overflow or underflow!
+    record->flags |= TIMING_FLAG_DROPOUT;
+    overflow_count_++;
+    last_overflow_ticks_ = now;
+    // The stream has slipped by at least a block. Keep the measured drift,
+    // but find the new baseline.
+    drift_.Reanchor();
+  } else if (bucket >= METER_BUCKETS / 2) {
+    // Warning.
+    warning_count_++;
+    record->flags |= TIMING_FLAG_WARNING;
+  }
+  rolling_.Record(now, last_delta_, record->flags);
+}
+
+void DropoutDetector::Process(TimingRecord* record) {
+  // The stream starts at the first callback, whatever the transport is
+  // doing. When the host's timeline jumps, PlayHeadMonitor flags it and
+  // processBlock calls Reanchor(), so playback starting later finds its
+  // own baseline.
+  if (total_samples_ == 0) {
+    record->flags |= TIMING_FLAG_RESET;
+  }
+
+  if (period_.Update(record->ticks, record->num_samples)) {
+    if (period_.TakePeriodChanged()) {
+      UpdateDevicePeriod();
+    }
+    TrackPeriodStart(record);
+  } else {
+    // A later piece of a device period the host has split up. When it
+    // arrives only says how long the host took over the earlier pieces.
+    record->flags |= TIMING_FLAG_SUB_BLOCK;
+    record->delta = last_delta_;
+    record->spread = spread_;
+  }
+  total_samples_ += record->num_samples;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "DevicePeriodTracker.h"
+#include "DriftEstimator.h"
+#include "LogLinearHistogram.h"
+#include "RollingStats.h"
+#include "TimingRecord.h"
+
+const int METER_BUCKETS = 32;
+
+// Snapshot of the detector state, published by the audio thread after
+// every block. Readers get a consistent copy via getStats().
+struct DropoutStats {
+  int64 warning_count;
+  int64 overflow_count;
+  int64 last_overflow_ticks;
+  float spread;
+  float last_delta;
+  float drift_ppm;
+  int samples_per_block;
+  float period_ms;  // Length of the device period.
+};
+
+// The part of the detector worth keeping across sessions: what it has
+// counted, not how it is tracking the stream.
+struct DetectorState {
+  int64 warning_count;
+  int64 overflow_count;
+  LogLinearHistogram lateness;  // ns.
+  LogLinearHistogram interval;
+  RollingStats::Saved windows;
+};
+
+// The timing classification behind processBlock, on its own so offline
+// tools can replay recorded timestamps through exactly the same logic.
+//
+// Feed it the timestamp and size of every callback. The first callback of
+// each device period is compared against the drift-corrected start of the
+// stream: lateness is measured in device periods, a callback more than half
+// a period late is a warning, and a spread of more than a whole period
+// means the stream slipped (a dropout). Not thread safe; one owner, except
+// for the histogram snapshots and window queries.
+class DropoutDetector {
+public:
+  explicit DropoutDetector(int64 ticks_per_second);
+
+  // Sets the stream format and forgets the timing state, keeping the
+  // counters.
+  void SetFormat(double sample_rate, int samples_per_block);
+
+  // Forgets the timing state but keeps the counters, e.g. when timestamps
+  // start coming from a different clock.
+  void ResetTracking();
+
+  // Forgets everything.
+  void Reset();
+
+  // Replaces the counters, histograms and windows with state's, moving the
+  // windows shift_seconds later onto this run's clock. Keeps the timing
+  // state.
+  void Restore(const DetectorState& state, int64 shift_seconds);
+
+  // Finds a new baseline from the next device period on, keeping the drift
+  // and the counters, as after a dropout. For when the host jumps its
+  // timeline and may have stalled the callbacks doing it.
+  void Reanchor();
+
+  // Classifies one callback. record->ticks and record->num_samples are the
+  // inputs; fills in delta and spread and ORs TIMING_FLAG_* into flags.
+  void Process(TimingRecord* record);
+
+  void GetStats(DropoutStats* stats) const;
+
+  int64 GetWarningCount() const {
+    return warning_count_;
+  }
+
+  int64 GetOverflowCount() const {
+    return overflow_count_;
+  }
+
+  int GetPeriodSamples() const {
+    return period_.GetPeriodSamples();
+  }
+
+  double GetDriftPpm() const {
+    return drift_.GetDriftPpm();
+  }
+
+  // Lateness of the latest device period start, in ns, as recorded in the
+  // lateness histogram.
+  int64 GetLastLatenessNs() const {
+    return last_lateness_ns_;
+  }
+
+  // Lateness of each device period start, in ns. Any thread.
+  void GetLatenessHistogram(LogLinearHistogram* snapshot) const {
+    lateness_histo_.GetSnapshot(snapshot);
+  }
+
+  // Time between consecutive device period starts, in ns. Any thread.
+  void GetIntervalHistogram(LogLinearHistogram* snapshot) const {
+    interval_histo_.GetSnapshot(snapshot);
+  }
+
+  // Counts over a trailing window. Any thread.
+  void GetWindowStats(RollingStats::Window window, WindowStats* stats) const {
+    rolling_.GetWindow(window, stats);
+  }
+
+  // Any thread.
+  void SaveWindows(RollingStats::Saved* saved) const {
+    rolling_.Save(saved);
+  }
+
+private:
+  void UpdateDevicePeriod();
+  void TrackPeriodStart(TimingRecord* record);
+
+  const int64 ticks_per_second_;
+  const double ns_per_tick_;
+  DriftEstimator drift_;
+  double sample_rate_ = 0;
+  int samples_per_block_ = 0;
+  double seconds_per_sample_ = 0;
+  double ticks_per_sample_ = 0;
+  DevicePeriodTracker period_;
+  int64 ticks_per_block_ = 1;  // Of the device period, not of each callback.
+  double inv_ticks_per_block_ = 1;
+  int64 total_samples_ = 0;
+  int64 warning_count_ = 0;
+  int64 overflow_count_ = 0;
+  int64 last_overflow_ticks_ = 0;
+  float spread_ = 0;
+  float last_delta_ = 0;
+  int64 last_lateness_ns_ = 0;
+  bool have_period_start_ = false;
+  int64 last_period_start_ = 0;
+  HistogramRecorder lateness_histo_;
+  HistogramRecorder interval_histo_;
+  RollingStats rolling_;
+};
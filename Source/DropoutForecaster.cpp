@@ -0,0 +1,151 @@
+#include "DropoutForecaster.h"
+
+#include <cmath>
+
+namespace {
+
+const double EULER_GAMMA = 0.5772156649015329;
+
+// Smallest Gumbel scale the fit will use, in blocks, so a perfectly steady
+// stream doesn't divide by zero.
+const double MIN_SCALE = 1e-4;
+
+}  // namespace
+
+DropoutForecaster::DropoutForecaster(int64 ticks_per_second)
+  : seconds_per_tick_(1.0 / double(ticks_per_second)) {
+  zerostruct(current_);
+  Clear();
+}
+
+void DropoutForecaster::Clear() {
+  second_ = -1;
+  second_max_ = 0;
+  zeromem(maxima_, sizeof(maxima_));
+  seconds_ = 0;
+  last_fit_second_ = 0;
+  mean_ = 0;
+  variance_ = 0;
+  have_mean_ = false;
+  const int64 prewarnings = current_.prewarnings;
+  zerostruct(current_);
+  current_.headroom_percent = 100;
+  current_.minutes_to_dropout = -1;
+  current_.prewarnings = prewarnings;
+  forecast_.Write(current_);
+}
+
+void DropoutForecaster::TimingRecordsReceived(const TimingRecord* records, int count) {
+  for (int i = 0; i < count; i++) {
+    const TimingRecord& record = records[i];
+    if (record.flags & TIMING_FLAG_RESET) {
+      // A new stream; the old one's trend says nothing about it.
+      Clear();
+    }
+    if ((record.flags & TIMING_FLAG_SUB_BLOCK) || record.ticks < 0) continue;
+
+    const int64 second = int64(record.ticks * seconds_per_tick_);
+    if (second != second_) {
+      // Seconds with no callbacks at all (the host stopped) aren't
+      // maxima of anything, so they are skipped rather than pushed.
+      if (second_ >= 0) EndSecond();
+      second_ = second;
+      second_max_ = 0;
+    }
+    second_max_ = jmax(second_max_, record.spread);
+
+    // EWMA with a time constant, so it means the same at any block size.
+    if (!have_mean_) {
+      mean_ = record.spread;
+      variance_ = 0;
+      have_mean_ = true;
+    } else {
+      const double alpha = jmin(1.0, (record.ticks - last_ticks_) * seconds_per_tick_ / EWMA_SECONDS);
+      const double diff = record.spread - mean_;
+      mean_ += alpha * diff;
+      variance_ = (1 - alpha) * (variance_ + alpha * diff * diff);
+    }
+    last_ticks_ = record.ticks;
+  }
+}
+
+// Pushes the finished second's maximum, refits every FIT_INTERVAL_S, and
+// publishes.
+void DropoutForecaster::EndSecond() {
+  maxima_[seconds_ % FIT_SECONDS] = second_max_;
+  seconds_++;
+
+  float worst = 0;
+  for (int64 s = jmax<int64>(0, seconds_ - HEADROOM_SECONDS); s < seconds_; s++) {
+    worst = jmax(worst, maxima_[s % FIT_SECONDS]);
+  }
+  current_.headroom_percent = 100.0f * jlimit(0.0f, 1.0f, 1.0f - worst);
+  current_.mean_spread = float(mean_);
+  current_.sd_spread = float(std::sqrt(variance_));
+
+  if (seconds_ - last_fit_second_ >= FIT_INTERVAL_S) {
+    last_fit_second_ = seconds_;
+    Fit();
+  }
+  forecast_.Write(current_);
+}
+
+void DropoutForecaster::Fit() {
+  const int n = int(jmin<int64>(seconds_, FIT_SECONDS));
+  if (n < MIN_FIT_SECONDS) {
+    current_.seconds_fitted = 0;
+    return;
+  }
+  const int64 first = seconds_ - n;
+
+  // Least-squares trend of the maxima against time, t = 0 the oldest.
+  double sum_t = 0, sum_m = 0, sum_tt = 0, sum_tm = 0;
+  for (int t = 0; t < n; t++) {
+    const double m = maxima_[(first + t) % FIT_SECONDS];
+    sum_t += t;
+    sum_m += m;
+    sum_tt += double(t) * t;
+    sum_tm += t * m;
+  }
+  const double denominator = n * sum_tt - sum_t * sum_t;
+  const double slope = denominator > 0 ? (n * sum_tm - sum_t * sum_m) / denominator : 0;
+
+  // Gumbel by moments, of the maxima moved along the trend to now.
+  double sum = 0, sum_squares = 0;
+  for (int t = 0; t < n; t++) {
+    const double y = maxima_[(first + t) % FIT_SECONDS] + slope * (n - 1 - t);
+    sum += y;
+    sum_squares += y * y;
+  }
+  const double mean = sum / n;
+  const double variance = jmax(0.0, sum_squares / n - mean * mean);
+  const double scale = jmax(MIN_SCALE, std::sqrt(6 * variance) / double_Pi);
+  const double location = mean - EULER_GAMMA * scale;
+
+  // A second's worst spread stays under a block with probability
+  // exp(-exp(-z)), z = (1 - location) / scale, so log P(no dropout) adds
+  // up -exp(-z) per second. Only a worsening trend is projected; one that
+  // is improving may not last.
+  const double trend = jmax(0.0, slope);
+  const double prewarn_seconds = GetPrewarnMinutes() * 60.0;
+  double log_survival = 0;
+  double probability = 0;
+  double minutes_to_dropout = -1;
+  for (int t = STEP_SECONDS; t <= HORIZON_MINUTES * 60; t += STEP_SECONDS) {
+    const double z = (1.0 - (location + trend * (t - 0.5 * STEP_SECONDS))) / scale;
+    log_survival -= STEP_SECONDS * std::exp(-z);
+    const double p = 1.0 - std::exp(log_survival);
+    if (t <= prewarn_seconds) probability = p;
+    if (p >= 0.5 && minutes_to_dropout < 0) minutes_to_dropout = t / 60.0;
+  }
+
+  current_.tail_location = float(location);
+  current_.tail_scale = float(scale);
+  current_.trend_per_minute = float(slope * 60);
+  current_.dropout_probability = float(probability);
+  current_.minutes_to_dropout = float(minutes_to_dropout);
+  current_.seconds_fitted = n;
+  const bool prewarning = probability >= 0.5;
+  if (prewarning && !current_.prewarning) current_.prewarnings++;
+  current_.prewarning = prewarning;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "SeqLock.h"
+#include "TimingRecord.h"
+
+#include <atomic>
+
+// What DropoutForecaster makes of the recent timing. Spreads are in
+// blocks; a dropout is a spread over 1.
+struct DropoutForecast {
+  float headroom_percent;   // Of the block left above the worst spread of the last few seconds.
+  float mean_spread;        // Slow EWMA over every period.
+  float sd_spread;
+  float tail_location;      // Gumbel fit of the per-second worst spread.
+  float tail_scale;
+  float trend_per_minute;   // Of the per-second worst spread.
+  float dropout_probability;  // Of a dropout within the pre-warning horizon.
+  float minutes_to_dropout;   // Until a dropout is more likely than not, or -1 if not within HORIZON_MINUTES.
+  int32 seconds_fitted;     // Per-second maxima the fit used; 0 until there are enough.
+  bool prewarning;          // A dropout is likely within the pre-warning horizon.
+  int64 prewarnings;        // Times the pre-warning has been raised.
+};
+
+// Forecasts dropouts from how the lateness tail is trending, so there's
+// time to act before the glitch.
+//
+// A TimingRecordStream listener, so none of this is on the audio thread.
+// Each period costs O(1) on the drain thread: an EWMA of the spread, and
+// the running worst spread of the current second, which goes into a ring
+// of the last FIT_SECONDS of per-second maxima. Every FIT_INTERVAL_S
+// seconds those maxima get a linear trend and, once detrended, a Gumbel
+// (extreme value) fit by moments. Projecting the fit forward along the
+// trend (only if it's getting worse) gives the chance that some second's
+// worst spread crosses a whole block, i.e. a dropout, within the next
+// minutes. If it's more likely than not within the pre-warning horizon,
+// the pre-warning is up.
+class DropoutForecaster : public TimingRecordStream::Listener {
+public:
+  enum {
+    FIT_SECONDS = 600,          // Per-second maxima kept.
+    MIN_FIT_SECONDS = 30,
+    FIT_INTERVAL_S = 5,
+    HEADROOM_SECONDS = 10,
+    HORIZON_MINUTES = 30,
+    DEFAULT_PREWARN_MINUTES = 5,
+    STEP_SECONDS = 10,          // Of the projection.
+  };
+  static constexpr double EWMA_SECONDS = 60;
+
+  explicit DropoutForecaster(int64 ticks_per_second);
+
+  // Any thread. How far ahead a likely dropout raises the pre-warning.
+  void SetPrewarnMinutes(float minutes) {
+    prewarn_minutes_.store(jlimit(1.0f, float(HORIZON_MINUTES), minutes), std::memory_order_relaxed);
+  }
+
+  float GetPrewarnMinutes() const {
+    return prewarn_minutes_.load(std::memory_order_relaxed);
+  }
+
+  // Drain thread.
+  void TimingRecordsReceived(const TimingRecord* records, int count) override;
+
+  // Any thread.
+  void GetForecast(DropoutForecast* forecast) const {
+    forecast_.Read(forecast);
+  }
+
+private:
+  void Clear();
+  void EndSecond();
+  void Fit();
+
+  const double seconds_per_tick_;
+  std::atomic<float> prewarn_minutes_{float(DEFAULT_PREWARN_MINUTES)};
+
+  // Drain thread.
+  int64 second_ = -1;           // Index of the current second.
+  float second_max_ = 0;
+  float maxima_[FIT_SECONDS];   // Ring of per-second worst spreads.
+  int64 seconds_ = 0;           // Ever pushed into maxima_.
+  int64 last_fit_second_ = 0;
+  int64 last_ticks_ = 0;
+  double mean_ = 0;
+  double variance_ = 0;
+  bool have_mean_ = false;
+  DropoutForecast current_;
+
+  SeqLock<DropoutForecast> forecast_;
+
+  JUCE_DECLARE_NON_COPYABLE(DropoutForecaster)
+};
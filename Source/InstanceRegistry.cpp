@@ -0,0 +1,228 @@
+#include "InstanceRegistry.h"
+
+#if JUCE_MAC || JUCE_LINUX
+ #include <errno.h>
+ #include <fcntl.h>
+ #include <signal.h>
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+ #define DROPOUTSPY_HAVE_SHM 1
+#else
+ #define DROPOUTSPY_HAVE_SHM 0
+#endif
+
+// The table is shared between processes, so its atomics must not fall back
+// to (process-local) locks.
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+              "InstanceTable needs lock-free atomics");
+
+namespace {
+
+const uint64 MAGIC = 0x54534E4959505344ull;  // "DSPYINST", little endian.
+
+#if DROPOUTSPY_HAVE_SHM
+int32 GetPid() {
+  return int32(getpid());
+}
+
+bool IsAlive(int32 pid) {
+  return kill(pid_t(pid), 0) == 0 || errno == EPERM;
+}
+#else
+int32 GetPid() {
+  return 0;
+}
+
+bool IsAlive(int32 pid) {
+  return false;
+}
+#endif
+
+}  // namespace
+
+struct InstanceTable::Header {
+  std::atomic<uint64> magic;
+  std::atomic<uint32> version;
+  std::atomic<uint32> slot_bytes;
+  std::atomic<uint32> max_slots;
+  std::atomic<uint32> slot_limit;  // One past the highest slot ever claimed.
+  char reserved[40];
+};
+
+struct InstanceTable::Slot {
+  std::atomic<int32> owner;        // pid, or 0 if free.
+  std::atomic<uint32> generation;  // Bumped on every claim and release.
+  SeqLock<InstanceSnapshot> snapshot;
+};
+
+static_assert(sizeof(InstanceSnapshot) == 280, "InstanceSnapshot layout changed; bump InstanceTable::VERSION");
+static_assert(sizeof(INSTANCE_LATE_BOUNDS_US) / sizeof(INSTANCE_LATE_BOUNDS_US[0]) == InstanceSnapshot::LATE_BUCKETS,
+              "One bound per bucket");
+
+InstanceTable::InstanceTable(bool writable) {
+#if DROPOUTSPY_HAVE_SHM
+  const size_t size = sizeof(Header) + MAX_SLOTS * sizeof(Slot);
+  const int fd = shm_open(GetName(), writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+  if (fd < 0) return;
+  struct stat st;
+  if (writable && fstat(fd, &st) == 0 && st.st_size == 0) {
+    // macOS only lets a shared memory object be sized once, so this fails
+    // if another process got there first; the size check below decides.
+    ftruncate(fd, off_t(size));
+  }
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < size) {
+    close(fd);
+    return;
+  }
+  void* p = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) return;
+
+  Header* header = static_cast<Header*>(p);
+  if (writable && header->magic.load(std::memory_order_acquire) == 0) {
+    // Fresh segment. Racing creators all store the same values.
+    header->version.store(VERSION, std::memory_order_relaxed);
+    header->slot_bytes.store(uint32(sizeof(Slot)), std::memory_order_relaxed);
+    header->max_slots.store(MAX_SLOTS, std::memory_order_relaxed);
+    header->magic.store(MAGIC, std::memory_order_release);
+  }
+  if (header->magic.load(std::memory_order_acquire) != MAGIC
+      || header->version.load(std::memory_order_relaxed) != VERSION
+      || header->slot_bytes.load(std::memory_order_relaxed) != sizeof(Slot)
+      || header->max_slots.load(std::memory_order_relaxed) != MAX_SLOTS) {
+    // Not initialized yet, or left by an incompatible build.
+    munmap(p, size);
+    return;
+  }
+  header_ = header;
+  size_ = size;
+#else
+  ignoreUnused(writable);
+#endif
+}
+
+InstanceTable::~InstanceTable() {
+#if DROPOUTSPY_HAVE_SHM
+  if (header_ != nullptr) munmap(header_, size_);
+#endif
+}
+
+// Nothing ever unlinks the segment, so the version is in the name: a build
+// with another layout gets a segment of its own instead of finding one it
+// must reject until the machine restarts.
+const char* InstanceTable::GetName() {
+  static_assert(VERSION == 3, "Put the new VERSION in the segment name");
+  return "/dropoutspy-instances-v3";
+}
+
+InstanceTable::Slot* InstanceTable::GetSlot(int slot) const {
+  return reinterpret_cast<Slot*>(reinterpret_cast<char*>(header_) + sizeof(Header)) + slot;
+}
+
+int InstanceTable::ClaimSlot() {
+  if (header_ == nullptr) return -1;
+  const int32 pid = GetPid();
+  for (int i = 0; i < MAX_SLOTS; i++) {
+    Slot* slot = GetSlot(i);
+    int32 owner = slot->owner.load(std::memory_order_relaxed);
+    if (owner != 0 && IsAlive(owner)) continue;
+    if (!slot->owner.compare_exchange_strong(owner, pid)) continue;
+    // An owner that died in the middle of a Write() left the sequence odd;
+    // the generation tells readers the slot changed hands.
+    slot->snapshot.ResetSequence();
+    slot->generation.fetch_add(1);
+    uint32 limit = header_->slot_limit.load();
+    while (limit < uint32(i + 1) && !header_->slot_limit.compare_exchange_weak(limit, uint32(i + 1))) {}
+    return i;
+  }
+  return -1;
+}
+
+void InstanceTable::ReleaseSlot(int slot) {
+  if (header_ == nullptr || slot < 0) return;
+  GetSlot(slot)->generation.fetch_add(1);
+  GetSlot(slot)->owner.store(0, std::memory_order_release);
+}
+
+void InstanceTable::Publish(int slot, const InstanceSnapshot& snapshot) {
+  if (header_ == nullptr || slot < 0) return;
+  GetSlot(slot)->snapshot.Write(snapshot);
+}
+
+int InstanceTable::GetSlotLimit() const {
+  if (header_ == nullptr) return 0;
+  return jmin(int(MAX_SLOTS), int(header_->slot_limit.load(std::memory_order_acquire)));
+}
+
+uint64 InstanceTable::GetSlotVersion(int slot) const {
+  const Slot* s = GetSlot(slot);
+  return (uint64(s->generation.load(std::memory_order_acquire)) << 32) | s->snapshot.GetVersion();
+}
+
+bool InstanceTable::ReadSlot(int slot, InstanceSnapshot* snapshot) const {
+  const Slot* s = GetSlot(slot);
+  const int32 owner = s->owner.load(std::memory_order_acquire);
+  if (owner == 0 || !IsAlive(owner)) return false;
+  // A writer that died mid-update would make Read() spin forever.
+  for (int attempt = 0; attempt < 100; attempt++) {
+    if (s->snapshot.TryRead(snapshot)) return snapshot->pid == owner;
+    Thread::yield();
+  }
+  return false;
+}
+
+InstanceRegistry::InstanceRegistry() : Thread("dropoutspy registry"), table_(true) {
+  zerostruct(host_);
+  File::getSpecialLocation(File::hostApplicationPath).getFileNameWithoutExtension()
+      .copyToUTF8(host_, sizeof(host_));
+  if (table_.IsValid()) startThread(3);
+}
+
+InstanceRegistry::~InstanceRegistry() {
+  stopThread(1000);
+  for (int i = 0; i < entries_.size(); i++) table_.ReleaseSlot(entries_.getReference(i).slot);
+}
+
+void InstanceRegistry::Add(Source* source) {
+  const int slot = table_.ClaimSlot();
+  if (slot < 0) return;
+  // Nothing else writes to the slot yet; hide what its last owner left.
+  InstanceSnapshot empty;
+  zerostruct(empty);
+  table_.Publish(slot, empty);
+  ScopedLock l(lock_);
+  entries_.add({ source, slot, next_instance_++ });
+}
+
+void InstanceRegistry::Remove(Source* source) {
+  ScopedLock l(lock_);
+  for (int i = 0; i < entries_.size(); i++) {
+    if (entries_.getReference(i).source == source) {
+      table_.ReleaseSlot(entries_.getReference(i).slot);
+      entries_.remove(i);
+      return;
+    }
+  }
+}
+
+void InstanceRegistry::run() {
+  const int32 pid = GetPid();
+  while (!threadShouldExit()) {
+    {
+      ScopedLock l(lock_);
+      for (int i = 0; i < entries_.size(); i++) {
+        const Entry& entry = entries_.getReference(i);
+        InstanceSnapshot snapshot;
+        zerostruct(snapshot);
+        entry.source->GetInstanceSnapshot(&snapshot);
+        snapshot.pid = pid;
+        snapshot.instance = entry.instance;
+        snapshot.updated_ms = Time::currentTimeMillis();
+        memcpy(snapshot.host, host_, sizeof(host_));
+        table_.Publish(entry.slot, snapshot);
+      }
+    }
+    wait(PUBLISH_INTERVAL_MS);
+  }
+}
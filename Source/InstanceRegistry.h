@@ -0,0 +1,148 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "SeqLock.h"
+
+#include <atomic>
+
+// Upper bounds of InstanceSnapshot::late_buckets, in microseconds.
+const int32 INSTANCE_LATE_BOUNDS_US[] = { 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 1000000 };
+
+// What one running instance publishes about itself. Fixed layout, since the
+// writer and the reader can be different builds; bump
+// InstanceTable::VERSION when it changes.
+struct InstanceSnapshot {
+  enum { LATE_BUCKETS = 12 };
+
+  int32 pid;
+  uint32 instance;        // Counts up per process.
+  int64 updated_ms;       // Wall clock of this snapshot; the heartbeat.
+  char host[32];          // Host application, NUL terminated.
+  float sample_rate;
+  int32 samples_per_block;
+  float period_ms;        // Length of the device period.
+  float drift_ppm;
+  int64 warning_count;    // Since the last reset.
+  int64 overflow_count;
+  int64 late_p99_ns;      // Since the last reset.
+  int64 late_max_ns;
+  float max_delta_1s;     // Worst lateness in the window, in blocks.
+  float max_delta_1m;
+  int64 callbacks_1m;
+  int64 warnings_1m;
+  int64 dropouts_1m;
+  float spread;           // Of the start-time window, in blocks.
+  int32 reserved;
+  int64 periods;          // Device periods since the last reset.
+  // Lateness since the last reset, for exporters: how many periods were at
+  // most INSTANCE_LATE_BOUNDS_US[i] late (to the histogram's precision),
+  // and the total.
+  int64 late_buckets[LATE_BUCKETS];
+  int64 late_sum_ns;
+  // Offline rendering, kept apart from all of the above.
+  int32 rendering;                // 1 while the host renders offline.
+  float render_realtime_factor;   // Of the latest render; 0 if none.
+  float render_slowest_factor;    // Its slowest stretch.
+  int32 reserved2;
+  int64 renders;                  // Since the last reset.
+  int64 render_samples;           // Of the latest render.
+};
+
+// Table of running instances in a POSIX shared memory segment, shared by
+// every host process on the machine.
+//
+// Each instance owns one fixed-size slot, claimed by storing its pid. The
+// payload is a SeqLock<InstanceSnapshot>, so a reader copies it without
+// locking and retries if the writer was mid-update; zero-filled memory is
+// a valid empty slot. Slots of processes that died without releasing them
+// are reclaimed by the next claim. Readers only scan up to the highest slot
+// ever claimed.
+//
+// Only available where there is POSIX shared memory; elsewhere IsValid()
+// is always false.
+class InstanceTable {
+public:
+  enum {
+    VERSION = 3,            // Also in GetName().
+    MAX_SLOTS = 1024,
+  };
+
+  // Opens (creating if needed) the segment for publishing, or maps an
+  // existing one read-only.
+  explicit InstanceTable(bool writable);
+  ~InstanceTable();
+
+  bool IsValid() const {
+    return header_ != nullptr;
+  }
+
+  // Writer. Returns a slot index, or -1 if the table is full or invalid.
+  int ClaimSlot();
+  void ReleaseSlot(int slot);
+
+  // Writer; only from one thread per slot.
+  void Publish(int slot, const InstanceSnapshot& snapshot);
+
+  // Reader. Slots at or past this have never been used.
+  int GetSlotLimit() const;
+
+  // Reader. Changes whenever the slot is claimed, released or published,
+  // so callers can skip slots they have already read.
+  uint64 GetSlotVersion(int slot) const;
+
+  // Reader. Returns false if the slot is free or its owner is gone.
+  bool ReadSlot(int slot, InstanceSnapshot* snapshot) const;
+
+  static const char* GetName();
+
+private:
+  struct Header;
+  struct Slot;
+
+  Slot* GetSlot(int slot) const;
+
+  Header* header_ = nullptr;
+  size_t size_ = 0;
+
+  JUCE_DECLARE_NON_COPYABLE(InstanceTable)
+};
+
+// Publishes the stats of every instance in this process into the
+// InstanceTable, from one background thread, so the audio thread never
+// touches the shared memory. Use through SharedResourcePointer.
+class InstanceRegistry : public Thread {
+public:
+  class Source {
+  public:
+    virtual ~Source() {}
+
+    // Called on the registry thread. Fill in the stats; the registry sets
+    // pid, instance, host and updated_ms.
+    virtual void GetInstanceSnapshot(InstanceSnapshot* snapshot) = 0;
+  };
+
+  InstanceRegistry();
+  ~InstanceRegistry();
+
+  // Message thread. After Remove() returns the source is no longer called.
+  void Add(Source* source);
+  void Remove(Source* source);
+
+  void run() override;
+
+private:
+  enum { PUBLISH_INTERVAL_MS = 250 };
+
+  struct Entry {
+    Source* source;
+    int slot;
+    uint32 instance;
+  };
+
+  InstanceTable table_;
+  char host_[sizeof(InstanceSnapshot::host)];
+  uint32 next_instance_ = 1;
+
+  CriticalSection lock_;
+  Array<Entry> entries_;
+};
@@ -0,0 +1,59 @@
+#include "LatenessTimeline.h"
+
+LatenessTimeline::LatenessTimeline(int64 ticks_per_second)
+  : column_ticks_(jmax<int64>(1, ticks_per_second * COLUMN_US / 1000000)) {
+  columns_.calloc(size_t(LEVELS * COLUMNS));
+  for (int i = 0; i < LEVELS * COLUMNS; i++) columns_[i].index = -1;
+}
+
+void LatenessTimeline::TimingRecordsReceived(const TimingRecord* records, int count) {
+  ScopedLock l(lock_);
+  for (int i = 0; i < count; i++) {
+    const TimingRecord& record = records[i];
+    // Later pieces of a split period just carry the first one's delta.
+    if ((record.flags & TIMING_FLAG_SUB_BLOCK) || record.ticks < 0) continue;
+    const uint32 flags = record.flags & (TIMING_FLAG_WARNING | TIMING_FLAG_DROPOUT);
+    const int64 column0 = record.ticks / column_ticks_;
+    for (int level = 0; level < LEVELS; level++) {
+      const int64 index = column0 >> (ZOOM_BITS * level);
+      TimelineColumn& column = columns_[level * COLUMNS + int(index & (COLUMNS - 1))];
+      if (column.index == index) {
+        column.min_delta = jmin(column.min_delta, record.delta);
+        column.max_delta = jmax(column.max_delta, record.delta);
+        column.count++;
+        column.flags |= flags;
+      } else if (column.index < index) {
+        column.index = index;
+        column.min_delta = record.delta;
+        column.max_delta = record.delta;
+        column.count = 1;
+        column.flags = flags;
+      }
+      // Else the record is older than what the slot holds now (the clock
+      // went backwards); leave it out.
+    }
+    newest_ = jmax(newest_, column0);
+    record_count_++;
+  }
+}
+
+int64 LatenessTimeline::GetNewestColumn(int level, int64* record_count) const {
+  ScopedLock l(lock_);
+  *record_count = record_count_;
+  return newest_ < 0 ? -1 : newest_ >> (ZOOM_BITS * level);
+}
+
+void LatenessTimeline::GetColumns(int level, int64 first, int count, TimelineColumn* out) const {
+  ScopedLock l(lock_);
+  const TimelineColumn* ring = columns_ + level * COLUMNS;
+  for (int i = 0; i < count; i++) {
+    const int64 index = first + i;
+    const TimelineColumn& column = ring[int(index & (COLUMNS - 1))];
+    if (index >= 0 && column.index == index) {
+      out[i] = column;
+    } else {
+      zerostruct(out[i]);
+      out[i].index = -1;
+    }
+  }
+}
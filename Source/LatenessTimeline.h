@@ -0,0 +1,67 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "TimingRecord.h"
+
+// Callbacks that fell in one timeline column.
+struct TimelineColumn {
+  int64 index;      // Column number at its level (ticks / column ticks), or -1 if empty.
+  float min_delta;  // Lateness, in blocks.
+  float max_delta;
+  uint32 count;     // Device period starts.
+  uint32 flags;     // TIMING_FLAG_WARNING and TIMING_FLAG_DROPOUT, if any callback had them.
+};
+
+// Per-callback lateness over the last day or so, at every zoom level, in
+// constant memory.
+//
+// A pyramid of LEVELS rings of COLUMNS columns each. A level 0 column
+// covers COLUMN_US microseconds, and each level's columns are ZOOM times
+// wider than the one below, so level 0 resolves single callbacks and the
+// top level spans days. Like RollingStats, each column is tagged with the
+// absolute column number it holds, so a record just folds into the current
+// column of every level, reclaiming any whose tag is out of date, and a gap
+// in processing leaves stale columns that readers see as empty.
+//
+// It is a TimingRecordStream listener, so the pyramid is built on the drain
+// thread; readers copy columns out under a lock the audio thread never
+// takes.
+class LatenessTimeline : public TimingRecordStream::Listener {
+public:
+  enum {
+    LEVELS = 12,
+    COLUMNS = 512,        // Per level; a power of two.
+    ZOOM = 4,             // Each level over the one below.
+    ZOOM_BITS = 2,
+    COLUMN_US = 250,      // Level 0.
+  };
+
+  explicit LatenessTimeline(int64 ticks_per_second);
+
+  // Drain thread.
+  void TimingRecordsReceived(const TimingRecord* records, int count) override;
+
+  // Width of a column at the level.
+  int64 GetColumnTicks(int level) const {
+    return column_ticks_ << (ZOOM_BITS * level);
+  }
+
+  // Any thread. Column number of the newest record at the level, or -1 if
+  // there hasn't been one. Also returns how many records have gone in, so
+  // callers can tell whether a column they drew has changed.
+  int64 GetNewestColumn(int level, int64* record_count) const;
+
+  // Any thread. Copies columns first .. first + count - 1 of the level into
+  // out; any the pyramid no longer (or never) held come back with index -1.
+  void GetColumns(int level, int64 first, int count, TimelineColumn* out) const;
+
+private:
+  const int64 column_ticks_;  // Level 0.
+
+  CriticalSection lock_;
+  int64 newest_ = -1;         // Level 0 column.
+  int64 record_count_ = 0;
+  HeapBlock<TimelineColumn> columns_;  // LEVELS rings of COLUMNS.
+
+  JUCE_DECLARE_NON_COPYABLE(LatenessTimeline)
+};
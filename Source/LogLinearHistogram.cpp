@@ -0,0 +1,65 @@
+#include "LogLinearHistogram.h"
+
+int64 LogLinearHistogram::BucketLow(int index) {
+  if (index < 2 * SUB_BUCKETS) return index;
+  const int shift = index / SUB_BUCKETS - 1;
+  return int64(index % SUB_BUCKETS + SUB_BUCKETS) << shift;
+}
+
+int64 LogLinearHistogram::BucketHigh(int index) {
+  if (index < 2 * SUB_BUCKETS) return index + 1;
+  const int shift = index / SUB_BUCKETS - 1;
+  return int64(index % SUB_BUCKETS + SUB_BUCKETS + 1) << shift;
+}
+
+void LogLinearHistogram::Clear() {
+  for (int i = 0; i < NUM_BUCKETS; i++) counts_[i] = 0;
+  total_ = 0;
+  max_ = 0;
+}
+
+void LogLinearHistogram::Add(const LogLinearHistogram& other) {
+  for (int i = 0; i < NUM_BUCKETS; i++) counts_[i] += other.counts_[i];
+  total_ += other.total_;
+  max_ = jmax(max_, other.max_);
+}
+
+int64 LogLinearHistogram::GetValueAtPercentile(double percentile) const {
+  if (total_ == 0) return 0;
+  if (percentile >= 100) return max_;
+  // Rank of the value we want, counting from 1.
+  const uint64 rank = jmax<uint64>(1, uint64(std::ceil(percentile / 100 * total_)));
+  uint64 seen = 0;
+  for (int i = 0; i < NUM_BUCKETS; i++) {
+    seen += counts_[i];
+    if (seen >= rank) {
+      // Middle of the bucket, but never past the true maximum.
+      return jmin(max_, (BucketLow(i) + BucketHigh(i) - 1) / 2);
+    }
+  }
+  return max_;
+}
+
+void HistogramRecorder::Clear() {
+  for (int i = 0; i < LogLinearHistogram::NUM_BUCKETS; i++) {
+    counts_[i].store(0, std::memory_order_relaxed);
+  }
+  max_.store(0, std::memory_order_relaxed);
+}
+
+void HistogramRecorder::Restore(const LogLinearHistogram& snapshot) {
+  for (int i = 0; i < LogLinearHistogram::NUM_BUCKETS; i++) {
+    counts_[i].store(snapshot.counts_[i], std::memory_order_relaxed);
+  }
+  max_.store(snapshot.max_, std::memory_order_relaxed);
+}
+
+void HistogramRecorder::GetSnapshot(LogLinearHistogram* snapshot) const {
+  snapshot->total_ = 0;
+  for (int i = 0; i < LogLinearHistogram::NUM_BUCKETS; i++) {
+    const uint64 count = counts_[i].load(std::memory_order_relaxed);
+    snapshot->counts_[i] = count;
+    snapshot->total_ += count;
+  }
+  snapshot->max_ = max_.load(std::memory_order_relaxed);
+}
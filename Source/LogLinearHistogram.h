@@ -0,0 +1,131 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#include <atomic>
+
+// Histogram of non-negative integer values (nanoseconds, here) with a fixed
+// relative precision over a wide range, in the style of HdrHistogram. Values
+// below 2 * SUB_BUCKETS get a bucket each; above that, every power of two is
+// split into SUB_BUCKETS linear buckets, so a bucket is never wider than
+// 1/SUB_BUCKETS (about 3%) of the values in it. With MAX_VALUE_BITS = 36 that
+// is 1 ns to about a minute in 1024 buckets.
+//
+// This is the plain value type: snapshots, merging across instances or time
+// windows, and percentile queries. HistogramRecorder is the version the
+// audio thread writes to.
+class LogLinearHistogram {
+public:
+  enum {
+    SUB_BUCKET_BITS = 5,
+    SUB_BUCKETS = 1 << SUB_BUCKET_BITS,
+    MAX_VALUE_BITS = 36,
+    NUM_BUCKETS = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS,
+  };
+
+  LogLinearHistogram() {
+    Clear();
+  }
+
+  // O(1). Values past the top of the range land in the last bucket, but
+  // still count towards GetMax().
+  static int BucketIndex(int64 value) {
+    if (value < 2 * SUB_BUCKETS) return int(jmax<int64>(0, value));
+    const uint64 v = uint64(value);
+    const int top_bit = (v >> 32) ? 32 + findHighestSetBit(uint32(v >> 32))
+                                  : findHighestSetBit(uint32(v));
+    const int shift = top_bit - SUB_BUCKET_BITS;
+    const int index = (shift + 1) * SUB_BUCKETS + int(v >> shift) - SUB_BUCKETS;
+    return jmin(index, int(NUM_BUCKETS) - 1);
+  }
+
+  // Smallest value that lands in bucket index.
+  static int64 BucketLow(int index);
+
+  // One past the largest value that lands in bucket index.
+  static int64 BucketHigh(int index);
+
+  void Clear();
+
+  void Record(int64 value) {
+    counts_[BucketIndex(value)]++;
+    total_++;
+    if (value > max_) max_ = value;
+  }
+
+  // Adds other's counts to this one.
+  void Add(const LogLinearHistogram& other);
+
+  // Adds count values to bucket index, e.g. when reading counts back from
+  // disk. The maximum only learns the bottom of the bucket.
+  void AddCount(int index, uint64 count) {
+    if (count == 0) return;
+    counts_[index] += count;
+    total_ += int64(count);
+    max_ = jmax(max_, BucketLow(index));
+  }
+
+  // Where the exact maximum is known, as when it was saved alongside.
+  void RaiseMax(int64 value) {
+    max_ = jmax(max_, value);
+  }
+
+  int64 GetTotalCount() const {
+    return total_;
+  }
+
+  uint64 GetCount(int index) const {
+    return counts_[index];
+  }
+
+  int64 GetMax() const {
+    return max_;
+  }
+
+  // Value at or below which percentile% of the recorded values fall, to
+  // within the bucket precision. 100 gives the exact maximum; 0 if empty.
+  int64 GetValueAtPercentile(double percentile) const;
+
+private:
+  friend class HistogramRecorder;
+
+  uint64 counts_[NUM_BUCKETS];
+  int64 total_;
+  int64 max_;
+};
+
+// LogLinearHistogram with one writer thread and any number of readers. The
+// writer never waits and never does a read-modify-write; readers copy the
+// buckets into a snapshot. A snapshot taken while the writer is recording
+// may be one value behind in some buckets, which doesn't matter for
+// percentiles.
+class HistogramRecorder {
+public:
+  HistogramRecorder() {
+    Clear();
+  }
+
+  // Writer thread only.
+  void Record(int64 value) {
+    std::atomic<uint64>& count = counts_[LogLinearHistogram::BucketIndex(value)];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (value > max_.load(std::memory_order_relaxed)) {
+      max_.store(value, std::memory_order_relaxed);
+    }
+  }
+
+  // Writer thread only.
+  void Clear();
+
+  // Writer thread only. Replaces the counts with snapshot's.
+  void Restore(const LogLinearHistogram& snapshot);
+
+  // Any thread.
+  void GetSnapshot(LogLinearHistogram* snapshot) const;
+
+private:
+  std::atomic<uint64> counts_[LogLinearHistogram::NUM_BUCKETS];
+  std::atomic<int64> max_;
+
+  JUCE_DECLARE_NON_COPYABLE(HistogramRecorder)
+};
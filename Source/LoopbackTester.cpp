@@ -0,0 +1,177 @@
+#include "LoopbackTester.h"
+
+namespace {
+
+// x^16 + x^14 + x^13 + x^11 + 1, maximal length.
+const uint32 LFSR_TAPS = 0xb400;
+
+uint32 Step16(uint32 state) {
+  for (int i = 0; i < 16; i++) {
+    state = (state >> 1) ^ ((0u - (state & 1)) & LFSR_TAPS);
+  }
+  return state;
+}
+
+}  // namespace
+
+PrbsSequence::PrbsSequence() {
+  for (int i = 0; i < 65536; i++) positions_[i] = -1;
+  // 16 steps at a time still visits every nonzero state, since 16 and the
+  // period are coprime.
+  uint32 state = 1;
+  for (int i = 0; i < PERIOD; i++) {
+    state = Step16(state);
+    samples_[i] = int16(state) / 32768.0f;
+    positions_[state] = i;
+  }
+}
+
+LoopbackTester::LoopbackTester(int64 ticks_per_second)
+  : ticks_per_second_(double(ticks_per_second)) {
+  Reset();
+}
+
+void LoopbackTester::Prepare(double sample_rate) {
+  ticks_per_sample_ = sample_rate > 0 ? ticks_per_second_ / sample_rate : 0;
+  lost_lock_samples_ = jmax<int64>(CONFIRM, int64(sample_rate));
+  Reset();
+}
+
+void LoopbackTester::Reset() {
+  generate_ = 0;
+  locked_ = false;
+  expect_ = 0;
+  pending_bad_ = 0;
+  candidate_count_ = 0;
+  zerostruct(report_);
+  stats_.Write(report_);
+}
+
+void LoopbackTester::AddEvent(LoopbackEventKind kind, int64 samples, int64 ticks) {
+  LoopbackEvent& event = report_.recent[report_.event_count % LoopbackStats::RECENT_EVENTS];
+  event.ticks = ticks;
+  event.kind = kind;
+  event.samples = int32(jmin<int64>(samples, 0x7fffffff));
+  report_.event_count++;
+}
+
+void LoopbackTester::Relock() {
+  if (locked_) {
+    // `bad` samples arrived between the last good one and the new run,
+    // which is `slip` samples off from where the sequence should be. A
+    // forward slip is samples that never arrived; a backward one is extra
+    // samples (repeated, or inserted silence), and any bad samples beyond
+    // those were corrupted in place.
+    int slip = candidate_start_ - candidate_expect_;
+    if (slip > PrbsSequence::PERIOD / 2) slip -= PrbsSequence::PERIOD;
+    if (slip < -PrbsSequence::PERIOD / 2) slip += PrbsSequence::PERIOD;
+    const int64 bad = pending_bad_ - candidate_count_;
+    const int64 corrupted = jmax<int64>(0, bad - jmax(0, -slip));
+    if (corrupted > 0) {
+      report_.corrupted += corrupted;
+      report_.corrupt_events++;
+      AddEvent(LOOPBACK_CORRUPTED, corrupted, bad_ticks_);
+    }
+    if (slip > 0) {
+      report_.dropped += slip;
+      report_.drop_events++;
+      AddEvent(LOOPBACK_DROPPED, slip, bad > 0 ? bad_ticks_ : candidate_ticks_);
+    } else if (slip < 0) {
+      report_.repeated -= slip;
+      report_.repeat_events++;
+      AddEvent(LOOPBACK_REPEATED, -slip, bad > 0 ? bad_ticks_ : candidate_ticks_);
+    }
+  } else {
+    report_.lock_count++;
+    AddEvent(LOOPBACK_LOCKED, 0, candidate_ticks_);
+  }
+  locked_ = true;
+  expect_ = candidate_next_;
+  pending_bad_ = 0;
+  candidate_count_ = 0;
+}
+
+void LoopbackTester::CheckSample(float sample, int64 ticks) {
+  const int position = sequence_->GetPosition(sample);
+  if (locked_ && position == expect_) {
+    if (pending_bad_ > 0) {
+      report_.corrupted += pending_bad_;
+      report_.corrupt_events++;
+      AddEvent(LOOPBACK_CORRUPTED, pending_bad_, bad_ticks_);
+      pending_bad_ = 0;
+    }
+    candidate_count_ = 0;
+    expect_ = Advance(expect_, 1);
+    return;
+  }
+
+  if (pending_bad_ == 0) bad_ticks_ = ticks;
+  pending_bad_++;
+  if (position >= 0 && candidate_count_ > 0 && position == candidate_next_) {
+    candidate_count_++;
+  } else if (position >= 0) {
+    candidate_count_ = 1;
+    candidate_start_ = position;
+    candidate_expect_ = expect_;
+    candidate_ticks_ = ticks;
+  } else {
+    candidate_count_ = 0;
+  }
+  candidate_next_ = Advance(position, 1);
+  expect_ = Advance(expect_, 1);
+
+  if (candidate_count_ >= CONFIRM) {
+    Relock();
+  } else if (locked_ && pending_bad_ > lost_lock_samples_) {
+    AddEvent(LOOPBACK_LOST_LOCK, pending_bad_, bad_ticks_);
+    locked_ = false;
+    pending_bad_ = 0;
+  }
+}
+
+void LoopbackTester::Check(const float* data, int num_samples, int64 ticks) {
+  report_.samples_checked += num_samples;
+  if (locked_ && pending_bad_ == 0) {
+    // The common case: the whole block is the next stretch of the sequence,
+    // bit for bit.
+    const float* expected = sequence_->GetSamples();
+    bool match = true;
+    int position = expect_;
+    for (int i = 0; i < num_samples;) {
+      const int count = jmin(num_samples - i, PrbsSequence::PERIOD - position);
+      match &= memcmp(data + i, expected + position, count * sizeof(float)) == 0;
+      position = Advance(position, count);
+      i += count;
+    }
+    if (match) {
+      expect_ = position;
+      return;
+    }
+  }
+  for (int i = 0; i < num_samples; i++) {
+    CheckSample(data[i], ticks + int64(i * ticks_per_sample_));
+  }
+}
+
+void LoopbackTester::Process(AudioSampleBuffer& buffer, int num_inputs, int num_outputs, int64 ticks) {
+  const int num_samples = buffer.getNumSamples();
+  if (num_inputs > 0) Check(buffer.getReadPointer(0), num_samples, ticks);
+  report_.locked = locked_;
+  if (locked_) {
+    // From this block's first output sample back to its first input sample.
+    const int input = Advance(expect_, PrbsSequence::PERIOD - num_samples % PrbsSequence::PERIOD);
+    report_.latency_samples = Advance(generate_, PrbsSequence::PERIOD - input);
+  }
+
+  const float* samples = sequence_->GetSamples();
+  for (int i = 0; i < num_samples;) {
+    const int count = jmin(num_samples - i, PrbsSequence::PERIOD - generate_);
+    for (int c = 0; c < jmin(num_outputs, buffer.getNumChannels()); c++) {
+      memcpy(buffer.getWritePointer(c) + i, samples + generate_, count * sizeof(float));
+    }
+    generate_ = Advance(generate_, count);
+    i += count;
+  }
+
+  stats_.Write(report_);
+}
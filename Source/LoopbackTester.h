@@ -0,0 +1,138 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "SeqLock.h"
+
+enum LoopbackEventKind {
+  LOOPBACK_LOCKED,      // Found the sequence on the input.
+  LOOPBACK_DROPPED,     // The input skipped ahead `samples`.
+  LOOPBACK_REPEATED,    // The input went back `samples`: repeated, or silence inserted.
+  LOOPBACK_CORRUPTED,   // `samples` in a row didn't match, then the sequence carried on.
+  LOOPBACK_LOST_LOCK,   // Nothing matched for a second; `samples` unaccounted.
+};
+
+struct LoopbackEvent {
+  int64 ticks;          // Of the first affected input sample.
+  int32 kind;           // LoopbackEventKind.
+  int32 samples;
+};
+
+// What the loopback checker has seen since it was switched on or reset.
+struct LoopbackStats {
+  enum { RECENT_EVENTS = 8 };
+
+  int32 locked;
+  int32 latency_samples;   // Output to input, as last measured while locked.
+  int64 samples_checked;
+  int64 dropped;           // Samples.
+  int64 repeated;
+  int64 corrupted;
+  int64 drop_events;
+  int64 repeat_events;
+  int64 corrupt_events;
+  int64 lock_count;
+  int64 event_count;       // All events ever; the newest is recent[(event_count - 1) % RECENT_EVENTS].
+  LoopbackEvent recent[RECENT_EVENTS];
+};
+
+// The test sequence: a 16-bit maximal-length LFSR stepped 16 times per
+// sample, so each sample carries 16 fresh pseudo-random bits and any one
+// sample value identifies its position in the 65535-sample period. Sample
+// values are 16-bit codes scaled to [-1, 1), so they survive any
+// bit-transparent path of 16 bits or more. Built once per process.
+class PrbsSequence {
+public:
+  enum { PERIOD = 65535 };
+
+  PrbsSequence();
+
+  float GetSample(int position) const {
+    return samples_[position];
+  }
+
+  const float* GetSamples() const {
+    return samples_;
+  }
+
+  // Position of a received sample, or -1 if it isn't in the sequence.
+  int GetPosition(float sample) const {
+    const float scaled = sample * 32768.0f;
+    if (!(scaled >= -32768.0f && scaled < 32768.0f)) return -1;
+    const int code = int(scaled);
+    if (float(code) != scaled) return -1;
+    return positions_[code & 0xffff];
+  }
+
+private:
+  float samples_[PERIOD];
+  int32 positions_[65536];
+
+  JUCE_DECLARE_NON_COPYABLE(PrbsSequence)
+};
+
+// Loopback test mode: writes the PRBS to the outputs and checks that it
+// comes back, in order, on the first input, after any fixed delay (a cable,
+// or a software loopback through the host's graph).
+//
+// While locked, each block is compared against the expected stretch of the
+// sequence in one branch-free pass. On a mismatch the block is walked
+// sample by sample: a sample that matches the expected position carries on
+// (anything between is counted as corrupted), and a run of CONFIRM samples
+// that follow each other somewhere else in the sequence relocks there. The
+// distance from the expected position is the number of samples dropped, or
+// if negative, the number of extra samples (repeated or inserted). Slips are
+// exact up to half the period (about 0.7 s at 48 kHz).
+class LoopbackTester {
+public:
+  enum {
+    CONFIRM = 8,
+  };
+
+  explicit LoopbackTester(int64 ticks_per_second);
+
+  // Audio thread (or prepareToPlay). Starts a new test.
+  void Prepare(double sample_rate);
+  void Reset();
+
+  // Audio thread. Checks input channel 0, then overwrites every output
+  // channel with the sequence.
+  void Process(AudioSampleBuffer& buffer, int num_inputs, int num_outputs, int64 ticks);
+
+  // Any thread.
+  void GetStats(LoopbackStats* stats) const {
+    stats_.Read(stats);
+  }
+
+private:
+  void Check(const float* data, int num_samples, int64 ticks);
+  void CheckSample(float sample, int64 ticks);
+  void Relock();
+  void AddEvent(LoopbackEventKind kind, int64 samples, int64 ticks);
+
+  static int Advance(int position, int count) {
+    position += count;
+    return position >= PrbsSequence::PERIOD ? position - PrbsSequence::PERIOD : position;
+  }
+
+  SharedResourcePointer<PrbsSequence> sequence_;
+  const double ticks_per_second_;
+  double ticks_per_sample_ = 0;
+  int64 lost_lock_samples_ = 48000;
+
+  // Audio thread.
+  int generate_ = 0;           // Position of the next output sample.
+  bool locked_ = false;
+  int expect_ = 0;             // Position expected for the next input sample.
+  int64 pending_bad_ = 0;      // Mismatches since the last good sample.
+  int64 bad_ticks_ = 0;        // When they started.
+  int candidate_count_ = 0;    // Consecutive samples following each other elsewhere.
+  int candidate_start_ = 0;
+  int candidate_next_ = 0;
+  int candidate_expect_ = 0;   // What was expected where the candidate started.
+  int64 candidate_ticks_ = 0;
+  LoopbackStats report_;
+
+  SeqLock<LoopbackStats> stats_;
+
+  JUCE_DECLARE_NON_COPYABLE(LoopbackTester)
+};
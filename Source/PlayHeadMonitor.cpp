@@ -0,0 +1,74 @@
+#include "PlayHeadMonitor.h"
+
+namespace {
+
+void Increment(std::atomic<int64>* counter) {
+  counter->store(counter->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+void PlayHeadMonitor::Reset() {
+  have_last_ = false;
+  last_playing_ = false;
+  next_position_ = 0;
+  has_position_.store(false, std::memory_order_relaxed);
+  playing_.store(false, std::memory_order_relaxed);
+  position_.store(0, std::memory_order_relaxed);
+  starts_.store(0, std::memory_order_relaxed);
+  stops_.store(0, std::memory_order_relaxed);
+  seeks_.store(0, std::memory_order_relaxed);
+  loops_.store(0, std::memory_order_relaxed);
+  gaps_.store(0, std::memory_order_relaxed);
+  gap_samples_.store(0, std::memory_order_relaxed);
+}
+
+void PlayHeadMonitor::Process(AudioPlayHead* play_head, TimingRecord* record) {
+  AudioPlayHead::CurrentPositionInfo info;
+  if (play_head == nullptr || !play_head->getCurrentPosition(info)) {
+    // Nothing to compare the next position with.
+    have_last_ = false;
+    has_position_.store(false, std::memory_order_relaxed);
+    return;
+  }
+
+  const bool playing = info.isPlaying || info.isRecording;
+  if (have_last_) {
+    if (playing != last_playing_) {
+      Increment(playing ? &starts_ : &stops_);
+      record->flags |= TIMING_FLAG_TRANSPORT;
+    } else if (playing) {
+      const int64 jump = info.timeInSamples - next_position_;
+      if (jump < -TOLERANCE_SAMPLES) {
+        Increment(info.isLooping ? &loops_ : &seeks_);
+        record->flags |= TIMING_FLAG_TRANSPORT;
+      } else if (jump > int64(MAX_GAP_BLOCKS) * record->num_samples) {
+        Increment(&seeks_);
+        record->flags |= TIMING_FLAG_TRANSPORT;
+      } else if (jump > TOLERANCE_SAMPLES) {
+        Increment(&gaps_);
+        gap_samples_.store(gap_samples_.load(std::memory_order_relaxed) + jump, std::memory_order_relaxed);
+        record->flags |= TIMING_FLAG_HOST_GAP;
+      }
+    }
+  }
+
+  have_last_ = true;
+  last_playing_ = playing;
+  next_position_ = info.timeInSamples + record->num_samples;
+  has_position_.store(true, std::memory_order_relaxed);
+  playing_.store(playing, std::memory_order_relaxed);
+  position_.store(info.timeInSamples, std::memory_order_relaxed);
+}
+
+void PlayHeadMonitor::GetStats(PlayHeadStats* stats) const {
+  stats->has_position = has_position_.load(std::memory_order_relaxed);
+  stats->playing = playing_.load(std::memory_order_relaxed);
+  stats->position = position_.load(std::memory_order_relaxed);
+  stats->starts = starts_.load(std::memory_order_relaxed);
+  stats->stops = stops_.load(std::memory_order_relaxed);
+  stats->seeks = seeks_.load(std::memory_order_relaxed);
+  stats->loops = loops_.load(std::memory_order_relaxed);
+  stats->gaps = gaps_.load(std::memory_order_relaxed);
+  stats->gap_samples = gap_samples_.load(std::memory_order_relaxed);
+}
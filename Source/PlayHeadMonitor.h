@@ -0,0 +1,79 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "TimingRecord.h"
+
+#include <atomic>
+
+// What PlayHeadMonitor has seen of the host's transport since the last
+// reset.
+struct PlayHeadStats {
+  bool has_position;     // The host reported a position for the latest block.
+  bool playing;
+  int64 position;        // Samples, of the latest block.
+  int64 starts;
+  int64 stops;
+  int64 seeks;
+  int64 loops;
+  int64 gaps;            // The host skipped audio while playing.
+  int64 gap_samples;
+};
+
+// Checks the host's play head for continuity from one block to the next.
+//
+// The detector times the device stream, which doesn't stop for the
+// transport, but many hosts stall a callback or two when the transport
+// starts or stops, or when they seek or loop, and that looked like a
+// dropout. Here those jumps are recognised, and the record is flagged
+// TIMING_FLAG_TRANSPORT so the detector finds a new baseline instead. A
+// position that runs ahead of the samples delivered while playing, by a few
+// blocks at most, is the host skipping audio of its own: that is flagged
+// TIMING_FLAG_HOST_GAP and counted, but still timed. Positions while
+// stopped mean nothing and are ignored.
+//
+// One getCurrentPosition() into a CurrentPositionInfo on the stack per
+// block; nothing is allocated.
+class PlayHeadMonitor {
+public:
+  enum {
+    TOLERANCE_SAMPLES = 1,  // Hosts that derive the position from beats round it.
+    MAX_GAP_BLOCKS = 8,     // A longer jump forward is a seek.
+  };
+
+  PlayHeadMonitor() {}
+
+  // Audio thread.
+  void Reset();
+
+  // Audio thread. Forgets the last position, keeping the counts, when
+  // there were blocks this didn't see.
+  void Rebase() {
+    have_last_ = false;
+  }
+
+  // Audio thread, before the detector sees the record. play_head may be
+  // null. ORs TIMING_FLAG_TRANSPORT or TIMING_FLAG_HOST_GAP into
+  // record->flags.
+  void Process(AudioPlayHead* play_head, TimingRecord* record);
+
+  // Any thread.
+  void GetStats(PlayHeadStats* stats) const;
+
+private:
+  // Audio thread.
+  bool have_last_ = false;
+  bool last_playing_ = false;
+  int64 next_position_ = 0;   // Where the previous block says this one starts.
+
+  std::atomic<bool> has_position_{false};
+  std::atomic<bool> playing_{false};
+  std::atomic<int64> position_{0};
+  std::atomic<int64> starts_{0};
+  std::atomic<int64> stops_{0};
+  std::atomic<int64> seeks_{0};
+  std::atomic<int64> loops_{0};
+  std::atomic<int64> gaps_{0};
+  std::atomic<int64> gap_samples_{0};
+
+  JUCE_DECLARE_NON_COPYABLE(PlayHeadMonitor)
+};
@@ -6,35 +6,69 @@ const int meter_width = 256 + 1;
 const int meter_right = meter_left + meter_width;
 const int meter_top = 20;
 const int meter_height = 15;
+const int text_height = 15;
+
+const int text_top = meter_top + meter_height + 5;
+const int percentile_top = text_top + 2 * (text_height + 5);
+const int percentile_height = 12;
 
 const int plugin_width = meter_width + 50;
-const int plugin_height = 102;
+const int windows_top = percentile_top + 2 * (percentile_height + 2);
+const int forecast_top = windows_top + percentile_height + 2;
+const int advice_top = forecast_top + percentile_height + 2;
+const int transport_top = advice_top + percentile_height + 2;
+const int render_top = transport_top + percentile_height + 2;
+const int chain_top = render_top + percentile_height + 4;
+const int chain_role_width = 80;
+const int chain_id_width = 55;
+const int signal_top = chain_top + text_height + 4;
+const int loopback_top = signal_top + text_height + 4;
+const int telemetry_top = loopback_top + text_height + 4;
+const int system_top = telemetry_top + text_height + 4;
+const int timeline_top = system_top + percentile_height + 6;
+const int timeline_height = 48 + TimelineView::READOUT_HEIGHT;
+const int plugin_height = timeline_top + timeline_height + 5 + text_height + 8;
 
-const int text_top = meter_top + meter_height + 5;
 const int text_left0 = meter_left;
 const int text_left1 = meter_left + meter_width / 4;
 const int text_left2 = text_left1 + (meter_right - text_left1) / 2;
 const int text_width0 = text_left1 - text_left0;
 const int text_width1 = text_left2 - text_left1;
 const int text_width2 = meter_right - text_left2;
-const int text_height = 15;
 
-class Repainter {
-public:
-  Repainter(DropoutspyAudioProcessorEditor* ed) : editor_(ed) {
-  }
-  void Cancel() {
-    editor_ = nullptr;
-  }
-  void Repaint() {
-    if (editor_) editor_->repaint();
-    else delete this;
+const int row_left = text_left0 + chain_role_width + chain_id_width + 10;
+
+// The histograms cover the whole run, so a few reads a second keep up.
+const int histogram_frames = EditorFrameClock::FRAMES_PER_SECOND / 5;
+
+// Formats into the caller's buffer, so nothing is allocated.
+template <int N>
+static const char* Printf(char (&buffer)[N], const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buffer, N, fmt, args);
+  va_end(args);
+  return buffer;
+}
+
+void EditorFrameClock::Add(Client* client) {
+  clients_.add(client);
+  if (clients_.size() == 1) startTimerHz(FRAMES_PER_SECOND);
+}
+
+void EditorFrameClock::Remove(Client* client) {
+  clients_.removeFirstMatchingValue(client);
+  if (clients_.size() == 0) stopTimer();
+}
+
+void EditorFrameClock::timerCallback() {
+  for (int i = 0; i < clients_.size(); i++) {
+    clients_[i]->FrameTick();
   }
-private:
-  DropoutspyAudioProcessorEditor* editor_;
-};
+}
 
-DropoutspyAudioProcessorEditor::DropoutspyAudioProcessorEditor (DropoutspyAudioProcessor& p) : AudioProcessorEditor(&p), processor(p) {
+DropoutspyAudioProcessorEditor::DropoutspyAudioProcessorEditor (DropoutspyAudioProcessor& p)
+  : AudioProcessorEditor(&p), processor(p), timeline_view_(p.getTimeline()) {
   emit_button_dropout_.setButtonText("Click on dropout");
   emit_button_dropout_.addListener(this);
   addAndMakeVisible(&emit_button_dropout_);
@@ -43,26 +77,109 @@ DropoutspyAudioProcessorEditor::DropoutspyAudioProcessorEditor (DropoutspyAudioP
   emit_button_warning_.addListener(this);
   addAndMakeVisible(&emit_button_warning_);
 
+  tsc_clock_button_.setButtonText("TSC clock");
+  tsc_clock_button_.setToggleState(processor.getUseTscClock(), dontSendNotification);
+  tsc_clock_button_.setEnabled(TscClock::IsSupported());
+  tsc_clock_button_.addListener(this);
+  addAndMakeVisible(&tsc_clock_button_);
+
+  record_button_.setButtonText("Record");
+  record_button_.setToggleState(processor.getRecording(), dontSendNotification);
+  record_button_.addListener(this);
+  addAndMakeVisible(&record_button_);
+
+  signal_button_.setButtonText("Signal scan");
+  signal_button_.setToggleState(processor.getSignalScan(), dontSendNotification);
+  signal_button_.addListener(this);
+  addAndMakeVisible(&signal_button_);
+
+  loopback_button_.setButtonText("Loopback test");
+  loopback_button_.setToggleState(processor.getLoopbackTest(), dontSendNotification);
+  loopback_button_.addListener(this);
+  addAndMakeVisible(&loopback_button_);
+
+  telemetry_button_.setButtonText("Thread stats");
+  telemetry_button_.setToggleState(processor.getThreadTelemetry() != 0, dontSendNotification);
+  telemetry_button_.addListener(this);
+  addAndMakeVisible(&telemetry_button_);
+
+  // Item IDs are the ChainProbe role plus one, and the chain ID.
+  chain_role_box_.addItem("No chain", ChainProbe::OFF + 1);
+  chain_role_box_.addItem("Chain first", ChainProbe::FIRST + 1);
+  chain_role_box_.addItem("Chain last", ChainProbe::LAST + 1);
+  chain_role_box_.setSelectedId(processor.getChainRole() + 1, dontSendNotification);
+  chain_role_box_.addListener(this);
+  addAndMakeVisible(&chain_role_box_);
+
+  for (int id = 1; id <= ChainProbe::MAX_ID; id++) {
+    char buffer[16];
+    chain_id_box_.addItem(Printf(buffer, "ID %d", id), id);
+  }
+  chain_id_box_.setSelectedId(processor.getChainId(), dontSendNotification);
+  chain_id_box_.addListener(this);
+  addAndMakeVisible(&chain_id_box_);
+
+  // Item IDs are the shortest zero run counted, in samples.
+  for (int samples = SignalScanner::MIN_ZERO_RUN; samples <= SignalScanner::MAX_MIN_ZERO_RUN; samples *= 2) {
+    char buffer[16];
+    zero_run_box_.addItem(Printf(buffer, "%d smp", samples), samples);
+  }
+  zero_run_box_.setSelectedId(processor.getMinZeroRun(), dontSendNotification);
+  zero_run_box_.addListener(this);
+  addAndMakeVisible(&zero_run_box_);
+
   reset_button_.setButtonText("Reset");
   reset_button_.addListener(this);
   addAndMakeVisible(&reset_button_);
 
+  timeline_view_.setBounds(text_left0, timeline_top, plugin_width - 2 * text_left0, timeline_height);
+  addAndMakeVisible(&timeline_view_);
+
   tulrich_button_.setButtonText("tulrich.com");
   tulrich_button_.setURL(URL("http://tulrich.com/recording/dropoutspy/"));
   addAndMakeVisible(&tulrich_button_);
 
-  setSize(plugin_width, plugin_height);
+  InitText(&block_size_text_, meter_right + 2, meter_top, 50, meter_height, meter_height, Justification::topLeft);
+  InitText(&drift_text_, text_left0, text_top + text_height + 5, text_width0, text_height, meter_height, Justification::topLeft);
+  InitText(&warnings_text_, text_left1, text_top, text_width1, text_height, meter_height, Justification::topRight);
+  InitText(&dropouts_text_, text_left2, text_top, text_width2, text_height, meter_height, Justification::topRight);
+  InitText(&late_text_, text_left0, percentile_top, meter_right - text_left0, percentile_height, percentile_height, Justification::topLeft);
+  InitText(&interval_text_, text_left0, percentile_top + percentile_height + 2, meter_right - text_left0, percentile_height, percentile_height, Justification::topLeft);
+  InitText(&windows_text_, text_left0, windows_top, meter_right - text_left0, percentile_height, percentile_height, Justification::topLeft);
+  InitText(&forecast_text_, text_left0, forecast_top, meter_right - text_left0, percentile_height, percentile_height, Justification::topLeft);
+  InitText(&advice_text_, text_left0, advice_top, meter_right - text_left0, percentile_height, percentile_height, Justification::topLeft);
+  InitText(&transport_text_, text_left0, transport_top, meter_right - text_left0, percentile_height, percentile_height, Justification::topLeft);
+  InitText(&render_text_, text_left0, render_top, meter_right - text_left0, percentile_height, percentile_height, Justification::topLeft);
+  InitText(&chain_text_, row_left, chain_top, meter_right - row_left, text_height, percentile_height, Justification::centredLeft);
+  InitText(&signal_text_, row_left, signal_top, meter_right - row_left, text_height, percentile_height, Justification::centredLeft);
+  InitText(&loopback_text_, row_left, loopback_top, meter_right - row_left, text_height, percentile_height, Justification::centredLeft);
+  InitText(&telemetry_text_, row_left, telemetry_top, meter_right - row_left, text_height, percentile_height, Justification::centredLeft);
+  InitText(&system_text_, text_left0, system_top, meter_right - text_left0, percentile_height, percentile_height, Justification::topLeft);
+  for (int i = 0; i < METER_BUCKETS; i++) bar_tops_[i] = -1;
 
-  repainter_ = new Repainter(this);
+  // Everything is painted from the cached state, so a frame where no shown
+  // value changed allocates nothing and repaints nothing.
+  setOpaque(true);
+  setSize(plugin_width, plugin_height);
+  Refresh();
+  frame_clock_->Add(this);
 }
 
 DropoutspyAudioProcessorEditor::~DropoutspyAudioProcessorEditor() {
-  repainter_->Cancel();
+  frame_clock_->Remove(this);
 }
 
 void DropoutspyAudioProcessorEditor::resized() {
   emit_button_warning_.setBounds(text_left1, text_top + text_height + 5, text_width1, text_height);
   emit_button_dropout_.setBounds(text_left2, text_top + text_height + 5, text_width2, text_height);
+  tsc_clock_button_.setBounds(text_left2, plugin_height - text_height - 5, text_width2, text_height);
+  record_button_.setBounds(text_left1, plugin_height - text_height - 5, text_width1, text_height);
+  chain_role_box_.setBounds(text_left0, chain_top, chain_role_width, text_height);
+  chain_id_box_.setBounds(text_left0 + chain_role_width + 4, chain_top, chain_id_width, text_height);
+  signal_button_.setBounds(text_left0, signal_top, chain_role_width, text_height);
+  zero_run_box_.setBounds(text_left0 + chain_role_width + 4, signal_top, chain_id_width, text_height);
+  loopback_button_.setBounds(text_left0, loopback_top, chain_role_width + 4 + chain_id_width, text_height);
+  telemetry_button_.setBounds(text_left0, telemetry_top, chain_role_width + 4 + chain_id_width, text_height);
   reset_button_.setBounds(text_left0, text_top, 35, text_height);
   //Font font(text_height * 0.6f);
   //int width = font.getStringWidth(tulrich_button_.getButtonText()) + 5;
@@ -75,38 +192,414 @@ void DropoutspyAudioProcessorEditor::buttonClicked(Button* b) {
  if (b == &reset_button_) {
     processor.DoReset();
   }
+  refresh_ = true;
 }
 
 void DropoutspyAudioProcessorEditor::buttonStateChanged(Button* b) {
+  refresh_ = true;
   if (b == &emit_button_dropout_) {
     processor.setEmitClickOnDropout(b->getToggleState());
   }
   if (b == &emit_button_warning_) {
     processor.setEmitClickOnWarning(b->getToggleState());
   }
+  if (b == &tsc_clock_button_) {
+    processor.setUseTscClock(b->getToggleState());
+  }
+  if (b == &signal_button_) {
+    processor.setSignalScan(b->getToggleState());
+  }
+  if (b == &loopback_button_) {
+    processor.setLoopbackTest(b->getToggleState());
+  }
+  if (b == &telemetry_button_) {
+    processor.setThreadTelemetry(b->getToggleState() ? ThreadTelemetry::DEFAULT_INTERVAL : 0);
+  }
+  if (b == &record_button_) {
+    processor.setRecording(b->getToggleState());
+    // Stays off if the log couldn't be created.
+    record_button_.setToggleState(processor.getRecording(), dontSendNotification);
+  }
 }
 
-static const char* Printf(const char* fmt, ...) {
-  const int BUFSIZE = 200;
-  static char buffer[BUFSIZE];
-  va_list args;
-  va_start(args, fmt);
-  vsnprintf(buffer, BUFSIZE, fmt, args);
-  va_end(args);
-  return buffer;
+void DropoutspyAudioProcessorEditor::comboBoxChanged(ComboBox* box) {
+  if (box == &chain_role_box_ || box == &chain_id_box_) {
+    processor.setChainProbe(ChainProbe::Role(chain_role_box_.getSelectedId() - 1),
+                            chain_id_box_.getSelectedId());
+  }
+  if (box == &zero_run_box_) {
+    processor.setMinZeroRun(zero_run_box_.getSelectedId());
+  }
+  refresh_ = true;
+}
+
+void DropoutspyAudioProcessorEditor::FrameTick() {
+  if (!isShowing()) return;
+  // The timeline scrolls with the clock, audio or not.
+  timeline_view_.Update();
+
+  // Everything else changes only when the audio thread publishes (every
+  // block, while playing), or when a setting changes here. Refresh() then
+  // compares what it would show with what is on screen, so only text that
+  // really changed is laid out again.
+  const uint32 version = processor.getStatsVersion();
+  if (version == stats_version_ && !refresh_ && processor.getSystemReportCount() == system_report_count_) return;
+  stats_version_ = version;
+  refresh_ = false;
+  Refresh();
+}
+
+void DropoutspyAudioProcessorEditor::InitText(TextItem* item, int x, int y, int width, int height, float font_height, int justification) {
+  item->x = x;
+  item->y = y;
+  item->width = width;
+  item->height = height;
+  item->font_height = font_height;
+  item->justification = justification;
+  item->text[0] = 0;
+  item->colour = Colours::white;
+}
+
+// Lays out and repaints the item only if it changed; `text` is usually a
+// stack buffer, so an unchanged frame allocates nothing.
+void DropoutspyAudioProcessorEditor::SetText(TextItem* item, const char* text, Colour colour) {
+  if (colour == item->colour && strncmp(text, item->text, sizeof(item->text) - 1) == 0) return;
+  Printf(item->text, "%s", text);
+  item->colour = colour;
+  item->glyphs.clear();
+  item->glyphs.addFittedText(Font(item->font_height), String::fromUTF8(item->text), float(item->x),
+                             float(item->y), float(item->width), float(item->height),
+                             Justification(item->justification), 1);
+  repaint(item->x, item->y, item->width, item->height);
+}
+
+void DropoutspyAudioProcessorEditor::Refresh() {
+  DropoutStats stats;
+  processor.getStats(&stats);
+
+  Colour bg = Colour(20, 80, 20);
+  if (stats.overflow_count) {
+    bg = Colour(80, 20, 20);
+  } else if (stats.warning_count) {
+    bg = Colour(80, 80, 20);
+  }
+  if (bg != background_) {
+    background_ = bg;
+    repaint();
+  }
+
+  RefreshHistograms(stats);
+  RefreshTick(stats);
+
+  char buffer[64];
+  // Show buffer size.
+  SetText(&block_size_text_, Printf(buffer, "%d", stats.samples_per_block), Colours::white);
+
+  // Show how far the device clock runs from the host clock.
+  SetText(&drift_text_, Printf(buffer, "%+.1f ppm", stats.drift_ppm), Colours::white);
+
+  const int warnings = int(jmin<int64>(stats.warning_count, 999));
+  SetText(&warnings_text_, Printf(buffer, "warnings: %d", warnings),
+          warnings == 0 ? Colour(192, 192, 0) : Colours::yellow);
+
+  const int dropouts = int(jmin<int64>(stats.overflow_count, 999));
+  SetText(&dropouts_text_, Printf(buffer, "dropouts: %d", dropouts),
+          dropouts == 0 ? Colour(192, 0, 0) : Colours::red);
+
+  RefreshWindows();
+  RefreshForecast();
+  RefreshAdvice();
+  RefreshTransport();
+  RefreshRender();
+  RefreshChain();
+  RefreshSignal();
+  RefreshLoopback();
+  RefreshTelemetry();
+  RefreshSystem();
+}
+
+// The meter bars and percentiles, from fresh snapshots. Copying the
+// histograms is the most expensive part of a refresh, so it only happens
+// every histogram_frames, or straight away once a warning or dropout lands.
+void DropoutspyAudioProcessorEditor::RefreshHistograms(const DropoutStats& stats) {
+  if (--histogram_wait_ > 0 && stats.warning_count == histogram_stats_.warning_count &&
+      stats.overflow_count == histogram_stats_.overflow_count && stats.period_ms == histogram_stats_.period_ms) {
+    return;
+  }
+  histogram_wait_ = histogram_frames;
+  histogram_stats_ = stats;
+  processor.getLatenessHistogram(&lateness_snapshot_);
+  processor.getIntervalHistogram(&interval_snapshot_);
+  RefreshMeter(stats);
+  RefreshPercentiles(&late_text_, "late", lateness_snapshot_);
+  RefreshPercentiles(&interval_text_, "interval", interval_snapshot_);
 }
 
-void DropoutspyAudioProcessorEditor::DrawHistoBar(Graphics& g, int i, int first_empty, int bar_count, int total_count, int max_bar) {
-  if (i >= first_empty) return;
+void DropoutspyAudioProcessorEditor::RefreshMeter(const DropoutStats& stats) {
+  // Fold the lateness histogram into the meter's buckets, which span one
+  // device period.
+  int64 histo[METER_BUCKETS] = { 0 };
+  const double meter_buckets_per_ns = (METER_BUCKETS - 1) / (stats.period_ms * 1e6);
+  for (int i = 0; i < LogLinearHistogram::NUM_BUCKETS; i++) {
+    const uint64 n = lateness_snapshot_.GetCount(i);
+    if (n == 0) continue;
+    double mid = 0.5 * (LogLinearHistogram::BucketLow(i) + LogLinearHistogram::BucketHigh(i) - 1);
+    int bucket = jlimit(0, METER_BUCKETS - 1, int(mid * meter_buckets_per_ns));
+    histo[bucket] += int64(n);
+  }
+  int64 max_bar = 0;
+  int first_empty = 0;
+  for (int i = 0; i < METER_BUCKETS; i++) {
+    max_bar = jmax(max_bar, histo[i]);
+    if (histo[i]) first_empty = i + 1;
+  }
+
+  // Repaint the span of bars whose height changed.
+  const int width = meter_width / METER_BUCKETS;
+  const int y0 = meter_top + 1;
+  const int y2 = y0 + meter_height - 2;
+  int dirty_first = -1;
+  int dirty_last = -1;
+  for (int i = 0; i < METER_BUCKETS; i++) {
+    int top = -1;
+    if (i < first_empty) {
+      int yplus = (y2 - y0) * (histo[i] / float(max_bar));
+      if (histo[i] > 0 && yplus < 1) yplus = 1;
+      top = y2 - yplus;
+    }
+    if (top == bar_tops_[i]) continue;
+    bar_tops_[i] = top;
+    if (dirty_first < 0) dirty_first = i;
+    dirty_last = i;
+  }
+  if (dirty_first >= 0) {
+    repaint(meter_left + 1 + width * dirty_first, y0, width * (dirty_last - dirty_first + 1), y2 - y0);
+  }
+}
+
+// The tick mark at the last delta value.
+void DropoutspyAudioProcessorEditor::RefreshTick(const DropoutStats& stats) {
+  float current = stats.last_delta;
+  if (current > 1.0f) current = 1.0f;
+  if (current < 0.0f) current = 0.0f;
+  const int current_x = meter_left + 1 + int((meter_width - 2) * current);
+  if (current_x != tick_x_) {
+    if (tick_x_ >= 0) repaint(tick_x_ - 1, meter_top + meter_height - 5, 3, 4);
+    repaint(current_x - 1, meter_top + meter_height - 5, 3, 4);
+    tick_x_ = current_x;
+  }
+}
+
+void DropoutspyAudioProcessorEditor::RefreshPercentiles(TextItem* item, const char* label, const LogLinearHistogram& histo) {
+  const double ms = 1e-6;
+  char buffer[128];
+  SetText(item, Printf(buffer, "%s ms  p50 %.2f  p99 %.2f  p99.9 %.2f  p99.99 %.2f  max %.2f", label,
+                       histo.GetValueAtPercentile(50) * ms,
+                       histo.GetValueAtPercentile(99) * ms,
+                       histo.GetValueAtPercentile(99.9) * ms,
+                       histo.GetValueAtPercentile(99.99) * ms,
+                       histo.GetMax() * ms),
+          Colours::white);
+}
+
+// Recent counts, next to the lifetime totals above.
+void DropoutspyAudioProcessorEditor::RefreshWindows() {
+  const RollingStats::Window windows[] = { RollingStats::LAST_MINUTE, RollingStats::LAST_HOUR, RollingStats::LAST_DAY };
+  char buffer[128];
+  int length = 0;
+  for (int i = 0; i < 3; i++) {
+    WindowStats stats;
+    processor.getWindowStats(windows[i], &stats);
+    length += snprintf(buffer + length, sizeof(buffer) - length, "%s%s: %d warn %d drop", i > 0 ? "   " : "",
+                       RollingStats::GetWindowName(windows[i]),
+                       int(jmin<int64>(stats.warnings, 999)), int(jmin<int64>(stats.dropouts, 999)));
+    length = jmin(length, int(sizeof(buffer)) - 1);
+  }
+  SetText(&windows_text_, buffer, Colours::white);
+}
+
+// Headroom now, and where the lateness tail is heading.
+void DropoutspyAudioProcessorEditor::RefreshForecast() {
+  DropoutForecast forecast;
+  processor.getForecast(&forecast);
+  char buffer[128];
+  int length = snprintf(buffer, sizeof(buffer), "headroom %.0f%%", forecast.headroom_percent);
+  if (forecast.seconds_fitted > 0) {
+    length += snprintf(buffer + length, sizeof(buffer) - length, "   tail %.2f/%.2f %+.3f/min",
+                       forecast.tail_location, forecast.tail_scale, forecast.trend_per_minute);
+    length = jmin(length, int(sizeof(buffer)) - 1);
+    if (forecast.minutes_to_dropout >= 0) {
+      snprintf(buffer + length, sizeof(buffer) - length, "   dropout ~%.0f min",
+               jmax(1.0f, forecast.minutes_to_dropout));
+    }
+  }
+  SetText(&forecast_text_, buffer, forecast.prewarning ? Colour(255, 160, 0) : Colours::white);
+}
+
+// The buffer size to run at, and how much evidence that rests on.
+void DropoutspyAudioProcessorEditor::RefreshAdvice() {
+  BufferAdvice advice;
+  processor.getBufferAdvice(&advice);
+  char buffer[128];
+  const double target_per_day = advice.target_per_hour * 24;
+  if (advice.tail_periods == 0) {
+    Printf(buffer, "buffer: not enough evidence yet (%.1f h at %d)", advice.hours, int(advice.samples_per_block));
+  } else if (advice.recommended == 0) {
+    Printf(buffer, "buffer: none up to %d meets %g drop/day (%.1f h at %d)", ADVICE_SIZES[NUM_ADVICE_SIZES - 1],
+           target_per_day, advice.hours, int(advice.samples_per_block));
+  } else {
+    Printf(buffer, "buffer: %d for under %g drop/day (%.1f h at %d)", int(advice.recommended),
+           target_per_day, advice.hours, int(advice.samples_per_block));
+  }
+  const bool too_small = advice.recommended > advice.samples_per_block;
+  SetText(&advice_text_, buffer, too_small ? Colour(255, 160, 0) : Colours::white);
+}
+
+// Host timeline jumps the timing ignored, and audio the host skipped.
+void DropoutspyAudioProcessorEditor::RefreshTransport() {
+  PlayHeadStats stats;
+  processor.getPlayHeadStats(&stats);
+  if (!stats.has_position && stats.starts + stats.stops + stats.seeks + stats.loops + stats.gaps == 0) {
+    SetText(&transport_text_, "transport: no play head", Colours::white);
+    return;
+  }
+  char buffer[128];
+  Printf(buffer, "transport: %d start/stop  %d seek  %d loop   host gaps: %d (%lld smp)",
+         int(jmin<int64>(stats.starts + stats.stops, 999)), int(jmin<int64>(stats.seeks, 999)),
+         int(jmin<int64>(stats.loops, 999)), int(jmin<int64>(stats.gaps, 999)), (long long) stats.gap_samples);
+  SetText(&transport_text_, buffer, stats.gaps == 0 ? Colours::white : Colour(255, 160, 0));
+}
+
+// Throughput of the latest offline render.
+void DropoutspyAudioProcessorEditor::RefreshRender() {
+  RenderStats stats;
+  processor.getRenderStats(&stats);
+  if (stats.renders == 0) {
+    SetText(&render_text_, "render: no offline renders yet", Colours::white);
+    return;
+  }
+  processor.getRenderHistogram(&render_snapshot_);
+  char buffer[128];
+  int length = snprintf(buffer, sizeof(buffer), "render%s: %.1fx realtime  %.0fk smp/s  block p99 %.2f ms",
+                        stats.active ? "ing" : "", stats.realtime_factor, stats.samples_per_second * 1e-3,
+                        render_snapshot_.GetValueAtPercentile(99) * 1e-6);
+  length = jmin(length, int(sizeof(buffer)) - 1);
+  if (stats.num_slowest > 0) {
+    const int start = int(stats.slowest[0].start_seconds);
+    snprintf(buffer + length, sizeof(buffer) - length, "  slowest %.1fx at %d:%02d",
+             stats.slowest[0].realtime_factor, start / 60, start % 60);
+  }
+  // Slower than realtime somewhere would have dropped out live.
+  const bool slow = stats.num_slowest > 0 && stats.slowest[0].realtime_factor < 1;
+  SetText(&render_text_, buffer, slow ? Colour(255, 160, 0) : Colours::white);
+}
+
+// Chain time as a share of the block, measured by the LAST instance.
+void DropoutspyAudioProcessorEditor::RefreshChain() {
+  const ChainProbe::Role role = processor.getChainRole();
+  if (role == ChainProbe::OFF) {
+    SetText(&chain_text_, "", Colours::white);
+    return;
+  }
+  ChainProbeStats stats;
+  processor.getChainStats(&stats);
+  char buffer[64];
+  const char* text;
+  if (role == ChainProbe::FIRST) {
+    text = stats.lasts > 0 ? "measured by last" : "no last instance";
+  } else if (stats.firsts == 0) {
+    text = "no first instance";
+  } else if (stats.blocks == 0) {
+    text = "waiting";
+  } else {
+    processor.getChainHistogram(&chain_snapshot_);
+    // The histogram is in parts per million of the block.
+    text = Printf(buffer, "p99 %.0f%%  max %.0f%%", chain_snapshot_.GetValueAtPercentile(99) * 1e-4,
+                  stats.max_fraction * 100.0);
+  }
+  SetText(&chain_text_, text, Colours::white);
+}
+
+// Events found in the audio itself, kept apart from the timing counts.
+void DropoutspyAudioProcessorEditor::RefreshSignal() {
+  if (!processor.getSignalScan()) {
+    SetText(&signal_text_, "", Colours::white);
+    return;
+  }
+  SignalStats stats;
+  processor.getSignalStats(&stats);
+  const int events = int(jmin<int64>(stats.zero_runs + stats.discontinuities, 999));
+  char buffer[64];
+  SetText(&signal_text_, Printf(buffer, "zero runs: %d  jumps: %d", int(jmin<int64>(stats.zero_runs, 999)),
+                                int(jmin<int64>(stats.discontinuities, 999))),
+          events == 0 ? Colours::white : Colour(255, 160, 0));
+}
+
+// Exact sample counts from the loopback test.
+void DropoutspyAudioProcessorEditor::RefreshLoopback() {
+  LoopbackStats stats;
+  if (!processor.getLoopbackTest() || !processor.getLoopbackStats(&stats)) {
+    SetText(&loopback_text_, "", Colours::white);
+    return;
+  }
+  char buffer[64];
+  const char* text;
+  if (!stats.locked) {
+    text = stats.lock_count == 0 ? "no signal on input" : "lost lock";
+  } else {
+    text = Printf(buffer, "lost %d  extra %d  bad %d  delay %d",
+                  int(jmin<int64>(stats.dropped, 99999)), int(jmin<int64>(stats.repeated, 99999)),
+                  int(jmin<int64>(stats.corrupted, 99999)), stats.latency_samples);
+  }
+  const bool clean = stats.dropped == 0 && stats.repeated == 0 && stats.corrupted == 0;
+  SetText(&loopback_text_, text, clean ? Colours::white : Colour(255, 160, 0));
+}
+
+// How many late blocks came right after the audio thread was moved,
+// preempted or faulted.
+void DropoutspyAudioProcessorEditor::RefreshTelemetry() {
+  if (processor.getThreadTelemetry() == 0) {
+    SetText(&telemetry_text_, "", Colours::white);
+    return;
+  }
+  ThreadTelemetryStats stats;
+  processor.getThreadTelemetryStats(&stats);
+  char buffer[64];
+  SetText(&telemetry_text_, Printf(buffer, "cpu %d  late %d: moved %d  preempt %d  fault %d", int(stats.cpu),
+                                   int(jmin<int64>(stats.late, 999)), int(jmin<int64>(stats.late_migrated, 999)),
+                                   int(jmin<int64>(stats.late_preempted, 999)),
+                                   int(jmin<int64>(stats.late_faulted, 999))),
+          stats.late == 0 ? Colours::white : Colour(255, 160, 0));
+}
+
+// What the system was doing around the latest dropout.
+void DropoutspyAudioProcessorEditor::RefreshSystem() {
+  const int64 count = processor.getSystemReportCount();
+  if (count == system_report_count_) return;
+  system_report_count_ = count;
+  SystemEventReport report;
+  if (!processor.getSystemReport(count - 1, &report)) {
+    SetText(&system_text_, "", Colours::white);
+    return;
+  }
+  const Time time(report.wall_ms);
+  char details[96];
+  char buffer[128];
+  FormatSystemEventReport(report, true, details, sizeof(details));
+  SetText(&system_text_, Printf(buffer, "dropout at %02d:%02d:%02d: %s", time.getHours(), time.getMinutes(),
+                                time.getSeconds(), details),
+          Colour(255, 160, 0));
+}
+
+void DropoutspyAudioProcessorEditor::DrawHistoBar(Graphics& g, int i) {
+  const int y1 = bar_tops_[i];
+  if (y1 < 0) return;
 
   int width = meter_width / METER_BUCKETS;
   int x = width * i + meter_left + 1;
   int y0 = meter_top + 1;
   int y2 = y0 + meter_height - 2;
-  int ymid = y2;
-  int yplus = (ymid - y0) * (bar_count / float(max_bar));
-  if (bar_count > 0 && yplus < 1) yplus = 1;
-  int y1 = ymid - yplus;
+  if (!g.clipRegionIntersects(Rectangle<int>(x, y0, width - 1, y2 - y0))) return;
 
   Colour c0 = Colour(0, 192, 0);
   Colour c1 = Colour(0, 255, 0);
@@ -124,57 +617,46 @@ void DropoutspyAudioProcessorEditor::DrawHistoBar(Graphics& g, int i, int first_
   g.fillRect(x, y1, width - 1, y2 - y1);
 }
 
+void DropoutspyAudioProcessorEditor::DrawText(Graphics& g, const TextItem& item) {
+  if (item.text[0] == 0 || !g.clipRegionIntersects(Rectangle<int>(item.x, item.y, item.width, item.height))) return;
+  g.setColour(item.colour);
+  item.glyphs.draw(g);
+}
+
+// Only draws what Refresh() left behind; the repaints it queued clip this
+// to the parts that changed.
 void DropoutspyAudioProcessorEditor::paint(Graphics& g) {
   // (Our component is opaque, so we must completely fill the background with a solid colour)
-  Colour bg = Colour(20, 80, 20);
-  if (processor.getOverflowCount()) {
-    bg = Colour(80, 20, 20);
-  } else if (processor.getWarningCount()) {
-    bg = Colour(80, 80, 20);
-  }
-  g.fillAll(bg);
+  g.fillAll(background_);
 
   g.setColour(Colours::white);
   g.drawRect(meter_left, meter_top, meter_width, meter_height);
 
-  int histo[METER_BUCKETS];
-  processor.getHisto(histo);
-  int count = 0;
-  int max_bar = 0;
-  int first_empty = 0;
-  for (int i = 0; i < METER_BUCKETS; i++) {
-    count += histo[i];
-    max_bar = std::max(max_bar, histo[i]);
-    if (histo[i]) first_empty = i + 1;
-  }
   for (int i = 0; i < METER_BUCKETS; i++) {
-    DrawHistoBar(g, i, first_empty, histo[i], count, max_bar);
+    DrawHistoBar(g, i);
   }
 
-  // Draw a tick mark at the last delta value.
-  float_t current = processor.getLastDelta();
-  if (current > 1.0f) current = 1.0f;
-  if (current < 0.0f) current = 0.0f;
-  int current_x = meter_left + 1 + (meter_width - 2) * (current);
-  g.setColour(Colours::white);
-  g.fillRect(current_x - 1, meter_top + meter_height - 3, 1, 2);
-  g.fillRect(current_x + 0, meter_top + meter_height - 5, 1, 4);
-  g.fillRect(current_x + 1, meter_top + meter_height - 3, 1, 2);
-
-  // Show buffer size.
-  g.setFont(meter_height);
-  g.drawFittedText(Printf("%d", processor.getSamplesPerBlock()), meter_right + 2, meter_top, 50, meter_height, Justification::topLeft, 0);
-
-  int warnings = int(processor.getWarningCount());
-  if (warnings > 999) warnings = 999;
-  g.setColour(warnings == 0 ? Colour(192, 192, 0) : Colours::yellow);
-  g.drawFittedText(Printf("warnings: %d", warnings), text_left1, text_top, text_width1, text_height, Justification::topRight, 1);
-
-  int dropouts = int(processor.getOverflowCount());
-  if (dropouts > 999) dropouts = 999;
-  g.setColour(dropouts == 0 ? Colour(192, 0, 0) : Colours::red);
-  g.drawFittedText(Printf("dropouts: %d", dropouts), text_left2, text_top, text_width2, text_height, Justification::topRight, 1);
+  if (tick_x_ >= 0) {
+    g.setColour(Colours::white);
+    g.fillRect(tick_x_ - 1, meter_top + meter_height - 3, 1, 2);
+    g.fillRect(tick_x_ + 0, meter_top + meter_height - 5, 1, 4);
+    g.fillRect(tick_x_ + 1, meter_top + meter_height - 3, 1, 2);
+  }
 
-  auto repainter = repainter_;
-  Timer::callAfterDelay(16, [repainter]{ repainter->Repaint(); });
+  DrawText(g, block_size_text_);
+  DrawText(g, drift_text_);
+  DrawText(g, warnings_text_);
+  DrawText(g, dropouts_text_);
+  DrawText(g, late_text_);
+  DrawText(g, interval_text_);
+  DrawText(g, windows_text_);
+  DrawText(g, forecast_text_);
+  DrawText(g, advice_text_);
+  DrawText(g, transport_text_);
+  DrawText(g, render_text_);
+  DrawText(g, chain_text_);
+  DrawText(g, signal_text_);
+  DrawText(g, loopback_text_);
+  DrawText(g, telemetry_text_);
+  DrawText(g, system_text_);
 }
@@ -12,11 +12,35 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "PluginProcessor.h"
+#include "TimelineView.h"
 
-class Repainter;
+// Drives the display of every open editor from one timer, so the message
+// thread gets one callback per frame however many editors are open. Use
+// through SharedResourcePointer.
+class EditorFrameClock : private Timer {
+public:
+  enum { FRAMES_PER_SECOND = 30 };
+
+  class Client {
+  public:
+    virtual ~Client() {}
+
+    // Message thread, once per frame.
+    virtual void FrameTick() = 0;
+  };
+
+  // Message thread.
+  void Add(Client* client);
+  void Remove(Client* client);
+
+private:
+  void timerCallback() override;
+
+  Array<Client*> clients_;
+};
 
 class DropoutspyAudioProcessorEditor : public AudioProcessorEditor,
-  private Button::Listener {
+  private Button::Listener, private ComboBox::Listener, private EditorFrameClock::Client {
 public:
   DropoutspyAudioProcessorEditor (DropoutspyAudioProcessor&);
   ~DropoutspyAudioProcessorEditor();
@@ -27,8 +51,41 @@ public:
 private:
   void buttonClicked(Button*) override;
   void buttonStateChanged(Button* b) override;
+  void comboBoxChanged(ComboBox* box) override;
+  void FrameTick() override;
+
+  // One piece of text, laid out only when it changes.
+  struct TextItem {
+    int x, y, width, height;
+    float font_height;
+    int justification;
+    char text[128];
+    Colour colour;
+    GlyphArrangement glyphs;
+  };
+
+  void InitText(TextItem* item, int x, int y, int width, int height, float font_height, int justification);
+  void SetText(TextItem* item, const char* text, Colour colour);
 
-  void DrawHistoBar(Graphics& g, int i, int first_empty, int bar_count, int total_count, int max_bar);
+  // Reads the processor and repaints whatever no longer matches the screen.
+  void Refresh();
+  void RefreshHistograms(const DropoutStats& stats);
+  void RefreshMeter(const DropoutStats& stats);
+  void RefreshTick(const DropoutStats& stats);
+  void RefreshPercentiles(TextItem* item, const char* label, const LogLinearHistogram& histo);
+  void RefreshWindows();
+  void RefreshForecast();
+  void RefreshAdvice();
+  void RefreshTransport();
+  void RefreshRender();
+  void RefreshChain();
+  void RefreshSignal();
+  void RefreshLoopback();
+  void RefreshTelemetry();
+  void RefreshSystem();
+
+  void DrawHistoBar(Graphics& g, int i);
+  void DrawText(Graphics& g, const TextItem& item);
 
   // This reference is provided as a quick way for your editor to
   // access the processor object that created it.
@@ -36,10 +93,51 @@ private:
 
   ToggleButton emit_button_dropout_;
   ToggleButton emit_button_warning_;
+  ToggleButton tsc_clock_button_;
+  ToggleButton record_button_;
+  ToggleButton signal_button_;
+  ToggleButton loopback_button_;
+  ToggleButton telemetry_button_;
+  ComboBox chain_role_box_;
+  ComboBox chain_id_box_;
+  ComboBox zero_run_box_;
   TextButton reset_button_;
   HyperlinkButton tulrich_button_;
+  TimelineView timeline_view_;
+
+  SharedResourcePointer<EditorFrameClock> frame_clock_;
+  uint32 stats_version_ = 0;
+  bool refresh_ = true;      // Redo everything at the next frame, e.g. after a setting changed.
+  int64 system_report_count_ = 0;
+  int histogram_wait_ = 0;   // Refreshes until the histograms are read again.
+  DropoutStats histogram_stats_;  // As of the last histogram read.
+
+  // What's on screen. paint() only draws from these.
+  Colour background_;
+  int bar_tops_[METER_BUCKETS];   // -1 where there's no bar.
+  int tick_x_ = -1;
+  TextItem block_size_text_;
+  TextItem drift_text_;
+  TextItem warnings_text_;
+  TextItem dropouts_text_;
+  TextItem late_text_;
+  TextItem interval_text_;
+  TextItem windows_text_;
+  TextItem forecast_text_;
+  TextItem advice_text_;
+  TextItem transport_text_;
+  TextItem render_text_;
+  TextItem chain_text_;
+  TextItem signal_text_;
+  TextItem loopback_text_;
+  TextItem telemetry_text_;
+  TextItem system_text_;
 
-  Repainter* repainter_ = nullptr;
+  // Filled in by Refresh(); members so it doesn't put them on the stack.
+  LogLinearHistogram lateness_snapshot_;
+  LogLinearHistogram interval_snapshot_;
+  LogLinearHistogram chain_snapshot_;
+  LogLinearHistogram render_snapshot_;
 
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DropoutspyAudioProcessorEditor)
 };
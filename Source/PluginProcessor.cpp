@@ -13,10 +13,23 @@ DropoutspyAudioProcessor::DropoutspyAudioProcessor()
                        )
 #endif
 {
-  DoReset();
+  PublishStats();
+  timing_records_.AddListener(&timeline_);
+  timing_records_.AddListener(&system_events_);
+  timing_records_.AddListener(&forecaster_);
+  timing_records_.AddListener(&buffer_advisor_);
+  registry_->Add(this);
 }
 
 DropoutspyAudioProcessor::~DropoutspyAudioProcessor() {
+  registry_->Remove(this);
+  timing_records_.RemoveListener(&buffer_advisor_);
+  timing_records_.RemoveListener(&forecaster_);
+  timing_records_.RemoveListener(&system_events_);
+  timing_records_.RemoveListener(&timeline_);
+  setRecording(false);
+  delete tsc_clock_.load();
+  delete loopback_.load();
 }
 
 const String DropoutspyAudioProcessor::getName() const {
@@ -63,87 +76,195 @@ void DropoutspyAudioProcessor::changeProgramName (int index, const String& newNa
 }
 
 void DropoutspyAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock) {
-  sample_rate_ = sampleRate;
-  samples_per_block_ = samplesPerBlock;
-  DoReset();
+  session_log_.SetFormat(sampleRate, samplesPerBlock);
+  buffer_advisor_.SetSampleRate(sampleRate);
+  if (TscClock* tsc = tsc_clock_.load()) {
+    tsc->Prepare();
+  }
+  reset_requested_.store(false);
+  chain_probe_.Prepare(sampleRate);
+  signal_scanner_.Prepare(sampleRate);
+  if (LoopbackTester* tester = loopback_.load()) {
+    tester->Prepare(sampleRate);
+  }
+  // A new format starts the timing over, but the counts carry on, so that
+  // restored stats survive the host preparing us after loading them.
+  detector_.SetFormat(sampleRate, samplesPerBlock);
+  play_head_.Rebase();
+  render_monitor_.Prepare(sampleRate);
+  rendering_ = false;
+  ApplyRestore();
+  PublishStats();
 }
 
-void DropoutspyAudioProcessor::ResetTrackingState(double sample_rate, int samples_per_block) {
-  start_ticks_min_ = 0;
-  start_ticks_max_ = 0;
-  sample_rate_ = sample_rate;
-  samples_per_block_ = samples_per_block;
-  total_samples_ = 0;
-  spread_ = 0;
-  last_delta_ = 0;
-  ticks_per_block_ = Time::secondsToHighResolutionTicks(samples_per_block_ / sample_rate_);
+void DropoutspyAudioProcessor::ApplyRestore() {
+  int stage = RESTORE_PENDING;
+  if (!restore_stage_.compare_exchange_strong(stage, RESTORE_APPLYING, std::memory_order_acquire)) {
+    return;
+  }
+  detector_.Restore(restore_state_, restore_shift_seconds_);
+  restore_stage_.store(RESTORE_IDLE, std::memory_order_release);
 }
 
-void DropoutspyAudioProcessor::releaseResources() {
-  // When playback stops, you can use this as an opportunity to free up any
-  // spare memory, etc.
+void DropoutspyAudioProcessor::PublishStats() {
+  DropoutStats stats;
+  detector_.GetStats(&stats);
+  stats_.Write(stats);
 }
 
-void DropoutspyAudioProcessor::processBlock (AudioSampleBuffer& buffer, MidiBuffer& midiMessages) {
-  int64 now = Time::getHighResolutionTicks();
+void DropoutspyAudioProcessor::GetInstanceSnapshot(InstanceSnapshot* snapshot) {
+  DropoutStats stats;
+  getStats(&stats);
+  snapshot->sample_rate = float(getSampleRate());
+  snapshot->samples_per_block = stats.samples_per_block;
+  snapshot->period_ms = stats.period_ms;
+  snapshot->drift_ppm = stats.drift_ppm;
+  snapshot->warning_count = stats.warning_count;
+  snapshot->overflow_count = stats.overflow_count;
+
+  snapshot->spread = stats.spread;
+
+  getLatenessHistogram(&registry_snapshot_);
+  snapshot->late_p99_ns = registry_snapshot_.GetValueAtPercentile(99);
+  snapshot->late_max_ns = registry_snapshot_.GetMax();
+  snapshot->periods = registry_snapshot_.GetTotalCount();
+  // A bucket counts towards a bound if all of it is at or below the bound.
+  int bound = 0;
+  for (int i = 0; i < LogLinearHistogram::NUM_BUCKETS; i++) {
+    const uint64 n = registry_snapshot_.GetCount(i);
+    if (n == 0) continue;
+    const int64 high = LogLinearHistogram::BucketHigh(i) - 1;
+    while (bound < InstanceSnapshot::LATE_BUCKETS && high > INSTANCE_LATE_BOUNDS_US[bound] * int64(1000)) bound++;
+    for (int j = bound; j < InstanceSnapshot::LATE_BUCKETS; j++) snapshot->late_buckets[j] += int64(n);
+    snapshot->late_sum_ns += int64(n) * ((LogLinearHistogram::BucketLow(i) + high) / 2);
+  }
 
-  ScopedLock l(lock_);
+  RenderStats render;
+  getRenderStats(&render);
+  snapshot->rendering = render.active ? 1 : 0;
+  snapshot->render_realtime_factor = render.realtime_factor;
+  snapshot->render_slowest_factor = render.num_slowest > 0 ? render.slowest[0].realtime_factor : 0;
+  snapshot->renders = render.renders;
+  snapshot->render_samples = render.samples;
+
+  WindowStats window;
+  getWindowStats(RollingStats::LAST_SECOND, &window);
+  snapshot->max_delta_1s = window.max_delta;
+  getWindowStats(RollingStats::LAST_MINUTE, &window);
+  snapshot->max_delta_1m = window.max_delta;
+  snapshot->callbacks_1m = window.callbacks;
+  snapshot->warnings_1m = window.warnings;
+  snapshot->dropouts_1m = window.dropouts;
+}
 
-  // To keep precision within reason if the plugin runs continuously for a long time, we
-  // periodically reset the start time & samples.
-  const float RESET_START_TIME_INTERVAL = 3600.0f;
-  if (total_samples_ == 0 ||
-      Time::highResolutionTicksToSeconds(now - start_ticks_min_) > RESET_START_TIME_INTERVAL) {
-    // TODO: can we determine ticks at true start of playback?
-    ResetTrackingState(sample_rate_, samples_per_block_);
-    start_ticks_min_ = now;
-    start_ticks_max_ = now;
+void DropoutspyAudioProcessor::setUseTscClock(bool use) {
+  if (use && tsc_clock_.load() == nullptr && TscClock::IsSupported()) {
+    TscClock* tsc = new TscClock();
+    TscClock* expected = nullptr;
+    if (!tsc_clock_.compare_exchange_strong(expected, tsc)) {
+      delete tsc;
+    }
   }
+  use_tsc_clock_.store(use);
+}
 
-  double seconds0 = total_samples_ / sample_rate_;
-  int64 computed_min = now - Time::secondsToHighResolutionTicks(seconds0);
-  total_samples_ += buffer.getNumSamples();
+void DropoutspyAudioProcessor::setLoopbackTest(bool test) {
+  if (test && loopback_.load() == nullptr) {
+    LoopbackTester* tester = new LoopbackTester(Time::getHighResolutionTicksPerSecond());
+    tester->Prepare(getSampleRate());
+    loopback_.store(tester, std::memory_order_release);
+  }
+  loopback_enabled_.store(test);
+}
 
-  if (computed_min < start_ticks_min_) {
-    start_ticks_min_ = computed_min;
+void DropoutspyAudioProcessor::setRecording(bool record) {
+  if (record == session_log_.IsOpen()) return;
+  if (record) {
+    if (session_log_.Open(SessionLog::GetDefaultDirectory())) {
+      timing_records_.AddListener(&session_log_);
+    }
+  } else {
+    // Once removed, the drain thread is done with the log.
+    timing_records_.RemoveListener(&session_log_);
+    session_log_.Close();
   }
-  if (computed_min > start_ticks_max_) {
-    start_ticks_max_ = computed_min;
+}
+
+ClockSource* DropoutspyAudioProcessor::SelectClock() {
+  if (external_clock_) return external_clock_;
+  if (use_tsc_clock_.load(std::memory_order_relaxed)) {
+    // Falls back to the default clock until the TSC is calibrated, or if
+    // the calibrator decides the TSC can't be trusted.
+    TscClock* tsc = tsc_clock_.load(std::memory_order_acquire);
+    if (tsc && tsc->IsCalibrated()) return tsc;
   }
+  return &default_clock_;
+}
 
-  // Compute spread values.
-  spread_ = (start_ticks_max_ - start_ticks_min_) / float(ticks_per_block_);
-  last_delta_ = (computed_min - start_ticks_min_) / float(ticks_per_block_);
+void DropoutspyAudioProcessor::releaseResources() {
+  // When playback stops, you can use this as an opportunity to free up any
+  // spare memory, etc.
+}
 
-  // Update histogram.
-  int bucket = int(last_delta_ * (METER_BUCKETS - 1));
-  if (bucket < 0) bucket = 0;
-  if (bucket >= METER_BUCKETS) bucket = METER_BUCKETS - 1;
-  delta_histo_[bucket]++;
-  if (delta_histo_[bucket] > 10000) {
-    // Prune histogram so the buckets don't ever overflow.
-    for (int i = 0; i < METER_BUCKETS; i++) {
-      if (delta_histo_[i] > 1) delta_histo_[i] = (delta_histo_[i] * 7) >> 3;
-    }
+void DropoutspyAudioProcessor::processBlock (AudioSampleBuffer& buffer, MidiBuffer& midiMessages) {
+  ClockSource* clock = SelectClock();
+  if (clock != clock_) {
+    // Timestamps from different clocks aren't comparable; start tracking over.
+    clock_ = clock;
+    detector_.ResetTracking();
   }
 
-  bool overflow_happened = false;
-  bool warning_happened = false;
-  if (spread_ > 1.0f) {
-    // Overflow or underflow!
-    overflow_happened = true;
-    overflow_count_++;
-    last_overflow_ticks_ = now;
-    ResetTrackingState(sample_rate_, samples_per_block_);
-  } else if (bucket >= METER_BUCKETS / 2) {
-    // Warning.
-    warning_happened = true;
-    warning_count_++;
+  TimingRecord record;
+  record.ticks = clock_->GetTicks();
+  record.num_samples = buffer.getNumSamples();
+  record.flags = 0;
+
+  if (reset_requested_.exchange(false, std::memory_order_acquire)) {
+    chain_probe_.Reset();
+    signal_scanner_.Reset();
+    thread_telemetry_.Reset();
+    play_head_.Reset();
+    render_monitor_.Reset();
+    loopback_running_ = false;
+    detector_.Reset();
+    record.flags |= TIMING_FLAG_RESET;
   }
+  // After the reset, so a state loaded since isn't thrown away with it.
+  ApplyRestore();
+
+  chain_probe_.Process(record.ticks, record.num_samples);
+  const bool rendering = isNonRealtime();
+  render_monitor_.Process(record.ticks, record.num_samples, rendering);
+  if (rendering) {
+    // Offline, the callbacks run as fast as the host can make them. None
+    // of it goes near the realtime stats or the record stream.
+    rendering_ = true;
+  } else {
+    if (rendering_) {
+      // Back to realtime; the stream starts over.
+      rendering_ = false;
+      detector_.ResetTracking();
+      play_head_.Rebase();
+    }
+    play_head_.Process(getPlayHead(), &record);
+    if (record.flags & TIMING_FLAG_TRANSPORT) {
+      // The host may have stalled to jump; don't count that as lateness.
+      detector_.Reanchor();
+    }
+    detector_.Process(&record);
+    thread_telemetry_.Process(&record);
+    timing_records_.Push(record);
+    PublishStats();
+  }
+  const bool overflow_happened = (record.flags & TIMING_FLAG_DROPOUT) != 0;
+  const bool warning_happened = (record.flags & TIMING_FLAG_WARNING) != 0;
 
   const int totalNumInputChannels  = getTotalNumInputChannels();
   const int totalNumOutputChannels = getTotalNumOutputChannels();
 
+  // Before any clicks go in.
+  signal_scanner_.Process(buffer, totalNumInputChannels, record.ticks);
+
   // In case we have more outputs than inputs, this code clears any output
   // channels that didn't contain input data, (because these aren't
   // guaranteed to be empty - they may contain garbage).
@@ -154,14 +275,29 @@ void DropoutspyAudioProcessor::processBlock (AudioSampleBuffer& buffer, MidiBuff
     buffer.clear (i, 0, buffer.getNumSamples());
   }
 
+  // The test sequence replaces the audio, clicks included.
+  LoopbackTester* tester = loopback_.load(std::memory_order_acquire);
+  const bool loopback = tester != nullptr && loopback_enabled_.load(std::memory_order_relaxed);
+  if (loopback != loopback_running_) {
+    // Each time the test is switched on, it starts over.
+    loopback_running_ = loopback;
+    if (loopback) tester->Reset();
+  }
+  if (loopback) {
+    tester->Process(buffer, totalNumInputChannels, totalNumOutputChannels, record.ticks);
+    return;
+  }
+
   // Process audio. Leave it untouched, unless a warning or dropout happened
   // and we are configured to emit a click on dropout.
+  const bool click_on_dropout = emit_click_on_dropout_.load(std::memory_order_relaxed);
+  const bool click_on_warning = emit_click_on_warning_.load(std::memory_order_relaxed);
   for (int channel = 0; channel < totalNumInputChannels; ++channel) {
     float* channelData = buffer.getWritePointer(channel);
-    if (emit_click_on_dropout_ && overflow_happened) {
+    if (click_on_dropout && overflow_happened) {
       // Emit a positive click.
       channelData[0] = 1.0f;
-    } else if (emit_click_on_warning_ && warning_happened) {
+    } else if (click_on_warning && warning_happened) {
       // Emit a negative click.
       channelData[0] = -1.0f;
     }
@@ -199,20 +335,89 @@ AudioProcessorEditor* DropoutspyAudioProcessor::createEditor() {
   return new DropoutspyAudioProcessorEditor(*this);
 }
 
-// Store parameters.
+void DropoutspyAudioProcessor::GetSettings(PluginSettings* settings) const {
+  settings->click_on_warning = emit_click_on_warning_.load();
+  settings->click_on_dropout = emit_click_on_dropout_.load();
+  settings->tsc_clock = use_tsc_clock_.load();
+  settings->chain_role = int32(chain_probe_.GetRole());
+  settings->chain_id = int32(chain_probe_.GetId());
+  settings->signal_scan = signal_scanner_.IsEnabled();
+  settings->min_zero_run = int32(signal_scanner_.GetMinZeroRun());
+  settings->telemetry_interval = int32(thread_telemetry_.GetInterval());
+  settings->prewarn_minutes = getPrewarnMinutes();
+  settings->target_per_day = getDropoutTarget();
+}
+
+void DropoutspyAudioProcessor::ApplySettings(const PluginSettings& settings) {
+  emit_click_on_warning_ = settings.click_on_warning;
+  emit_click_on_dropout_ = settings.click_on_dropout;
+  setUseTscClock(settings.tsc_clock);
+  setChainProbe(ChainProbe::Role(jlimit(0, int(ChainProbe::LAST), int(settings.chain_role))),
+                settings.chain_id);
+  setSignalScan(settings.signal_scan);
+  setMinZeroRun(settings.min_zero_run);
+  setThreadTelemetry(settings.telemetry_interval);
+  if (settings.prewarn_minutes > 0) setPrewarnMinutes(settings.prewarn_minutes);
+  if (settings.target_per_day > 0) setDropoutTarget(settings.target_per_day);
+}
+
+// Store parameters, and the stats so far.
 void DropoutspyAudioProcessor::getStateInformation(MemoryBlock& destData) {
-  char data = emit_click_on_warning_;
-  destData.append(&data, 1);
-  data = emit_click_on_dropout_;
-  destData.append(&data, 1);
+  const ScopedLock lock(state_lock_);
+  GetSettings(&state_.settings);
+  state_.has_stats = true;
+  state_.saved_ms = Time::currentTimeMillis();
+  const int64 second = Time::getHighResolutionTicks() / Time::getHighResolutionTicksPerSecond();
+
+  // Stats loaded but not yet handed to the detector are still the ones to
+  // keep, e.g. when a project is opened and saved again without playing.
+  int stage = RESTORE_PENDING;
+  if (restore_stage_.compare_exchange_strong(stage, RESTORE_WRITING, std::memory_order_acquire)) {
+    state_.saved_second = second - restore_shift_seconds_;
+    state_.detector = restore_state_;
+    restore_stage_.store(RESTORE_PENDING, std::memory_order_release);
+  } else {
+    state_.saved_second = second;
+    DetectorState& detector = state_.detector;
+    DropoutStats stats;
+    getStats(&stats);
+    detector.warning_count = stats.warning_count;
+    detector.overflow_count = stats.overflow_count;
+    getLatenessHistogram(&detector.lateness);
+    getIntervalHistogram(&detector.interval);
+    detector_.SaveWindows(&detector.windows);
+  }
+
+  PluginStateFormat::Write(state_, &state_bytes_);
+  destData.append(state_bytes_.data(), state_bytes_.size());
 }
 
-// Restore parameters which were stored via getStateInformation.
+// Restore parameters which were stored via getStateInformation. Saved
+// stats go to the audio thread, which picks them up at its next block (or
+// prepareToPlay).
 void DropoutspyAudioProcessor::setStateInformation(const void* data, int sizeInBytes) {
-  if (sizeInBytes > 1) {
-    emit_click_on_warning_ = ((const bool*) data)[0];
-    emit_click_on_dropout_ = ((const bool*) data)[1];
+  const ScopedLock lock(state_lock_);
+  GetSettings(&state_.settings);
+  if (!PluginStateFormat::Read(data, sizeInBytes, &state_)) return;
+  ApplySettings(state_.settings);
+  if (!state_.has_stats) return;
+
+  int stage = restore_stage_.load(std::memory_order_relaxed);
+  for (;;) {
+    if (stage == RESTORE_APPLYING) {
+      Thread::yield();
+      stage = restore_stage_.load(std::memory_order_relaxed);
+    } else if (restore_stage_.compare_exchange_weak(stage, RESTORE_WRITING, std::memory_order_acquire)) {
+      break;
+    }
   }
+  // The saved windows end when the state was saved: as long ago on this
+  // run's clock as it was on the wall clock.
+  const int64 second = Time::getHighResolutionTicks() / Time::getHighResolutionTicksPerSecond();
+  const int64 elapsed = jmax<int64>(0, (Time::currentTimeMillis() - state_.saved_ms) / 1000);
+  restore_shift_seconds_ = second - elapsed - state_.saved_second;
+  restore_state_ = state_.detector;
+  restore_stage_.store(RESTORE_PENDING, std::memory_order_release);
 }
 
 // This creates new instances of the plugin.
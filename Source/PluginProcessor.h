@@ -1,10 +1,30 @@
 #pragma once
 
 #include "../JuceLibraryCode/JuceHeader.h"
+#include "BufferAdvisor.h"
+#include "ChainProbe.h"
+#include "ClockSource.h"
+#include "DropoutDetector.h"
+#include "DropoutForecaster.h"
+#include "InstanceRegistry.h"
+#include "LatenessTimeline.h"
+#include "LoopbackTester.h"
+#include "PlayHeadMonitor.h"
+#include "PluginState.h"
+#include "RenderMonitor.h"
+#include "SeqLock.h"
+#include "SessionLog.h"
+#include "SignalScanner.h"
+#include "SystemSampler.h"
+#include "ThreadTelemetry.h"
+#include "TimingRecord.h"
+#include "TscClock.h"
 
-const int METER_BUCKETS = 32;
+#include <atomic>
+#include <vector>
 
-class DropoutspyAudioProcessor  : public AudioProcessor {
+class DropoutspyAudioProcessor  : public AudioProcessor,
+                                   private InstanceRegistry::Source {
 public:
   DropoutspyAudioProcessor();
   ~DropoutspyAudioProcessor();
@@ -36,20 +56,31 @@ public:
   void getStateInformation (MemoryBlock& destData) override;
   void setStateInformation (const void* data, int sizeInBytes) override;
 
-  float getSpread() const {
-    return spread_;
+  // Safe to call from any thread.
+  void getStats(DropoutStats* stats) const {
+    stats_.Read(stats);
   }
 
-  float getLastDelta() const {
-    return last_delta_;
+  // Changes whenever the audio thread publishes new stats, which is when
+  // anything the editor shows can have changed. Any thread.
+  uint32 getStatsVersion() const {
+    return stats_.GetVersion() + render_monitor_.GetVersion();
   }
 
-  int64 getOverflowCount() const {
-    return overflow_count_;
+  // Lateness of each device period start, and the time between them, in
+  // ns since the last reset. Safe to call from any thread.
+  void getLatenessHistogram(LogLinearHistogram* snapshot) const {
+    detector_.GetLatenessHistogram(snapshot);
   }
 
-  int64 getWarningCount() const {
-    return warning_count_;
+  void getIntervalHistogram(LogLinearHistogram* snapshot) const {
+    detector_.GetIntervalHistogram(snapshot);
+  }
+
+  // Warnings and dropouts over a trailing window (last second, minute,
+  // hour, day). Safe to call from any thread.
+  void getWindowStats(RollingStats::Window window, WindowStats* stats) const {
+    detector_.GetWindowStats(window, stats);
   }
 
   void setEmitClickOnDropout(bool set) {
@@ -60,45 +91,262 @@ public:
     emit_click_on_warning_ = set;
   }
 
-  int getSamplesPerBlock() const {
-    return samples_per_block_;
+  // Replaces the timestamp source used by processBlock. Not owned; pass
+  // nullptr to go back to the default. Only call while not processing.
+  void setClockSource(ClockSource* clock) {
+    external_clock_ = clock;
+    clock_ = clock ? clock : &default_clock_;
+  }
+
+  // Take timestamps from the calibrated TSC instead of JUCE's high
+  // resolution timer, where the CPU has an invariant TSC. Safe to call from
+  // any thread; the audio thread switches over at the next block.
+  void setUseTscClock(bool use);
+
+  bool getUseTscClock() const {
+    return use_tsc_clock_.load();
+  }
+
+  // Raw per-callback records, for consumers that need more than the
+  // aggregate stats. Listeners are called on a background thread.
+  TimingRecordStream& getTimingRecords() {
+    return timing_records_;
+  }
+
+  // Lateness of every callback, at zoom levels from single callbacks out
+  // to days. Safe to read from any thread.
+  const LatenessTimeline& getTimeline() const {
+    return timeline_;
+  }
+
+  // Headroom left in the block, and whether the lateness tail is trending
+  // towards a dropout. Safe to call from any thread.
+  void getForecast(DropoutForecast* forecast) const {
+    forecaster_.GetForecast(forecast);
+  }
+
+  // How far ahead a likely dropout raises the pre-warning. Any thread.
+  void setPrewarnMinutes(float minutes) {
+    forecaster_.SetPrewarnMinutes(minutes);
+  }
+
+  float getPrewarnMinutes() const {
+    return forecaster_.GetPrewarnMinutes();
   }
 
-  const void getHisto(int histo[METER_BUCKETS]) const {
-    for (int i = 0; i < METER_BUCKETS; i++) histo[i] = delta_histo_[i];
+  // The smallest buffer size expected to meet the dropout target, from the
+  // lateness seen at this format in this and earlier runs. Any thread.
+  void getBufferAdvice(BufferAdvice* advice) const {
+    buffer_advisor_.GetAdvice(advice);
   }
 
+  // Dropouts a day the recommended size should stay under. Any thread.
+  void setDropoutTarget(double per_day) {
+    buffer_advisor_.SetTargetPerDay(per_day);
+  }
+
+  double getDropoutTarget() const {
+    return buffer_advisor_.GetTargetPerDay();
+  }
+
+  // What the system was doing around recent dropouts (Linux only; none
+  // elsewhere). Reports arrive a second or so after their dropout. Safe to
+  // call from any thread.
+  int64 getSystemReportCount() const {
+    return system_events_.GetReportCount();
+  }
+
+  bool getSystemReport(int64 index, SystemEventReport* report) const {
+    return system_events_.GetReport(index, report);
+  }
+
+  // Write every timing record to a session log under
+  // SessionLog::GetDefaultDirectory(). Call from the message thread.
+  void setRecording(bool record);
+
+  bool getRecording() const {
+    return session_log_.IsOpen();
+  }
+
+  const SessionLog& getSessionLog() const {
+    return session_log_;
+  }
+
+  // Pair this instance with another one, at the other end of a plugin
+  // chain, to measure the time the chain takes. Call from the message
+  // thread.
+  void setChainProbe(ChainProbe::Role role, int id) {
+    chain_probe_.SetRole(role, id);
+  }
+
+  ChainProbe::Role getChainRole() const {
+    return chain_probe_.GetRole();
+  }
+
+  int getChainId() const {
+    return chain_probe_.GetId();
+  }
+
+  // What this instance measured as the LAST of a chain. Any thread.
+  void getChainStats(ChainProbeStats* stats) const {
+    chain_probe_.GetStats(stats);
+  }
+
+  void getChainHistogram(LogLinearHistogram* snapshot) const {
+    chain_probe_.GetHistogram(snapshot);
+  }
+
+  // Scan the input audio for zero runs and block-boundary jumps, as well as
+  // timing the callbacks. Any thread; applies from the next block.
+  void setSignalScan(bool scan) {
+    signal_scanner_.SetEnabled(scan);
+  }
+
+  bool getSignalScan() const {
+    return signal_scanner_.IsEnabled();
+  }
+
+  // Shortest run of zeros the scan counts, in samples. Any thread.
+  void setMinZeroRun(int samples) {
+    signal_scanner_.SetMinZeroRun(samples);
+  }
+
+  int getMinZeroRun() const {
+    return signal_scanner_.GetMinZeroRun();
+  }
+
+  // Any thread.
+  void getSignalStats(SignalStats* stats) const {
+    signal_scanner_.GetStats(stats);
+  }
+
+  // Sample the audio thread's CPU, context switches and page faults on
+  // every `blocks`th block (and every late one); 0 turns it off. Any
+  // thread; applies from the next block.
+  void setThreadTelemetry(int blocks) {
+    thread_telemetry_.SetInterval(blocks);
+  }
+
+  int getThreadTelemetry() const {
+    return thread_telemetry_.GetInterval();
+  }
+
+  // Any thread.
+  void getThreadTelemetryStats(ThreadTelemetryStats* stats) const {
+    thread_telemetry_.GetStats(stats);
+  }
+
+  // Throughput of the latest offline render, which the realtime stats
+  // above leave out. Any thread.
+  void getRenderStats(RenderStats* stats) const {
+    render_monitor_.GetStats(stats);
+  }
+
+  // Wall time of each block of the latest offline render, in ns. Any
+  // thread.
+  void getRenderHistogram(LogLinearHistogram* snapshot) const {
+    render_monitor_.GetBlockHistogram(snapshot);
+  }
+
+  // Transport starts, stops, seeks and loops, which the timing ignores,
+  // and audio the host skipped while playing. Any thread.
+  void getPlayHeadStats(PlayHeadStats* stats) const {
+    play_head_.GetStats(stats);
+  }
+
+  // Replace the output with a pseudo-random test sequence and check that it
+  // comes back on the input, counting every lost, extra and corrupted
+  // sample. Loud: full-scale noise. Not saved with the state. Call from the
+  // message thread.
+  void setLoopbackTest(bool test);
+
+  bool getLoopbackTest() const {
+    return loopback_enabled_.load();
+  }
+
+  // Returns false if the test has never been run. Any thread.
+  bool getLoopbackStats(LoopbackStats* stats) const {
+    LoopbackTester* tester = loopback_.load(std::memory_order_acquire);
+    if (tester == nullptr) return false;
+    tester->GetStats(stats);
+    return true;
+  }
+
+  // Called from the UI. The reset is applied by the audio thread at the
+  // start of the next block, so the callback never waits on the UI.
   void DoReset() {
-    ScopedLock l(lock_);
-    ResetTrackingState(sample_rate_, samples_per_block_);
-    warning_count_ = 0;
-    overflow_count_ = 0;
-    last_overflow_ticks_ = 0;
-    for (int i = 0; i < METER_BUCKETS; i++) {
-      delta_histo_[i] = 0;
-    }
+    reset_requested_.store(true, std::memory_order_release);
   }
 
 private:
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DropoutspyAudioProcessor)
 
-  void ResetTrackingState(double sample_rate, int samples_per_block);
-
-  CriticalSection lock_;
-
-  int64 start_ticks_min_;
-  int64 start_ticks_max_;
-  double sample_rate_ = 0;
-  int samples_per_block_ = 0;
-  int64 ticks_per_block_ = 1;
-  int64 total_samples_ = 0;
-  int64 warning_count_ = 0;
-  int64 overflow_count_ = 0;
-  int64 last_overflow_ticks_ = 0;
-  float spread_ = 0;
-  float last_delta_ = 0;
-  int delta_histo_[METER_BUCKETS];
-
-  bool emit_click_on_warning_ = false;
-  bool emit_click_on_dropout_ = false;
+  void PublishStats();
+  ClockSource* SelectClock();
+  void GetSettings(PluginSettings* settings) const;
+  void ApplySettings(const PluginSettings& settings);
+
+  // Audio thread, or prepareToPlay. Hands the detector the stats
+  // setStateInformation left, if any.
+  void ApplyRestore();
+
+  // InstanceRegistry::Source; called on the registry thread.
+  void GetInstanceSnapshot(InstanceSnapshot* snapshot) override;
+
+  // Everything below until stats_ is owned by the audio thread (or by
+  // prepareToPlay, which hosts never run concurrently with processBlock).
+
+  DropoutDetector detector_{Time::getHighResolutionTicksPerSecond()};
+
+  HighResolutionClock default_clock_;
+  ClockSource* clock_ = &default_clock_;
+  ClockSource* external_clock_ = nullptr;
+
+  SeqLock<DropoutStats> stats_;
+  // Before the stream, so it outlives it.
+  LatenessTimeline timeline_{Time::getHighResolutionTicksPerSecond()};
+  SystemEventLog system_events_;
+  DropoutForecaster forecaster_{Time::getHighResolutionTicksPerSecond()};
+  BufferAdvisor buffer_advisor_{Time::getHighResolutionTicksPerSecond()};
+  TimingRecordStream timing_records_;
+  SessionLog session_log_;
+  ChainProbe chain_probe_;
+  SignalScanner signal_scanner_;
+  ThreadTelemetry thread_telemetry_;
+  PlayHeadMonitor play_head_;
+  RenderMonitor render_monitor_{Time::getHighResolutionTicksPerSecond()};
+  bool rendering_ = false;
+  std::atomic<bool> reset_requested_{false};
+  bool loopback_running_ = false;
+
+  // setStateInformation hands saved stats to the audio thread through
+  // restore_state_: it takes the slot (WRITING), fills it and marks it
+  // PENDING; the audio thread takes it (APPLYING) and frees it again. The
+  // message thread only waits while the slot is APPLYING, never the audio
+  // thread.
+  enum RestoreStage { RESTORE_IDLE, RESTORE_WRITING, RESTORE_PENDING, RESTORE_APPLYING };
+  std::atomic<int> restore_stage_{RESTORE_IDLE};
+  DetectorState restore_state_;
+  int64 restore_shift_seconds_ = 0;
+
+  // get/setStateInformation; hosts may call them from any thread.
+  CriticalSection state_lock_;
+  PluginState state_;
+  std::vector<uint8> state_bytes_;
+
+  // Created on first use, then kept until the processor goes away so the
+  // audio thread never sees it freed.
+  std::atomic<TscClock*> tsc_clock_{nullptr};
+  std::atomic<bool> use_tsc_clock_{false};
+
+  // Likewise.
+  std::atomic<LoopbackTester*> loopback_{nullptr};
+  std::atomic<bool> loopback_enabled_{false};
+
+  std::atomic<bool> emit_click_on_warning_{false};
+  std::atomic<bool> emit_click_on_dropout_{false};
+
+  // Publishes our stats for the dashboard, off the audio thread.
+  SharedResourcePointer<InstanceRegistry> registry_;
+  LogLinearHistogram registry_snapshot_;  // Registry thread.
 };
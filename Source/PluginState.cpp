@@ -0,0 +1,318 @@
+#include "PluginState.h"
+
+namespace {
+
+const char MAGIC[4] = { 'D', 'S', 'P', 'S' };
+
+enum Section {
+  SETTINGS = 1,
+  COUNTERS = 2,
+  LATENESS = 3,
+  INTERVAL = 4,
+  WINDOWS = 5,
+};
+
+// Bits of the first SETTINGS varint.
+const uint32 SETTING_CLICK_ON_WARNING = 1 << 0;
+const uint32 SETTING_CLICK_ON_DROPOUT = 1 << 1;
+const uint32 SETTING_TSC_CLOCK = 1 << 2;
+const uint32 SETTING_SIGNAL_SCAN = 1 << 3;
+
+inline uint64 ZigZag(int64 v) {
+  return (uint64(v) << 1) ^ uint64(v >> 63);
+}
+
+inline int64 UnZigZag(uint64 v) {
+  return int64(v >> 1) ^ -int64(v & 1);
+}
+
+void WriteVarint(std::vector<uint8>* out, uint64 v) {
+  while (v >= 0x80) {
+    out->push_back(uint8(v) | 0x80);
+    v >>= 7;
+  }
+  out->push_back(uint8(v));
+}
+
+void WriteSigned(std::vector<uint8>* out, int64 v) {
+  WriteVarint(out, ZigZag(v));
+}
+
+template <typename T>
+void WriteRaw(std::vector<uint8>* out, T v) {
+  const uint8* p = reinterpret_cast<const uint8*>(&v);
+  out->insert(out->end(), p, p + sizeof(T));
+}
+
+void WriteSection(std::vector<uint8>* out, int tag, const std::vector<uint8>& payload) {
+  WriteVarint(out, uint64(tag));
+  WriteVarint(out, payload.size());
+  out->insert(out->end(), payload.begin(), payload.end());
+}
+
+void WriteHistogram(std::vector<uint8>* out, const LogLinearHistogram& histo) {
+  WriteVarint(out, uint64(histo.GetMax()));
+  int next = 0;
+  for (int i = 0; i < LogLinearHistogram::NUM_BUCKETS; i++) {
+    if (histo.GetCount(i) == 0) continue;
+    WriteVarint(out, uint64(i - next));
+    WriteVarint(out, histo.GetCount(i));
+    next = i + 1;
+  }
+}
+
+// Non-empty cells, with tags as distances back from the ring's now.
+void WriteCells(std::vector<uint8>* out, const RollingStats::Saved::Cell* cells, int count, int64 now) {
+  int used = 0;
+  for (int i = 0; i < count; i++) {
+    if (cells[i].tag >= 0 && cells[i].tag <= now && cells[i].callbacks > 0) used++;
+  }
+  WriteVarint(out, uint64(used));
+  for (int i = 0; i < count; i++) {
+    const RollingStats::Saved::Cell& cell = cells[i];
+    if (cell.tag < 0 || cell.tag > now || cell.callbacks == 0) continue;
+    WriteVarint(out, uint64(now - cell.tag));
+    WriteVarint(out, cell.callbacks);
+    WriteVarint(out, cell.warnings);
+    WriteVarint(out, cell.dropouts);
+    WriteRaw(out, cell.max_delta);
+    for (int b = 0; b < WindowStats::DELTA_BINS; b++) WriteVarint(out, cell.bins[b]);
+  }
+}
+
+class Reader {
+public:
+  Reader(const uint8* data, size_t size) : p_(data), end_(data + size) {}
+
+  bool AtEnd() const {
+    return p_ >= end_;
+  }
+
+  bool Varint(uint64* value) {
+    uint64 v = 0;
+    for (int shift = 0; shift < 64 && p_ < end_; shift += 7) {
+      const uint8 b = *p_++;
+      v |= uint64(b & 0x7f) << shift;
+      if ((b & 0x80) == 0) {
+        *value = v;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool Signed(int64* value) {
+    uint64 v;
+    if (!Varint(&v)) return false;
+    *value = UnZigZag(v);
+    return true;
+  }
+
+  template <typename T>
+  bool Raw(T* value) {
+    if (end_ - p_ < ptrdiff_t(sizeof(T))) return false;
+    memcpy(value, p_, sizeof(T));
+    p_ += sizeof(T);
+    return true;
+  }
+
+  // The next section's tag and contents.
+  bool Next(uint64* tag, Reader* section) {
+    uint64 length;
+    if (!Varint(tag) || !Varint(&length) || length > uint64(end_ - p_)) return false;
+    *section = Reader(p_, size_t(length));
+    p_ += length;
+    return true;
+  }
+
+private:
+  const uint8* p_;
+  const uint8* end_;
+};
+
+bool ReadHistogram(Reader* in, LogLinearHistogram* histo) {
+  histo->Clear();
+  uint64 max;
+  if (!in->Varint(&max)) return false;
+  uint64 index = 0;
+  while (!in->AtEnd()) {
+    uint64 gap, count;
+    if (!in->Varint(&gap) || !in->Varint(&count)) return false;
+    index += gap;
+    if (index >= uint64(LogLinearHistogram::NUM_BUCKETS)) return false;
+    histo->AddCount(int(index), count);
+    index++;
+  }
+  histo->RaiseMax(int64(max));
+  return true;
+}
+
+bool ReadCells(Reader* in, RollingStats::Saved::Cell* cells, int count, int64 now) {
+  for (int i = 0; i < count; i++) cells[i].tag = -1;
+  uint64 used;
+  if (!in->Varint(&used)) return false;
+  for (uint64 i = 0; i < used; i++) {
+    uint64 back, callbacks, warnings, dropouts;
+    RollingStats::Saved::Cell cell;
+    if (!in->Varint(&back) || !in->Varint(&callbacks) || !in->Varint(&warnings) ||
+        !in->Varint(&dropouts) || !in->Raw(&cell.max_delta)) {
+      return false;
+    }
+    for (int b = 0; b < WindowStats::DELTA_BINS; b++) {
+      uint64 bin;
+      if (!in->Varint(&bin)) return false;
+      cell.bins[b] = uint32(bin);
+    }
+    if (back >= uint64(count) || int64(back) > now) continue;
+    cell.tag = now - int64(back);
+    cell.callbacks = uint32(callbacks);
+    cell.warnings = uint32(warnings);
+    cell.dropouts = uint32(dropouts);
+    cells[cell.tag % count] = cell;
+  }
+  return true;
+}
+
+// The seven setting bytes states held before the blob.
+void ReadLegacy(const uint8* bytes, int size, PluginSettings* settings) {
+  if (size > 1) {
+    settings->click_on_warning = bytes[0] != 0;
+    settings->click_on_dropout = bytes[1] != 0;
+  }
+  if (size > 2) settings->tsc_clock = bytes[2] != 0;
+  if (size > 4) {
+    settings->chain_role = int8(bytes[3]);
+    settings->chain_id = int8(bytes[4]);
+  }
+  if (size > 5) settings->signal_scan = bytes[5] != 0;
+  if (size > 6) settings->telemetry_interval = bytes[6];
+}
+
+}  // namespace
+
+void PluginStateFormat::Write(const PluginState& state, std::vector<uint8>* out) {
+  out->clear();
+  out->insert(out->end(), MAGIC, MAGIC + sizeof(MAGIC));
+  WriteVarint(out, VERSION);
+
+  std::vector<uint8> section;
+  const PluginSettings& settings = state.settings;
+  WriteVarint(&section, (settings.click_on_warning ? SETTING_CLICK_ON_WARNING : 0) |
+                        (settings.click_on_dropout ? SETTING_CLICK_ON_DROPOUT : 0) |
+                        (settings.tsc_clock ? SETTING_TSC_CLOCK : 0) |
+                        (settings.signal_scan ? SETTING_SIGNAL_SCAN : 0));
+  WriteSigned(&section, settings.chain_role);
+  WriteSigned(&section, settings.chain_id);
+  WriteVarint(&section, uint64(jmax(0, settings.telemetry_interval)));
+  WriteRaw(&section, settings.prewarn_minutes);
+  WriteRaw(&section, settings.target_per_day);
+  WriteVarint(&section, uint64(jmax(0, settings.min_zero_run)));
+  WriteSection(out, SETTINGS, section);
+  if (!state.has_stats) return;
+
+  const DetectorState& detector = state.detector;
+  section.clear();
+  WriteSigned(&section, state.saved_ms);
+  WriteSigned(&section, state.saved_second);
+  WriteVarint(&section, uint64(detector.warning_count));
+  WriteVarint(&section, uint64(detector.overflow_count));
+  WriteSection(out, COUNTERS, section);
+
+  section.clear();
+  WriteHistogram(&section, detector.lateness);
+  WriteSection(out, LATENESS, section);
+
+  section.clear();
+  WriteHistogram(&section, detector.interval);
+  WriteSection(out, INTERVAL, section);
+
+  const RollingStats::Saved& windows = detector.windows;
+  const int64 now = windows.now_second;
+  if (now >= 0) {
+    section.clear();
+    WriteSigned(&section, now);
+    WriteCells(&section, windows.seconds, RollingStats::SECONDS, now);
+    WriteCells(&section, windows.minutes, RollingStats::MINUTES, now / 60);
+    WriteCells(&section, windows.hours, RollingStats::HOURS, now / 3600);
+    WriteSection(out, WINDOWS, section);
+  }
+}
+
+bool PluginStateFormat::Read(const void* data, int size, PluginState* state) {
+  const uint8* bytes = static_cast<const uint8*>(data);
+  state->has_stats = false;
+  if (size < int(sizeof(MAGIC)) || memcmp(bytes, MAGIC, sizeof(MAGIC)) != 0) {
+    // Old states start with a bool, never with the magic.
+    if (size < 1 || bytes[0] > 1) return false;
+    ReadLegacy(bytes, size, &state->settings);
+    return true;
+  }
+
+  Reader in(bytes + sizeof(MAGIC), size_t(size) - sizeof(MAGIC));
+  uint64 version;
+  if (!in.Varint(&version) || version > VERSION) return false;
+
+  DetectorState& detector = state->detector;
+  detector.windows.now_second = -1;
+  bool have_counters = false;
+  uint64 tag;
+  Reader section(nullptr, 0);
+  while (!in.AtEnd() && in.Next(&tag, &section)) {
+    switch (tag) {
+      case SETTINGS: {
+        PluginSettings& settings = state->settings;
+        uint64 flags, interval;
+        int64 role, id;
+        if (!section.Varint(&flags) || !section.Signed(&role) || !section.Signed(&id) ||
+            !section.Varint(&interval)) {
+          return false;
+        }
+        settings.click_on_warning = (flags & SETTING_CLICK_ON_WARNING) != 0;
+        settings.click_on_dropout = (flags & SETTING_CLICK_ON_DROPOUT) != 0;
+        settings.tsc_clock = (flags & SETTING_TSC_CLOCK) != 0;
+        settings.signal_scan = (flags & SETTING_SIGNAL_SCAN) != 0;
+        settings.chain_role = int32(role);
+        settings.chain_id = int32(id);
+        settings.telemetry_interval = int32(jmin<uint64>(interval, 255));
+        section.Raw(&settings.prewarn_minutes);
+        section.Raw(&settings.target_per_day);
+        uint64 zero_run;
+        if (section.Varint(&zero_run)) settings.min_zero_run = int32(jmin<uint64>(zero_run, 1 << 20));
+        break;
+      }
+      case COUNTERS: {
+        uint64 warnings, overflows;
+        if (!section.Signed(&state->saved_ms) || !section.Signed(&state->saved_second) ||
+            !section.Varint(&warnings) || !section.Varint(&overflows)) {
+          return false;
+        }
+        detector.warning_count = int64(warnings);
+        detector.overflow_count = int64(overflows);
+        have_counters = true;
+        break;
+      }
+      case LATENESS:
+        if (!ReadHistogram(&section, &detector.lateness)) return false;
+        break;
+      case INTERVAL:
+        if (!ReadHistogram(&section, &detector.interval)) return false;
+        break;
+      case WINDOWS: {
+        int64 now;
+        RollingStats::Saved& windows = detector.windows;
+        if (!section.Signed(&now) || now < 0 ||
+            !ReadCells(&section, windows.seconds, RollingStats::SECONDS, now) ||
+            !ReadCells(&section, windows.minutes, RollingStats::MINUTES, now / 60) ||
+            !ReadCells(&section, windows.hours, RollingStats::HOURS, now / 3600)) {
+          return false;
+        }
+        windows.now_second = now;
+        break;
+      }
+      default:
+        break;  // From a newer build.
+    }
+  }
+  state->has_stats = have_counters;
+  return true;
+}
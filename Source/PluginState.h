@@ -0,0 +1,52 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "DropoutDetector.h"
+
+#include <vector>
+
+// Settings saved with the plugin state.
+struct PluginSettings {
+  bool click_on_warning;
+  bool click_on_dropout;
+  bool tsc_clock;
+  int32 chain_role;
+  int32 chain_id;
+  bool signal_scan;
+  int32 telemetry_interval;
+  float prewarn_minutes;     // 0 if not saved.
+  double target_per_day;     // 0 if not saved.
+  int32 min_zero_run;        // Samples.
+};
+
+// Everything getStateInformation saves: the settings, and the detector's
+// counters, histograms and windows so a long soak test survives the host
+// restarting.
+struct PluginState {
+  PluginSettings settings;
+  bool has_stats;            // False for states from before the stats were saved.
+  int64 saved_ms;            // Wall clock when saved.
+  int64 saved_second;        // The stats clock then, in seconds.
+  DetectorState detector;
+};
+
+// The state blob: "DSPS", a varint version, then sections of a varint tag,
+// a varint length and that many bytes. Readers skip sections they don't
+// know, and fields past the end of a section take defaults, so older and
+// newer builds can read each other's states; VERSION only changes if an
+// existing field changes meaning. Counts are varints and histograms list
+// only their non-empty buckets, so a state is a few KB and takes
+// microseconds to write, even for hosts that autosave every few seconds.
+//
+// States from before the blob (seven raw setting bytes) still read, as
+// settings without stats.
+class PluginStateFormat {
+public:
+  enum { VERSION = 1 };
+
+  static void Write(const PluginState& state, std::vector<uint8>* out);
+
+  // False if data isn't a state at all, or is from a newer VERSION. Settings
+  // the data doesn't have keep the values *state had.
+  static bool Read(const void* data, int size, PluginState* state);
+};
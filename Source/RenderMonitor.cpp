@@ -0,0 +1,98 @@
+#include "RenderMonitor.h"
+
+RenderMonitor::RenderMonitor(int64 ticks_per_second) : ns_per_tick_(1e9 / ticks_per_second) {
+  Reset();
+}
+
+void RenderMonitor::Prepare(double sample_rate) {
+  sample_rate_ = sample_rate;
+  if (in_render_) {
+    in_render_ = false;
+    current_.active = false;
+    stats_.Write(current_);
+  }
+}
+
+void RenderMonitor::Reset() {
+  in_render_ = false;
+  zerostruct(current_);
+  block_histo_.Clear();
+  stats_.Write(current_);
+}
+
+void RenderMonitor::StartRender() {
+  const int64 renders = current_.renders;
+  zerostruct(current_);
+  current_.active = true;
+  current_.renders = renders + 1;
+  block_histo_.Clear();
+  in_render_ = true;
+  stretch_samples_ = 0;
+  stretch_ticks_ = 0;
+  stretch_start_seconds_ = 0;
+}
+
+// Files the finished stretch among the slowest, if it is.
+void RenderMonitor::EndStretch() {
+  const double wall_seconds = stretch_ticks_ * ns_per_tick_ * 1e-9;
+  if (wall_seconds > 0) {
+    RenderStats::Stretch stretch;
+    stretch.start_seconds = float(stretch_start_seconds_);
+    stretch.realtime_factor = float(stretch_samples_ / sample_rate_ / wall_seconds);
+    int i = current_.num_slowest;
+    if (i < RenderStats::SLOWEST) {
+      current_.num_slowest++;
+    } else if (stretch.realtime_factor >= current_.slowest[i - 1].realtime_factor) {
+      i = -1;
+    } else {
+      i--;
+    }
+    if (i >= 0) {
+      for (; i > 0 && current_.slowest[i - 1].realtime_factor > stretch.realtime_factor; i--) {
+        current_.slowest[i] = current_.slowest[i - 1];
+      }
+      current_.slowest[i] = stretch;
+    }
+  }
+  stretch_samples_ = 0;
+  stretch_ticks_ = 0;
+  stretch_start_seconds_ = current_.audio_seconds;
+}
+
+void RenderMonitor::Process(int64 ticks, int num_samples, bool non_realtime) {
+  if (!non_realtime || sample_rate_ <= 0) {
+    if (in_render_) {
+      in_render_ = false;
+      current_.active = false;
+      stats_.Write(current_);
+    }
+    return;
+  }
+  if (!in_render_) {
+    StartRender();
+    first_ticks_ = last_ticks_ = ticks;
+    last_num_samples_ = num_samples;
+    stats_.Write(current_);
+    return;
+  }
+
+  // The time since the previous callback is what its block took, the host
+  // and every other plugin included.
+  const int64 interval = ticks - last_ticks_;
+  block_histo_.Record(int64(interval * ns_per_tick_));
+  current_.blocks++;
+  current_.samples += last_num_samples_;
+  current_.audio_seconds = current_.samples / sample_rate_;
+  current_.wall_seconds = (ticks - first_ticks_) * ns_per_tick_ * 1e-9;
+  if (current_.wall_seconds > 0) {
+    current_.realtime_factor = float(current_.audio_seconds / current_.wall_seconds);
+    current_.samples_per_second = float(current_.samples / current_.wall_seconds);
+  }
+  stretch_samples_ += last_num_samples_;
+  stretch_ticks_ += interval;
+  if (stretch_samples_ >= STRETCH_SECONDS * sample_rate_) EndStretch();
+
+  last_ticks_ = ticks;
+  last_num_samples_ = num_samples;
+  stats_.Write(current_);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LogLinearHistogram.h"
+#include "SeqLock.h"
+
+// Throughput of the latest offline render, published by the audio thread
+// after every block of it.
+struct RenderStats {
+  enum { SLOWEST = 5 };
+
+  bool active;                // The host is rendering offline now.
+  int64 renders;              // Offline renders since the last reset.
+
+  // Of the latest render. Wall time runs from its first callback to the
+  // start of its latest one, and audio time over the blocks in between.
+  int64 blocks;
+  int64 samples;
+  double audio_seconds;
+  double wall_seconds;
+  float realtime_factor;      // Audio seconds per wall second.
+  float samples_per_second;
+
+  // The slowest STRETCH_SECONDS stretches of audio, slowest first.
+  int32 num_slowest;
+  struct Stretch {
+    float start_seconds;      // Audio time from the start of the render.
+    float realtime_factor;
+  } slowest[SLOWEST];
+};
+
+// When the host renders offline (isNonRealtime()), callbacks come as fast
+// as the host and the plugins can make them, so timing them against the
+// sample clock means nothing. processBlock hands those blocks here
+// instead of to the detector, and this measures how fast the render goes:
+// the realtime factor, the wall time per block, and the slowest stretches.
+// None of it touches the realtime stats.
+//
+// A render starts at the first non-realtime block after a realtime one,
+// or after Prepare(). O(1) per block, nothing allocated.
+class RenderMonitor {
+public:
+  enum { STRETCH_SECONDS = 1 };
+
+  explicit RenderMonitor(int64 ticks_per_second);
+
+  // Audio thread, or prepareToPlay. Ends the current render, if any.
+  void Prepare(double sample_rate);
+
+  // Audio thread. Forgets every render.
+  void Reset();
+
+  // Audio thread, every block. non_realtime is isNonRealtime().
+  void Process(int64 ticks, int num_samples, bool non_realtime);
+
+  // Any thread.
+  void GetStats(RenderStats* stats) const {
+    stats_.Read(stats);
+  }
+
+  uint32 GetVersion() const {
+    return stats_.GetVersion();
+  }
+
+  // Wall time of each block of the latest render, in ns. Any thread.
+  void GetBlockHistogram(LogLinearHistogram* snapshot) const {
+    block_histo_.GetSnapshot(snapshot);
+  }
+
+private:
+  void StartRender();
+  void EndStretch();
+
+  const double ns_per_tick_;
+  double sample_rate_ = 0;
+
+  // Audio thread.
+  RenderStats current_;
+  bool in_render_ = false;
+  int64 first_ticks_ = 0;
+  int64 last_ticks_ = 0;
+  int last_num_samples_ = 0;
+  int64 stretch_samples_ = 0;
+  int64 stretch_ticks_ = 0;
+  double stretch_start_seconds_ = 0;
+
+  HistogramRecorder block_histo_;
+  SeqLock<RenderStats> stats_;
+
+  JUCE_DECLARE_NON_COPYABLE(RenderMonitor)
+};
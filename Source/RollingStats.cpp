@@ -0,0 +1,144 @@
+#include "RollingStats.h"
+
+constexpr float WindowStats::DELTA_BIN_WIDTH;
+
+namespace {
+const int64 NO_TAG = -1;
+}  // namespace
+
+RollingStats::RollingStats(int64 ticks_per_second)
+  : seconds_per_tick_(1.0 / ticks_per_second) {
+  Reset();
+}
+
+void RollingStats::Reset() {
+  for (int i = 0; i < SECONDS; i++) Reclaim(&seconds_[i], NO_TAG);
+  for (int i = 0; i < MINUTES; i++) Reclaim(&minutes_[i], NO_TAG);
+  for (int i = 0; i < HOURS; i++) Reclaim(&hours_[i], NO_TAG);
+  now_second_.store(NO_TAG, std::memory_order_release);
+}
+
+void RollingStats::Reclaim(Cell* cell, int64 tag) {
+  cell->tag.store(NO_TAG, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  cell->callbacks.store(0, std::memory_order_relaxed);
+  cell->warnings.store(0, std::memory_order_relaxed);
+  cell->dropouts.store(0, std::memory_order_relaxed);
+  cell->max_delta.store(0, std::memory_order_relaxed);
+  for (int i = 0; i < WindowStats::DELTA_BINS; i++) {
+    cell->bins[i].store(0, std::memory_order_relaxed);
+  }
+  cell->tag.store(tag, std::memory_order_release);
+}
+
+void RollingStats::Sum(const Cell* cells, int count, int64 first, int64 last, WindowStats* stats) {
+  for (int i = 0; i < count; i++) {
+    const Cell& cell = cells[i];
+    const int64 tag = cell.tag.load(std::memory_order_acquire);
+    if (tag < first || tag > last) continue;
+    const uint32 callbacks = cell.callbacks.load(std::memory_order_relaxed);
+    const uint32 warnings = cell.warnings.load(std::memory_order_relaxed);
+    const uint32 dropouts = cell.dropouts.load(std::memory_order_relaxed);
+    const float max_delta = cell.max_delta.load(std::memory_order_relaxed);
+    uint32 bins[WindowStats::DELTA_BINS];
+    for (int b = 0; b < WindowStats::DELTA_BINS; b++) {
+      bins[b] = cell.bins[b].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (cell.tag.load(std::memory_order_relaxed) != tag) continue;  // Reclaimed meanwhile.
+
+    stats->callbacks += callbacks;
+    stats->warnings += warnings;
+    stats->dropouts += dropouts;
+    stats->max_delta = jmax(stats->max_delta, max_delta);
+    for (int b = 0; b < WindowStats::DELTA_BINS; b++) stats->delta_bins[b] += bins[b];
+  }
+}
+
+void RollingStats::GetWindow(Window window, WindowStats* stats) const {
+  zerostruct(*stats);
+  const int64 now = now_second_.load(std::memory_order_acquire);
+  if (now == NO_TAG) return;
+  switch (window) {
+    case LAST_SECOND:
+      Sum(seconds_, SECONDS, now - 1, now - 1, stats);
+      break;
+    case LAST_MINUTE:
+      Sum(seconds_, SECONDS, now - (SECONDS - 1), now, stats);
+      break;
+    case LAST_HOUR:
+      Sum(minutes_, MINUTES, now / 60 - (MINUTES - 1), now / 60, stats);
+      break;
+    case LAST_DAY:
+      Sum(hours_, HOURS, now / 3600 - (HOURS - 1), now / 3600, stats);
+      break;
+    default:
+      break;
+  }
+}
+
+void RollingStats::SaveCells(const Cell* cells, int count, Saved::Cell* saved) {
+  for (int i = 0; i < count; i++) {
+    const Cell& cell = cells[i];
+    Saved::Cell& out = saved[i];
+    out.tag = cell.tag.load(std::memory_order_acquire);
+    out.callbacks = cell.callbacks.load(std::memory_order_relaxed);
+    out.warnings = cell.warnings.load(std::memory_order_relaxed);
+    out.dropouts = cell.dropouts.load(std::memory_order_relaxed);
+    out.max_delta = cell.max_delta.load(std::memory_order_relaxed);
+    for (int b = 0; b < WindowStats::DELTA_BINS; b++) {
+      out.bins[b] = cell.bins[b].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (cell.tag.load(std::memory_order_relaxed) != out.tag) out.tag = NO_TAG;
+  }
+}
+
+void RollingStats::Save(Saved* saved) const {
+  saved->now_second = now_second_.load(std::memory_order_acquire);
+  SaveCells(seconds_, SECONDS, saved->seconds);
+  SaveCells(minutes_, MINUTES, saved->minutes);
+  SaveCells(hours_, HOURS, saved->hours);
+}
+
+// Cells moved to before the start of the clock are dropped.
+void RollingStats::RestoreCells(const Saved::Cell* saved, int count, int64 shift, Cell* cells) {
+  for (int i = 0; i < count; i++) {
+    const Saved::Cell& in = saved[i];
+    if (in.tag < 0 || in.tag + shift < 0) continue;
+    const int64 tag = in.tag + shift;
+    Cell* cell = &cells[tag % count];
+    cell->tag.store(NO_TAG, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    cell->callbacks.store(in.callbacks, std::memory_order_relaxed);
+    cell->warnings.store(in.warnings, std::memory_order_relaxed);
+    cell->dropouts.store(in.dropouts, std::memory_order_relaxed);
+    cell->max_delta.store(in.max_delta, std::memory_order_relaxed);
+    for (int b = 0; b < WindowStats::DELTA_BINS; b++) {
+      cell->bins[b].store(in.bins[b], std::memory_order_relaxed);
+    }
+    cell->tag.store(tag, std::memory_order_release);
+  }
+}
+
+void RollingStats::Restore(const Saved& saved, int64 shift_seconds) {
+  Reset();
+  const int64 now = saved.now_second + shift_seconds;
+  if (saved.now_second < 0 || now < 0) return;
+  // The coarser rings move by whole minutes (hours), keeping the cells in
+  // the same place relative to now.
+  RestoreCells(saved.seconds, SECONDS, shift_seconds, seconds_);
+  RestoreCells(saved.minutes, MINUTES, now / 60 - saved.now_second / 60, minutes_);
+  RestoreCells(saved.hours, HOURS, now / 3600 - saved.now_second / 3600, hours_);
+  now_second_.store(now, std::memory_order_release);
+}
+
+int RollingStats::GetWindowSeconds(Window window) {
+  static const int SECONDS_PER_WINDOW[NUM_WINDOWS] = { 1, 60, 3600, 86400 };
+  return SECONDS_PER_WINDOW[window];
+}
+
+const char* RollingStats::GetWindowName(Window window) {
+  static const char* NAMES[NUM_WINDOWS] = { "1s", "1m", "1h", "24h" };
+  return NAMES[window];
+}
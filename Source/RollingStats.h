@@ -0,0 +1,138 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "TimingRecord.h"
+
+#include <atomic>
+
+// Totals over one trailing window, as returned by RollingStats.
+struct WindowStats {
+  enum { DELTA_BINS = 8 };
+  static constexpr float DELTA_BIN_WIDTH = 0.25f;  // Blocks; the last bin is open.
+
+  int64 callbacks;  // Device period starts.
+  int64 warnings;
+  int64 dropouts;
+  float max_delta;
+  int64 delta_bins[DELTA_BINS];
+};
+
+// Warning and dropout counts over the last second, minute, hour and day,
+// in constant memory.
+//
+// There are three rings of summary cells: 60 one-second cells, 60
+// one-minute cells and 24 one-hour cells. Each cell is tagged with the
+// absolute second (minute, hour) it holds, so a period start just adds to
+// the three cells for the current time, reclaiming any whose tag is out of
+// date; nothing has to roll over, and a gap in processing simply leaves
+// stale cells that queries skip. Record() is O(1); a query sums at most 60
+// cells.
+//
+// The windows are trailing, at the resolution of their ring: the last
+// complete second, the last 60 seconds (including the current one), the
+// last 60 minutes and the last 24 hours likewise. "Now" is the time of the
+// most recent Record(), so the windows stand still while audio is stopped.
+class RollingStats {
+public:
+  enum Window {
+    LAST_SECOND,
+    LAST_MINUTE,
+    LAST_HOUR,
+    LAST_DAY,
+    NUM_WINDOWS,
+  };
+
+  enum { SECONDS = 60, MINUTES = 60, HOURS = 24 };
+
+  // Plain copy of the cells, for saving with the plugin state. Tags are
+  // seconds (minutes, hours) of the clock they were recorded with; a tag
+  // of -1 is an empty cell.
+  struct Saved {
+    struct Cell {
+      int64 tag;
+      uint32 callbacks;
+      uint32 warnings;
+      uint32 dropouts;
+      float max_delta;
+      uint32 bins[WindowStats::DELTA_BINS];
+    };
+    int64 now_second;  // -1 if nothing was recorded.
+    Cell seconds[SECONDS];
+    Cell minutes[MINUTES];
+    Cell hours[HOURS];
+  };
+
+  explicit RollingStats(int64 ticks_per_second);
+
+  // Writer thread only.
+  void Reset();
+
+  // Writer thread only. One call per device period start.
+  void Record(int64 ticks, float delta, uint32 flags) {
+    const int64 second = int64(ticks * seconds_per_tick_);
+    const int bin = jlimit(0, int(WindowStats::DELTA_BINS) - 1,
+                           int(delta * (1.0f / WindowStats::DELTA_BIN_WIDTH)));
+    Add(&seconds_[second % SECONDS], second, delta, flags, bin);
+    Add(&minutes_[(second / 60) % MINUTES], second / 60, delta, flags, bin);
+    Add(&hours_[(second / 3600) % HOURS], second / 3600, delta, flags, bin);
+    now_second_.store(second, std::memory_order_release);
+  }
+
+  // Any thread.
+  void GetWindow(Window window, WindowStats* stats) const;
+
+  // Any thread. Cells being reclaimed as this reads them come out empty.
+  void Save(Saved* saved) const;
+
+  // Writer thread only. Replaces everything with saved, moved shift_seconds
+  // later, e.g. onto this run's clock.
+  void Restore(const Saved& saved, int64 shift_seconds);
+
+  // Nominal length of a window, for turning counts into rates.
+  static int GetWindowSeconds(Window window);
+
+  static const char* GetWindowName(Window window);
+
+private:
+  // Fields are relaxed atomics so readers can't tear them; the tag is
+  // written last when a cell is reclaimed, and checked again after
+  // reading, so a reader never mixes two different periods.
+  struct Cell {
+    std::atomic<int64> tag;
+    std::atomic<uint32> callbacks;
+    std::atomic<uint32> warnings;
+    std::atomic<uint32> dropouts;
+    std::atomic<float> max_delta;
+    std::atomic<uint32> bins[WindowStats::DELTA_BINS];
+  };
+
+  static void Increment(std::atomic<uint32>* value) {
+    value->store(value->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  static void Add(Cell* cell, int64 tag, float delta, uint32 flags, int bin) {
+    if (cell->tag.load(std::memory_order_relaxed) != tag) Reclaim(cell, tag);
+    Increment(&cell->callbacks);
+    if (flags & TIMING_FLAG_WARNING) Increment(&cell->warnings);
+    if (flags & TIMING_FLAG_DROPOUT) Increment(&cell->dropouts);
+    if (delta > cell->max_delta.load(std::memory_order_relaxed)) {
+      cell->max_delta.store(delta, std::memory_order_relaxed);
+    }
+    Increment(&cell->bins[bin]);
+  }
+
+  static void Reclaim(Cell* cell, int64 tag);
+  static void SaveCells(const Cell* cells, int count, Saved::Cell* saved);
+  static void RestoreCells(const Saved::Cell* saved, int count, int64 shift, Cell* cells);
+
+  // Adds cells tagged first..last to stats.
+  static void Sum(const Cell* cells, int count, int64 first, int64 last, WindowStats* stats);
+
+  const double seconds_per_tick_;
+  Cell seconds_[SECONDS];
+  Cell minutes_[MINUTES];
+  Cell hours_[HOURS];
+  std::atomic<int64> now_second_;
+
+  JUCE_DECLARE_NON_COPYABLE(RollingStats)
+};
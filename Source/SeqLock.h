@@ -0,0 +1,78 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#include <atomic>
+#include <type_traits>
+
+// Single-writer, multi-reader sequence lock for publishing a small POD
+// snapshot out of the audio thread.
+//
+// The writer never blocks or spins: Write() bumps the sequence to an odd
+// value, copies the payload, and bumps it to the next even value. Readers
+// retry until they see the same even sequence before and after copying.
+// The payload is stored as relaxed atomic words, so concurrent access is
+// well-defined rather than a benign data race.
+template <typename T>
+class SeqLock {
+public:
+  SeqLock() {
+    for (int i = 0; i < WORDS; i++) words_[i].store(0, std::memory_order_relaxed);
+  }
+
+  // Only ever call from a single thread.
+  void Write(const T& value) {
+    uint64 buf[WORDS] = {};
+    memcpy(buf, &value, sizeof(T));
+
+    // Round down: a writer that died mid-update (possible when the lock
+    // lives in shared memory) leaves the sequence odd.
+    uint32 seq = sequence_.load(std::memory_order_relaxed) & ~1u;
+    sequence_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i = 0; i < WORDS; i++) words_[i].store(buf[i], std::memory_order_relaxed);
+    sequence_.store(seq + 2, std::memory_order_release);
+  }
+
+  // For a lock in shared memory whose last writer may have died
+  // mid-update: rounds the sequence up to even, so readers stop waiting on
+  // it. Only from the new writer's thread, before its first Write(); the
+  // payload is whatever the last writer left until then.
+  void ResetSequence() {
+    sequence_.store((sequence_.load(std::memory_order_relaxed) + 1) & ~1u, std::memory_order_release);
+  }
+
+  // Safe from any thread. Returns false if the writer was mid-update;
+  // callers that can't wait should keep their previous copy.
+  bool TryRead(T* value) const {
+    uint64 buf[WORDS];
+    uint32 seq0 = sequence_.load(std::memory_order_acquire);
+    if (seq0 & 1) return false;
+    for (int i = 0; i < WORDS; i++) buf[i] = words_[i].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint32 seq1 = sequence_.load(std::memory_order_relaxed);
+    if (seq0 != seq1) return false;
+    memcpy(value, buf, sizeof(T));
+    return true;
+  }
+
+  void Read(T* value) const {
+    while (!TryRead(value)) {
+      Thread::yield();
+    }
+  }
+
+  // Changes whenever a new value has been published.
+  uint32 GetVersion() const {
+    return sequence_.load(std::memory_order_acquire);
+  }
+
+private:
+  static_assert(std::is_trivially_copyable<T>::value, "SeqLock payload must be POD");
+  enum { WORDS = (sizeof(T) + sizeof(uint64) - 1) / sizeof(uint64) };
+
+  std::atomic<uint32> sequence_{0};
+  std::atomic<uint64> words_[WORDS];
+
+  JUCE_DECLARE_NON_COPYABLE(SeqLock)
+};
@@ -0,0 +1,405 @@
+#include "SessionLog.h"
+
+namespace {
+
+const char MAGIC[8] = "DSPYLOG";
+
+// Bits of the extension value that follows a varint with its low bit set.
+const uint32 EXT_FLAGS_MASK = 0xf;  // TIMING_FLAG_* bits 0-3, stored as they are.
+const uint32 EXT_NUM_SAMPLES = 1 << 4;
+const uint32 EXT_KEYFRAME = 1 << 5;
+const uint32 EXT_TRANSPORT = 1 << 6;  // TIMING_FLAG_TRANSPORT; from VERSION 2.
+const uint32 EXT_HOST_GAP = 1 << 7;   // TIMING_FLAG_HOST_GAP; from VERSION 2.
+
+// The TIMING_FLAG_* bits that are stored, as extension bits.
+inline uint32 FlagsToExt(uint32 flags) {
+  return (flags & EXT_FLAGS_MASK) |
+         ((flags & TIMING_FLAG_TRANSPORT) ? EXT_TRANSPORT : 0) |
+         ((flags & TIMING_FLAG_HOST_GAP) ? EXT_HOST_GAP : 0);
+}
+
+inline uint32 ExtToFlags(uint32 ext) {
+  return (ext & EXT_FLAGS_MASK) |
+         ((ext & EXT_TRANSPORT) ? TIMING_FLAG_TRANSPORT : 0) |
+         ((ext & EXT_HOST_GAP) ? TIMING_FLAG_HOST_GAP : 0);
+}
+
+// Worst case for one record, with plenty of slack.
+const int MAX_RECORD_BYTES = 32;
+
+inline uint64 ZigZag(int64 v) {
+  return (uint64(v) << 1) ^ uint64(v >> 63);
+}
+
+inline int64 UnZigZag(uint64 v) {
+  return int64(v >> 1) ^ -int64(v & 1);
+}
+
+inline int WriteVarint(uint8* p, uint64 v) {
+  int n = 0;
+  while (v >= 0x80) {
+    p[n++] = uint8(v) | 0x80;
+    v >>= 7;
+  }
+  p[n++] = uint8(v);
+  return n;
+}
+
+}  // namespace
+
+SessionLog::SessionLog() {
+}
+
+SessionLog::~SessionLog() {
+  Close();
+}
+
+File SessionLog::GetDefaultDirectory() {
+  return File::getSpecialLocation(File::userApplicationDataDirectory)
+      .getChildFile("dropoutspy").getChildFile("logs");
+}
+
+bool SessionLog::Open(const File& directory) {
+  Close();
+  directory_ = directory;
+  if (directory_.createDirectory().failed()) return false;
+
+  // Time plus a random tag, so instances opened in the same second don't
+  // share a session.
+  session_name_ = Time::getCurrentTime().formatted("%Y%m%d-%H%M%S") + "-" +
+                  String::toHexString(Random::getSystemRandom().nextInt() & 0xffff);
+  segment_number_ = 0;
+  segments_.clear();
+  session_records_ = 0;
+  record_count_.store(0);
+  dropped_count_.store(0);
+  if (!StartSegment(sample_rate_.load(), samples_per_block_.load())) return false;
+  open_.store(true, std::memory_order_release);
+  return true;
+}
+
+void SessionLog::Close() {
+  open_.store(false, std::memory_order_release);
+  FinishSegment();
+  segments_.clear();
+}
+
+void SessionLog::FindSegments(const File& segment, Array<File>* segments) {
+  // Segment names are <session>-<number>.dsl.
+  String session = segment.getFileNameWithoutExtension().upToLastOccurrenceOf("-", true, false);
+  segments->clear();
+  segment.getParentDirectory().findChildFiles(*segments, File::findFiles, false, session + "*.dsl");
+  segments->sort();
+}
+
+bool SessionLog::StartSegment(double sample_rate, int samples_per_block) {
+  segment_file_ = directory_.getChildFile(
+      session_name_ + "-" + String(segment_number_).paddedLeft('0', 4) + ".dsl");
+  {
+    // Size the file up front; the map can't grow it.
+    FileOutputStream out(segment_file_);
+    if (out.failedToOpen()) return false;
+    out.setPosition(SEGMENT_BYTES - 1);
+    out.writeByte(0);
+  }
+  segment_ = new MemoryMappedFile(segment_file_, MemoryMappedFile::readWrite);
+  if (segment_->getData() == nullptr || segment_->getSize() < size_t(SEGMENT_BYTES)) {
+    segment_ = nullptr;
+    segment_file_.deleteFile();
+    return false;
+  }
+  data_ = static_cast<uint8*>(segment_->getData());
+
+  SessionLogHeader header;
+  zerostruct(header);
+  memcpy(header.magic, MAGIC, sizeof(header.magic));
+  header.version = VERSION;
+  header.header_bytes = sizeof(SessionLogHeader);
+  header.ticks_per_second = Time::getHighResolutionTicksPerSecond();
+  header.sample_rate = sample_rate;
+  header.start_time_ms = Time::currentTimeMillis();
+  header.first_record_index = session_records_;
+  header.segment_number = segment_number_;
+  header.samples_per_block = samples_per_block;
+  header.bytes_used = sizeof(SessionLogHeader);
+  memcpy(data_, &header, sizeof(header));
+
+  write_pos_ = sizeof(SessionLogHeader);
+  segment_records_ = 0;
+  segment_sample_rate_ = sample_rate;
+  segment_samples_per_block_ = samples_per_block;
+
+  index_ = new FileOutputStream(segment_file_.withFileExtension("dsi"));
+  if (index_->failedToOpen()) {
+    // Readers rebuild the index by scanning.
+    index_ = nullptr;
+  }
+
+  segments_.add(segment_file_);
+  while (segments_.size() > MAX_SEGMENTS) {
+    segments_[0].deleteFile();
+    segments_[0].withFileExtension("dsi").deleteFile();
+    segments_.remove(0);
+  }
+  segment_number_++;
+  return true;
+}
+
+void SessionLog::FinishSegment() {
+  if (segment_ == nullptr) return;
+  UpdateHeader();
+  segment_ = nullptr;
+  data_ = nullptr;
+  index_ = nullptr;
+
+  // Give back the unused tail.
+  FileOutputStream out(segment_file_);
+  if (out.openedOk()) {
+    out.setPosition(write_pos_);
+    out.truncate();
+  }
+}
+
+void SessionLog::UpdateHeader() {
+  SessionLogHeader* header = reinterpret_cast<SessionLogHeader*>(data_);
+  header->record_count = segment_records_;
+  header->bytes_used = write_pos_;
+}
+
+void SessionLog::TimingRecordsReceived(const TimingRecord* records, int count) {
+  if (segment_ == nullptr) {
+    dropped_count_ += count;
+    return;
+  }
+  for (int i = 0; i < count; i++) {
+    if (records[i].flags & TIMING_FLAG_RESET) {
+      // prepareToPlay resets the processor, so a new format always starts
+      // with a reset record.
+      double rate = sample_rate_.load(std::memory_order_relaxed);
+      int block = samples_per_block_.load(std::memory_order_relaxed);
+      if (rate != segment_sample_rate_ || block != segment_samples_per_block_) {
+        if (segment_records_ > 0) {
+          FinishSegment();
+          StartSegment(rate, block);
+        } else {
+          SessionLogHeader* header = reinterpret_cast<SessionLogHeader*>(data_);
+          header->sample_rate = segment_sample_rate_ = rate;
+          header->samples_per_block = segment_samples_per_block_ = block;
+        }
+      }
+    }
+    Append(records[i]);
+  }
+  if (segment_ != nullptr) {
+    UpdateHeader();
+    if (index_ != nullptr) index_->flush();
+  }
+  record_count_.store(session_records_, std::memory_order_relaxed);
+}
+
+void SessionLog::Append(const TimingRecord& record) {
+  if (segment_ != nullptr && write_pos_ + MAX_RECORD_BYTES > SEGMENT_BYTES) {
+    FinishSegment();
+    StartSegment(segment_sample_rate_, segment_samples_per_block_);
+  }
+  if (segment_ == nullptr) {
+    dropped_count_++;
+    return;
+  }
+
+  uint8* p = data_ + write_pos_;
+  const uint32 flags = FlagsToExt(record.flags);
+  if (segment_records_ % KEYFRAME_INTERVAL == 0) {
+    // Absolute timestamp, and the reader's prediction starts over.
+    if (index_ != nullptr) {
+      SessionLogIndexEntry entry = { session_records_, record.ticks, write_pos_ };
+      index_->write(&entry, sizeof(entry));
+    }
+    p += WriteVarint(p, ((flags | EXT_KEYFRAME | EXT_NUM_SAMPLES) << 1) | 1);
+    memcpy(p, &record.ticks, sizeof(record.ticks));
+    p += sizeof(record.ticks);
+    p += WriteVarint(p, uint32(record.num_samples));
+    last_interval_ = 0;
+  } else {
+    const int64 interval = record.ticks - last_ticks_;
+    const uint64 zz = ZigZag(interval - last_interval_);
+    const bool samples_changed = record.num_samples != last_num_samples_;
+    if (flags == 0 && !samples_changed && (zz >> 63) == 0) {
+      p += WriteVarint(p, zz << 1);
+    } else {
+      p += WriteVarint(p, ((flags | (samples_changed ? EXT_NUM_SAMPLES : 0)) << 1) | 1);
+      p += WriteVarint(p, zz);
+      if (samples_changed) p += WriteVarint(p, uint32(record.num_samples));
+    }
+    last_interval_ = interval;
+  }
+  last_ticks_ = record.ticks;
+  last_num_samples_ = record.num_samples;
+
+  write_pos_ = p - data_;
+  segment_records_++;
+  session_records_++;
+}
+
+SessionLogReader::SessionLogReader(const File& segment) : file_(segment) {
+  zerostruct(header_);
+  map_ = new MemoryMappedFile(segment, MemoryMappedFile::readOnly);
+  const int64 size = int64(map_->getSize());
+  if (map_->getData() == nullptr || size < int64(sizeof(SessionLogHeader))) return;
+  memcpy(&header_, map_->getData(), sizeof(header_));
+  if (memcmp(header_.magic, MAGIC, sizeof(header_.magic)) != 0 ||
+      header_.version > SessionLog::VERSION ||
+      header_.header_bytes < sizeof(SessionLogHeader) ||
+      header_.header_bytes > size) {
+    return;
+  }
+  data_ = static_cast<const uint8*>(map_->getData());
+  end_ = jlimit(int64(header_.header_bytes), size, header_.bytes_used);
+  Rewind();
+}
+
+void SessionLogReader::Rewind() {
+  pos_ = header_.header_bytes;
+  record_index_ = header_.first_record_index;
+  last_ticks_ = 0;
+  last_interval_ = 0;
+  last_num_samples_ = 0;
+}
+
+bool SessionLogReader::ReadVarint(uint64* value) {
+  uint64 v = 0;
+  for (int shift = 0; shift < 64 && pos_ < end_; shift += 7) {
+    uint8 b = data_[pos_++];
+    v |= uint64(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) {
+      *value = v;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SessionLogReader::Decode(TimingRecord* record, bool* keyframe) {
+  uint64 v;
+  if (!ReadVarint(&v)) return false;
+  uint32 flags = 0;
+  *keyframe = false;
+  if ((v & 1) == 0) {
+    last_interval_ += UnZigZag(v >> 1);
+    last_ticks_ += last_interval_;
+  } else {
+    const uint32 ext = uint32(v >> 1);
+    flags = ExtToFlags(ext);
+    if (ext & EXT_KEYFRAME) {
+      if (pos_ + int64(sizeof(last_ticks_)) > end_) return false;
+      memcpy(&last_ticks_, data_ + pos_, sizeof(last_ticks_));
+      pos_ += sizeof(last_ticks_);
+      last_interval_ = 0;
+      *keyframe = true;
+    } else {
+      uint64 zz;
+      if (!ReadVarint(&zz)) return false;
+      last_interval_ += UnZigZag(zz);
+      last_ticks_ += last_interval_;
+    }
+    if (ext & EXT_NUM_SAMPLES) {
+      uint64 num_samples;
+      if (!ReadVarint(&num_samples)) return false;
+      last_num_samples_ = int32(num_samples);
+    }
+  }
+  record->ticks = last_ticks_;
+  record->delta = 0;
+  record->spread = 0;
+  record->num_samples = last_num_samples_;
+  record->flags = flags;
+  record->cpu = -1;
+  record->voluntary_switches = 0;
+  record->involuntary_switches = 0;
+  record->minor_faults = 0;
+  record->major_faults = 0;
+  record->reserved = 0;
+  return true;
+}
+
+bool SessionLogReader::Next(TimingRecord* record) {
+  bool keyframe;
+  if (data_ == nullptr || !Decode(record, &keyframe)) return false;
+  record_index_++;
+  return true;
+}
+
+const Array<SessionLogIndexEntry>& SessionLogReader::GetIndex() {
+  if (have_index_ || data_ == nullptr) return index_;
+  have_index_ = true;
+
+  FileInputStream in(file_.withFileExtension("dsi"));
+  if (in.openedOk()) {
+    SessionLogIndexEntry entry;
+    while (in.read(&entry, sizeof(entry)) == int(sizeof(entry))) {
+      // The sidecar is flushed after the segment header, so it can run
+      // ahead of bytes_used after a crash.
+      if (entry.offset < header_.header_bytes || entry.offset >= end_) break;
+      index_.add(entry);
+    }
+  }
+  if (index_.size() > 0 || end_ == header_.header_bytes) return index_;
+
+  // No sidecar: find the keyframes by decoding the whole segment.
+  const int64 saved_pos = pos_, saved_index = record_index_;
+  const int64 saved_ticks = last_ticks_, saved_interval = last_interval_;
+  const int32 saved_num_samples = last_num_samples_;
+  Rewind();
+  TimingRecord record;
+  for (;;) {
+    const int64 offset = pos_;
+    bool keyframe;
+    if (!Decode(&record, &keyframe)) break;
+    if (keyframe) {
+      SessionLogIndexEntry entry = { record_index_, record.ticks, offset };
+      index_.add(entry);
+    }
+    record_index_++;
+  }
+  pos_ = saved_pos;
+  record_index_ = saved_index;
+  last_ticks_ = saved_ticks;
+  last_interval_ = saved_interval;
+  last_num_samples_ = saved_num_samples;
+  return index_;
+}
+
+void SessionLogReader::SeekToKeyframe(const SessionLogIndexEntry& entry) {
+  pos_ = entry.offset;
+  record_index_ = entry.record_index;
+  last_ticks_ = 0;
+  last_interval_ = 0;
+  last_num_samples_ = 0;
+}
+
+bool SessionLogReader::Seek(int64 record_index) {
+  if (data_ == nullptr || record_index < header_.first_record_index) return false;
+  const Array<SessionLogIndexEntry>& index = GetIndex();
+
+  // Last keyframe at or before record_index.
+  int lo = 0, hi = index.size();
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (index.getReference(mid).record_index <= record_index) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == 0) {
+    Rewind();
+  } else {
+    SeekToKeyframe(index.getReference(lo - 1));
+  }
+
+  TimingRecord record;
+  while (record_index_ < record_index) {
+    if (!Next(&record)) return false;
+  }
+  return true;
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "TimingRecord.h"
+
+#include <atomic>
+
+// On-disk layout of a session log segment (".dsl"). Segments are written
+// through a memory map and stay readable if the host dies mid-session: the
+// header is updated after every batch, and anything past bytes_used is
+// ignored. All fields are little-endian.
+struct SessionLogHeader {
+  char magic[8];             // "DSPYLOG\0"
+  uint32 version;
+  uint32 header_bytes;       // Offset of the first record.
+  int64 ticks_per_second;    // Units of TimingRecord::ticks.
+  double sample_rate;
+  int64 start_time_ms;       // Wall clock when the segment was opened.
+  int64 first_record_index;  // Index of this segment's first record in the session.
+  int32 segment_number;
+  int32 samples_per_block;   // As given to prepareToPlay.
+  int64 bytes_used;          // Including the header.
+  int64 record_count;
+};
+
+// One entry per keyframe, in the ".dsi" sidecar next to each segment.
+struct SessionLogIndexEntry {
+  int64 record_index;  // In the session, not the segment.
+  int64 ticks;
+  int64 offset;        // Byte offset of the keyframe in the segment.
+};
+
+// Records every TimingRecord of a processor to a rotating set of
+// memory-mapped files. It is a TimingRecordStream listener, so all the
+// encoding and file work happens on the drain thread; the audio thread only
+// ever pushes into the stream's ring.
+//
+// Records are delta coded. Each one is a varint whose low bit says whether
+// it is a plain record (the remaining bits are the zigzagged change in the
+// interval since the previous callback) or carries a flags/format byte with
+// it. A steady 32-sample stream costs one or two bytes per callback, so a
+// day at 48 kHz is a few hundred MB. Every KEYFRAME_INTERVAL records the
+// full timestamp is written and indexed, so readers can seek without
+// decoding from the start. delta and spread aren't stored; they depend only
+// on the timestamps and are recomputed by whatever reads the log. Nor is
+// thread telemetry.
+class SessionLog : public TimingRecordStream::Listener {
+public:
+  enum {
+    VERSION = 2,  // 2 stores TIMING_FLAG_TRANSPORT and TIMING_FLAG_HOST_GAP.
+    SEGMENT_BYTES = 64 << 20,
+    MAX_SEGMENTS = 16,  // Oldest segments are deleted beyond this.
+    KEYFRAME_INTERVAL = 4096,
+  };
+
+  SessionLog();
+  ~SessionLog();
+
+  // Where logs go unless told otherwise:
+  // <user application data>/dropoutspy/logs.
+  static File GetDefaultDirectory();
+
+  // Starts a new session in directory. Call from any non-audio thread,
+  // before adding this as a listener. Returns false if the first segment
+  // couldn't be created.
+  bool Open(const File& directory);
+
+  // Finishes the current segment and trims it to its used size. Remove
+  // this from the stream's listeners first.
+  void Close();
+
+  // Between a successful Open() and Close(), even while the drain thread
+  // is between segments. Any thread.
+  bool IsOpen() const {
+    return open_.load(std::memory_order_acquire);
+  }
+
+  // Format of the records to come. Safe from any thread; a change starts
+  // a new segment at the next TIMING_FLAG_RESET record.
+  void SetFormat(double sample_rate, int samples_per_block) {
+    sample_rate_.store(sample_rate, std::memory_order_relaxed);
+    samples_per_block_.store(samples_per_block, std::memory_order_relaxed);
+  }
+
+  int64 GetRecordCount() const {
+    return record_count_.load(std::memory_order_relaxed);
+  }
+
+  // Records lost because a segment couldn't be created or mapped.
+  int64 GetDroppedCount() const {
+    return dropped_count_.load(std::memory_order_relaxed);
+  }
+
+  // All segments of the session that segment belongs to, oldest first.
+  static void FindSegments(const File& segment, Array<File>* segments);
+
+  // TimingRecordStream::Listener. Drain thread only.
+  void TimingRecordsReceived(const TimingRecord* records, int count) override;
+
+private:
+  bool StartSegment(double sample_rate, int samples_per_block);
+  void FinishSegment();
+  void Append(const TimingRecord& record);
+  void UpdateHeader();
+
+  File directory_;
+  String session_name_;
+  int segment_number_ = 0;
+  Array<File> segments_;
+
+  ScopedPointer<MemoryMappedFile> segment_;
+  ScopedPointer<FileOutputStream> index_;
+  File segment_file_;
+  uint8* data_ = nullptr;
+  int64 write_pos_ = 0;
+  int64 segment_records_ = 0;
+  double segment_sample_rate_ = 0;
+  int segment_samples_per_block_ = 0;
+  int64 session_records_ = 0;
+
+  // Encoder prediction state.
+  int64 last_ticks_ = 0;
+  int64 last_interval_ = 0;
+  int32 last_num_samples_ = 0;
+
+  std::atomic<double> sample_rate_{0};
+  std::atomic<int> samples_per_block_{0};
+  std::atomic<int64> record_count_{0};
+  std::atomic<int64> dropped_count_{0};
+  std::atomic<bool> open_{false};
+
+  JUCE_DECLARE_NON_COPYABLE(SessionLog)
+};
+
+// Reads one segment written by SessionLog. Decoded records have delta and
+// spread set to zero, and no thread telemetry.
+class SessionLogReader {
+public:
+  explicit SessionLogReader(const File& segment);
+
+  // False if the file is missing, not a session log, or from a newer
+  // version.
+  bool IsValid() const {
+    return data_ != nullptr;
+  }
+
+  const SessionLogHeader& GetHeader() const {
+    return header_;
+  }
+
+  // Keyframe positions, from the sidecar if present, else by scanning.
+  const Array<SessionLogIndexEntry>& GetIndex();
+
+  // Decodes the next record into *record. Returns false at the end.
+  bool Next(TimingRecord* record);
+
+  // Index in the session of the record Next() returns next.
+  int64 GetPosition() const {
+    return record_index_;
+  }
+
+  // Positions the reader so Next() returns record record_index (a session
+  // index). Decodes forward from the nearest keyframe.
+  bool Seek(int64 record_index);
+
+  // Positions the reader at a keyframe, taken from GetIndex() of this or
+  // another reader of the same segment.
+  void SeekToKeyframe(const SessionLogIndexEntry& entry);
+
+  // Back to the first record of the segment.
+  void Rewind();
+
+private:
+  bool Decode(TimingRecord* record, bool* keyframe);
+  bool ReadVarint(uint64* value);
+
+  ScopedPointer<MemoryMappedFile> map_;
+  File file_;
+  SessionLogHeader header_;
+  const uint8* data_ = nullptr;
+  int64 end_ = 0;
+  int64 pos_ = 0;
+  int64 record_index_ = 0;
+  bool have_index_ = false;
+  Array<SessionLogIndexEntry> index_;
+
+  int64 last_ticks_ = 0;
+  int64 last_interval_ = 0;
+  int32 last_num_samples_ = 0;
+
+  JUCE_DECLARE_NON_COPYABLE(SessionLogReader)
+};
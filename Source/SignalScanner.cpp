@@ -0,0 +1,224 @@
+#include "SignalScanner.h"
+
+#if defined(__AVX__)
+ #include <immintrin.h>
+ #define DROPOUTSPY_SCAN_AVX 1
+#elif JUCE_INTEL
+ #include <emmintrin.h>
+ #define DROPOUTSPY_SCAN_SSE2 1
+#elif defined(__aarch64__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+ #include <arm_neon.h>
+ #define DROPOUTSPY_SCAN_NEON 1
+#endif
+
+namespace {
+
+const int VECTOR = 16;  // Samples per mask.
+const int STRIDE = 64;  // Samples per live-signal check.
+
+// A boundary jump must be at least this big (-20 dBFS) and this many times
+// the steepest curvature around it.
+const float MIN_JUMP = 0.1f;
+const float JUMP_RATIO = 8.0f;
+
+// True if any of 64 samples is exactly zero.
+inline bool AnyZero(const float* data) {
+#if DROPOUTSPY_SCAN_AVX
+  const __m256 zero = _mm256_setzero_ps();
+  __m256 any = _mm256_cmp_ps(_mm256_loadu_ps(data), zero, _CMP_EQ_OQ);
+  for (int i = 8; i < STRIDE; i += 8) {
+    any = _mm256_or_ps(any, _mm256_cmp_ps(_mm256_loadu_ps(data + i), zero, _CMP_EQ_OQ));
+  }
+  return _mm256_movemask_ps(any) != 0;
+#elif DROPOUTSPY_SCAN_SSE2
+  // Four independent chains, so the ORs don't serialize.
+  const __m128 zero = _mm_setzero_ps();
+  __m128 any0 = _mm_setzero_ps();
+  __m128 any1 = _mm_setzero_ps();
+  __m128 any2 = _mm_setzero_ps();
+  __m128 any3 = _mm_setzero_ps();
+  for (int i = 0; i < STRIDE; i += 16) {
+    any0 = _mm_or_ps(any0, _mm_cmpeq_ps(_mm_loadu_ps(data + i), zero));
+    any1 = _mm_or_ps(any1, _mm_cmpeq_ps(_mm_loadu_ps(data + i + 4), zero));
+    any2 = _mm_or_ps(any2, _mm_cmpeq_ps(_mm_loadu_ps(data + i + 8), zero));
+    any3 = _mm_or_ps(any3, _mm_cmpeq_ps(_mm_loadu_ps(data + i + 12), zero));
+  }
+  return _mm_movemask_ps(_mm_or_ps(_mm_or_ps(any0, any1), _mm_or_ps(any2, any3))) != 0;
+#elif DROPOUTSPY_SCAN_NEON
+  const float32x4_t zero = vdupq_n_f32(0);
+  uint32x4_t any = vceqq_f32(vld1q_f32(data), zero);
+  for (int i = 4; i < STRIDE; i += 4) {
+    any = vorrq_u32(any, vceqq_f32(vld1q_f32(data + i), zero));
+  }
+  return vmaxvq_u32(any) != 0;
+#else
+  for (int i = 0; i < STRIDE; i++) {
+    if (data[i] == 0) return true;
+  }
+  return false;
+#endif
+}
+
+// Bit i is set if data[i] is not exactly zero (NaN counts as nonzero), for
+// 16 samples.
+inline uint32 NonzeroMask(const float* data) {
+#if DROPOUTSPY_SCAN_AVX
+  const __m256 zero = _mm256_setzero_ps();
+  const uint32 lo = uint32(_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(data), zero, _CMP_NEQ_UQ)));
+  const uint32 hi = uint32(_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(data + 8), zero, _CMP_NEQ_UQ)));
+  return lo | (hi << 8);
+#elif DROPOUTSPY_SCAN_SSE2
+  const __m128 zero = _mm_setzero_ps();
+  const uint32 m0 = uint32(_mm_movemask_ps(_mm_cmpneq_ps(_mm_loadu_ps(data), zero)));
+  const uint32 m1 = uint32(_mm_movemask_ps(_mm_cmpneq_ps(_mm_loadu_ps(data + 4), zero)));
+  const uint32 m2 = uint32(_mm_movemask_ps(_mm_cmpneq_ps(_mm_loadu_ps(data + 8), zero)));
+  const uint32 m3 = uint32(_mm_movemask_ps(_mm_cmpneq_ps(_mm_loadu_ps(data + 12), zero)));
+  return m0 | (m1 << 4) | (m2 << 8) | (m3 << 12);
+#elif DROPOUTSPY_SCAN_NEON
+  // No movemask on NEON: weight each lane's compare result by its bit and
+  // add across the vector.
+  static const uint32 WEIGHTS[4] = { 1, 2, 4, 8 };
+  const uint32x4_t weights = vld1q_u32(WEIGHTS);
+  const float32x4_t zero = vdupq_n_f32(0);
+  uint32 zeros = 0;
+  for (int i = 0; i < 4; i++) {
+    const uint32x4_t eq = vceqq_f32(vld1q_f32(data + 4 * i), zero);
+    zeros |= vaddvq_u32(vandq_u32(eq, weights)) << (4 * i);
+  }
+  return ~zeros & 0xffff;
+#else
+  uint32 mask = 0;
+  for (int i = 0; i < VECTOR; i++) {
+    if (data[i] != 0) mask |= 1u << i;
+  }
+  return mask;
+#endif
+}
+
+// Largest |second difference| for i in [begin, end); needs begin >= 2.
+float MaxCurvature(const float* data, int begin, int end) {
+  float curve = 0;
+  for (int i = begin; i < end; i++) {
+    curve = jmax(curve, std::abs(data[i] - 2 * data[i - 1] + data[i - 2]));
+  }
+  return curve;
+}
+
+template <typename T>
+void Increment(std::atomic<T>* value) {
+  value->store(value->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+SignalScanner::SignalScanner() {
+  Reset();
+}
+
+void SignalScanner::Prepare(double sample_rate) {
+  max_zero_run_ = jmax<int64>(MAX_MIN_ZERO_RUN, int64(sample_rate * MAX_ZERO_RUN_MS / 1000));
+  Reset();
+}
+
+void SignalScanner::Reset() {
+  scanning_ = false;
+  zero_runs_.store(0, std::memory_order_relaxed);
+  discontinuities_.store(0, std::memory_order_relaxed);
+  longest_zero_run_.store(0, std::memory_order_relaxed);
+  last_event_ticks_.store(0, std::memory_order_relaxed);
+}
+
+bool SignalScanner::EndZeroRun(Channel* channel) {
+  const int64 run = channel->zero_run;
+  if (!channel->live || run < GetMinZeroRun() || run > max_zero_run_) return false;
+  Increment(&zero_runs_);
+  if (run > longest_zero_run_.load(std::memory_order_relaxed)) {
+    longest_zero_run_.store(int32(run), std::memory_order_relaxed);
+  }
+  return true;
+}
+
+bool SignalScanner::ConsumeMask(Channel* channel, uint32 mask, int width) {
+  if (mask == 0) {
+    channel->zero_run += width;
+    return false;
+  }
+  // Zeros before the first nonzero sample end the current run; zeros after
+  // the last one start the next. Gaps in between are shorter than a vector,
+  // so shorter than any run we count.
+  bool counted = false;
+  channel->zero_run += findHighestSetBit(mask & (~mask + 1));
+  if (channel->zero_run > 0) counted = EndZeroRun(channel);
+  channel->live = true;
+  channel->zero_run = width - 1 - findHighestSetBit(mask);
+  return counted;
+}
+
+bool SignalScanner::CheckBoundary(Channel* channel, const float* data, int num_samples) {
+  const int edge = jmin(int(EDGE), num_samples);
+  const int tail_size = channel->tail_size;
+  bool flagged = false;
+  if (tail_size >= 2 && num_samples > 0) {
+    const float prev1 = channel->tail[tail_size - 1];
+    const float prev2 = channel->tail[tail_size - 2];
+    const float error = std::abs(data[0] - (2 * prev1 - prev2));
+    if (error > MIN_JUMP && prev1 != 0 && data[0] != 0) {
+      const float curve = jmax(MaxCurvature(channel->tail, 2, tail_size), MaxCurvature(data, 2, edge));
+      if (error > JUMP_RATIO * curve) {
+        Increment(&discontinuities_);
+        flagged = true;
+      }
+    }
+  }
+  memcpy(channel->tail, data + num_samples - edge, edge * sizeof(float));
+  channel->tail_size = edge;
+  return flagged;
+}
+
+bool SignalScanner::Process(const AudioSampleBuffer& buffer, int num_channels, int64 ticks) {
+  if (!IsEnabled()) {
+    scanning_ = false;
+    return false;
+  }
+  if (!scanning_) {
+    // Whatever the channels held is from before the scan was last off.
+    zeromem(channels_, sizeof(channels_));
+    scanning_ = true;
+  }
+
+  const int num_samples = buffer.getNumSamples();
+  num_channels = jmin(num_channels, buffer.getNumChannels(), int(MAX_CHANNELS));
+  bool event = false;
+  for (int c = 0; c < num_channels; c++) {
+    const float* data = buffer.getReadPointer(c);
+    Channel* channel = &channels_[c];
+    event |= CheckBoundary(channel, data, num_samples);
+
+    int i = 0;
+    while (i + VECTOR <= num_samples) {
+      // Live signal: the common case.
+      if (i + STRIDE <= num_samples && channel->zero_run == 0 && channel->live && !AnyZero(data + i)) {
+        i += STRIDE;
+        continue;
+      }
+      event |= ConsumeMask(channel, NonzeroMask(data + i), VECTOR);
+      i += VECTOR;
+    }
+    if (i < num_samples) {
+      uint32 mask = 0;
+      for (int k = 0; i + k < num_samples; k++) {
+        if (data[i + k] != 0) mask |= 1u << k;
+      }
+      event |= ConsumeMask(channel, mask, num_samples - i);
+    }
+  }
+  if (event) last_event_ticks_.store(ticks, std::memory_order_relaxed);
+  return event;
+}
+
+void SignalScanner::GetStats(SignalStats* stats) const {
+  stats->zero_runs = zero_runs_.load(std::memory_order_relaxed);
+  stats->discontinuities = discontinuities_.load(std::memory_order_relaxed);
+  stats->longest_zero_run = longest_zero_run_.load(std::memory_order_relaxed);
+  stats->last_event_ticks = last_event_ticks_.load(std::memory_order_relaxed);
+}
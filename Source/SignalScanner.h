@@ -0,0 +1,110 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#include <atomic>
+
+// What SignalScanner has found since the last reset.
+struct SignalStats {
+  int64 zero_runs;          // Runs of exact zeros inside live signal.
+  int64 discontinuities;    // Jumps at block boundaries.
+  int32 longest_zero_run;   // Samples, of the runs counted.
+  int64 last_event_ticks;   // Block timestamp of the latest event.
+};
+
+// Looks at the audio itself for underruns that don't show up in the
+// callback timing: a driver that misses a buffer often plays (or delivers)
+// a run of digital zeros, or skips ahead so the next block doesn't follow
+// on from the last.
+//
+// Zero runs: a run of exact 0.0f samples longer than the minimum, with
+// signal on both sides, in any input channel. Runs longer than
+// MAX_ZERO_RUN_MS are taken to be real silence (a muted track, a closed
+// gate) and ignored. The scan compares 64 samples at a time against zero
+// with SSE2, AVX or NEON and ORs the results, so live signal costs one
+// compare and one OR per vector and a branch per 64 samples; only vectors
+// that contain a zero are looked at sample by sample.
+//
+// Discontinuities: the first sample of a block is predicted by linear
+// extrapolation from the last two of the previous block. The block is
+// flagged if the prediction error is both large in absolute terms and
+// large relative to the steepest curvature nearby (the previous block's
+// tail and this block's head), which keeps loud, bright material from
+// tripping it. Blocks entering or leaving a zero run are left to the zero
+// run check. The curvature is only worked out for blocks that fail the
+// absolute test, so the common case is a copy of the last few samples.
+//
+// Both are heuristics, so the scan is off by default and its events are
+// counted separately from the timing warnings and dropouts.
+class SignalScanner {
+public:
+  enum {
+    MAX_CHANNELS = 32,
+    MIN_ZERO_RUN = 16,      // Shortest run the vector scan can resolve.
+    DEFAULT_ZERO_RUN = 32,
+    MAX_MIN_ZERO_RUN = 1024,
+    MAX_ZERO_RUN_MS = 100,
+    EDGE = 16,              // Samples each side of a boundary used for the curvature.
+  };
+
+  SignalScanner();
+
+  // Any thread; takes effect at the next block.
+  void SetEnabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+  }
+
+  bool IsEnabled() const {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  // Shortest zero run counted, clamped to MIN_ZERO_RUN..MAX_MIN_ZERO_RUN.
+  // Any thread; takes effect at the next run that ends.
+  void SetMinZeroRun(int samples) {
+    min_zero_run_.store(jlimit(int(MIN_ZERO_RUN), int(MAX_MIN_ZERO_RUN), samples), std::memory_order_relaxed);
+  }
+
+  int GetMinZeroRun() const {
+    return min_zero_run_.load(std::memory_order_relaxed);
+  }
+
+  // Audio thread (or prepareToPlay).
+  void Prepare(double sample_rate);
+  void Reset();
+
+  // Audio thread, before the buffer is modified. Returns true if this block
+  // had an event.
+  bool Process(const AudioSampleBuffer& buffer, int num_channels, int64 ticks);
+
+  // Any thread.
+  void GetStats(SignalStats* stats) const;
+
+private:
+  struct Channel {
+    int64 zero_run;     // Zeros since the last nonzero sample.
+    bool live;          // A nonzero sample has been seen.
+    int tail_size;      // Samples in tail, 0 if none.
+    float tail[EDGE];   // End of the previous block.
+  };
+
+  // Feeds the nonzero mask of the next `width` samples into the channel's
+  // zero-run state. Returns true if a run was counted.
+  bool ConsumeMask(Channel* channel, uint32 mask, int width);
+  bool EndZeroRun(Channel* channel);
+  bool CheckBoundary(Channel* channel, const float* data, int num_samples);
+
+  std::atomic<bool> enabled_{false};
+  std::atomic<int> min_zero_run_{DEFAULT_ZERO_RUN};
+
+  // Audio thread.
+  bool scanning_ = false;
+  int64 max_zero_run_ = 4800;
+  Channel channels_[MAX_CHANNELS];
+
+  std::atomic<int64> zero_runs_{0};
+  std::atomic<int64> discontinuities_{0};
+  std::atomic<int32> longest_zero_run_{0};
+  std::atomic<int64> last_event_ticks_{0};
+
+  JUCE_DECLARE_NON_COPYABLE(SignalScanner)
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#include <atomic>
+#include <type_traits>
+
+// Preallocated wait-free single-producer/single-consumer ring of POD items.
+//
+// The producer (the audio thread) never blocks and never allocates: if the
+// ring is full the item is dropped and counted. The consumer pulls items out
+// in batches. Capacity is rounded up to a power of two.
+template <typename T>
+class SpscRing {
+public:
+  explicit SpscRing(int capacity) {
+    int size = 1;
+    while (size < capacity) size <<= 1;
+    mask_ = uint32(size - 1);
+    items_.calloc(size_t(size));
+  }
+
+  // Producer only.
+  bool Push(const T& item) {
+    uint32 w = write_.load(std::memory_order_relaxed);
+    if (w - cached_read_ > mask_) {
+      cached_read_ = read_.load(std::memory_order_acquire);
+      if (w - cached_read_ > mask_) {
+        overflow_count_.store(overflow_count_.load(std::memory_order_relaxed) + 1,
+                              std::memory_order_relaxed);
+        return false;
+      }
+    }
+    items_[w & mask_] = item;
+    write_.store(w + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. Copies up to max_count items into out and returns how
+  // many were copied.
+  int PopBatch(T* out, int max_count) {
+    uint32 r = read_.load(std::memory_order_relaxed);
+    uint32 w = write_.load(std::memory_order_acquire);
+    uint32 count = w - r;
+    if (count > uint32(max_count)) count = uint32(max_count);
+    for (uint32 i = 0; i < count; i++) {
+      out[i] = items_[(r + i) & mask_];
+    }
+    read_.store(r + count, std::memory_order_release);
+    return int(count);
+  }
+
+  // Consumer only. Throws away everything currently queued.
+  int DiscardAll() {
+    uint32 r = read_.load(std::memory_order_relaxed);
+    uint32 w = write_.load(std::memory_order_acquire);
+    read_.store(w, std::memory_order_release);
+    return int(w - r);
+  }
+
+  // Number of items the producer had to drop because the ring was full.
+  int64 GetOverflowCount() const {
+    return overflow_count_.load(std::memory_order_relaxed);
+  }
+
+  int GetCapacity() const {
+    return int(mask_ + 1);
+  }
+
+private:
+  static_assert(std::is_trivially_copyable<T>::value, "SpscRing items must be POD");
+
+  HeapBlock<T> items_;
+  uint32 mask_ = 0;
+
+  // Producer and consumer indices are padded onto separate cache lines so
+  // the two threads don't false-share. (Padding rather than alignas, since
+  // C++11 operator new doesn't honour over-alignment.)
+  char pad0_[64];
+  std::atomic<uint32> write_{0};
+  uint32 cached_read_ = 0;
+  std::atomic<int64> overflow_count_{0};
+  char pad1_[64];
+  std::atomic<uint32> read_{0};
+  char pad2_[64];
+
+  JUCE_DECLARE_NON_COPYABLE(SpscRing)
+};
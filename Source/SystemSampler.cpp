@@ -0,0 +1,636 @@
+#include "SystemSampler.h"
+
+#include <algorithm>
+
+#if JUCE_LINUX
+ #include <dirent.h>
+ #include <fcntl.h>
+ #include <time.h>
+ #include <unistd.h>
+ #define DROPOUTSPY_HAVE_PROCFS 1
+#else
+ #define DROPOUTSPY_HAVE_PROCFS 0
+#endif
+
+namespace {
+
+enum { CPU_USER, CPU_NICE, CPU_SYSTEM, CPU_IDLE, CPU_IOWAIT, CPU_IRQ, CPU_SOFTIRQ, CPU_STEAL, CPU_FIELDS };
+
+const char* const PRESSURE_PATHS[3] = { "/proc/pressure/cpu", "/proc/pressure/io", "/proc/pressure/memory" };
+
+// Appends to a NUL-terminated buffer, truncating at its end.
+void Append(char* buffer, int size, int* length, const char* format, ...) {
+  if (*length >= size - 1) return;
+  va_list args;
+  va_start(args, format);
+  const int written = vsnprintf(buffer + *length, size_t(size - *length), format, args);
+  va_end(args);
+  if (written > 0) *length = jmin(size - 1, *length + written);
+}
+
+// "870", "12.3k", "1.2M".
+const char* FormatRate(char* buffer, int size, float rate) {
+  if (rate >= 1e6f) {
+    snprintf(buffer, size, "%.1fM", rate * 1e-6f);
+  } else if (rate >= 1e4f) {
+    snprintf(buffer, size, "%.0fk", rate * 1e-3f);
+  } else if (rate >= 1e3f) {
+    snprintf(buffer, size, "%.1fk", rate * 1e-3f);
+  } else {
+    snprintf(buffer, size, "%.0f", rate);
+  }
+  return buffer;
+}
+
+void CopyName(char* name, int size, const char* begin, const char* end) {
+  const int length = jmin(size - 1, int(end - begin));
+  memcpy(name, begin, size_t(jmax(0, length)));
+  name[jmax(0, length)] = 0;
+}
+
+const char* SkipSpaces(const char* p) {
+  while (*p == ' ' || *p == '\t') p++;
+  return p;
+}
+
+// Parses an unsigned decimal, advancing p past it; false if there isn't one.
+bool ParseNumber(const char** p, uint64* value) {
+  const char* q = SkipSpaces(*p);
+  if (*q < '0' || *q > '9') return false;
+  uint64 result = 0;
+  while (*q >= '0' && *q <= '9') result = result * 10 + uint64(*q++ - '0');
+  *value = result;
+  *p = q;
+  return true;
+}
+
+#if DROPOUTSPY_HAVE_PROCFS
+// For files read too rarely, or too many, to keep open: the per-CPU sysfs
+// files and /proc/<pid>/stat.
+bool ReadSmallFile(const char* path, char* buffer, int size) {
+  const int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  const ssize_t length = read(fd, buffer, size_t(size - 1));
+  close(fd);
+  if (length <= 0) return false;
+  buffer[length] = 0;
+  return true;
+}
+
+int64 ThreadCpuNanoseconds() {
+  timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return int64(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+#endif
+
+}  // namespace
+
+struct SystemSampler::Snapshot {
+  int64 ticks;
+  int64 wall_ms;
+
+  // /proc/stat, in clock ticks summed over every CPU.
+  bool have_stat;
+  uint64 cpu[CPU_FIELDS];
+  uint64 context_switches;
+  uint64 interrupts;
+
+  // /proc/interrupts, summed over CPUs, one per line in irq_names_ order;
+  // only comparable between snapshots with the same layout.
+  uint32 irq_layout;
+  int num_irqs;
+  uint64 irq_counts[MAX_IRQS];
+
+  // cpufreq and cpuidle, over the CPUs that have them.
+  int32 min_khz;              // -1 if no CPU has cpufreq.
+  int32 max_khz;
+  int idle_cpus;
+  uint64 idle_us[SystemEventReport::MAX_IDLE_STATES];
+
+  // /proc/pressure "some" totals, or -1.
+  int64 pressure_us[3];
+};
+
+// A /proc file kept open and re-read from the start each time, which is
+// much cheaper than opening it again.
+class SystemSampler::ProcFile {
+public:
+  explicit ProcFile(const char* path) : data_(4096) {
+#if DROPOUTSPY_HAVE_PROCFS
+    fd_ = open(path, O_RDONLY | O_CLOEXEC);
+#endif
+  }
+
+  ~ProcFile() {
+#if DROPOUTSPY_HAVE_PROCFS
+    if (fd_ >= 0) close(fd_);
+#endif
+  }
+
+  // The whole file, NUL terminated, or nullptr.
+  const char* Read() {
+#if DROPOUTSPY_HAVE_PROCFS
+    if (fd_ < 0) return nullptr;
+    size_t length = 0;
+    for (;;) {
+      if (length + 1 >= data_.size()) data_.resize(data_.size() * 2);
+      const ssize_t n = pread(fd_, &data_[length], data_.size() - length - 1, off_t(length));
+      if (n < 0) return nullptr;
+      if (n == 0) break;
+      length += size_t(n);
+    }
+    data_[length] = 0;
+    return data_.data();
+#else
+    return nullptr;
+#endif
+  }
+
+private:
+  int fd_ = -1;
+  std::vector<char> data_;
+
+  JUCE_DECLARE_NON_COPYABLE(ProcFile)
+};
+
+SystemSampler::SystemSampler() : Thread("dropoutspy system sampler") {
+  ring_.calloc(size_t(RING_SIZE));
+  zeromem(idle_names_, sizeof(idle_names_));
+  zeromem(irq_names_, sizeof(irq_names_));
+#if DROPOUTSPY_HAVE_PROCFS
+  num_cpus_ = jlimit(1, int(MAX_CPUS), int(sysconf(_SC_NPROCESSORS_CONF)));
+  // The idle states are the same on every CPU; take their names from the
+  // first.
+  char path[96];
+  char name[32];
+  while (num_idle_states_ < SystemEventReport::MAX_IDLE_STATES) {
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cpuidle/state%d/name", num_idle_states_);
+    if (!ReadSmallFile(path, name, sizeof(name))) break;
+    CopyName(idle_names_[num_idle_states_], sizeof(idle_names_[0]), name, name + strcspn(name, "\n"));
+    num_idle_states_++;
+  }
+  stat_file_ = new ProcFile("/proc/stat");
+  interrupts_file_ = new ProcFile("/proc/interrupts");
+  for (int i = 0; i < 3; i++) pressure_files_[i] = new ProcFile(PRESSURE_PATHS[i]);
+  startThread(2);
+#endif
+}
+
+SystemSampler::~SystemSampler() {
+  stopThread(4000);
+}
+
+void SystemSampler::RequestReport(SystemEventLog* log, int64 ticks) {
+  {
+    ScopedLock l(lock_);
+    for (Request& request : pending_) {
+      if (request.log == log) {
+        request.dropouts++;
+        return;
+      }
+    }
+    if (pending_.size() >= MAX_PENDING) return;
+    pending_.add({ log, ticks, 1 });
+  }
+  notify();
+}
+
+void SystemSampler::Cancel(SystemEventLog* log) {
+  // Reports are delivered under lock_, so once it's ours none is under way.
+  ScopedLock l(lock_);
+  for (int i = pending_.size() - 1; i >= 0; i--) {
+    if (pending_.getReference(i).log == log) pending_.remove(i);
+  }
+}
+
+void SystemSampler::Hurry() {
+  const int64 now = Time::currentTimeMillis();
+  const bool hurrying = hurry_until_ms_.load(std::memory_order_relaxed) > now;
+  hurry_until_ms_.store(now + HURRY_MS, std::memory_order_relaxed);
+  if (!hurrying) notify();
+}
+
+void SystemSampler::run() {
+#if DROPOUTSPY_HAVE_PROCFS
+  uint32 last_scan_ms = 0;
+  while (!threadShouldExit()) {
+    const int64 start_ns = ThreadCpuNanoseconds();
+    const uint32 start_ms = Time::getMillisecondCounter();
+    TakeSnapshot(&ring_[int(snapshot_count_ % RING_SIZE)]);
+    snapshot_count_++;
+
+    bool pending;
+    {
+      ScopedLock l(lock_);
+      pending = pending_.size() > 0;
+    }
+    if (pending || process_scans_ == 0 || start_ms - last_scan_ms >= uint32(PROCESS_SCAN_MS)) {
+      ScanProcesses();
+      last_scan_ms = start_ms;
+    }
+    if (pending) DeliverReports();
+
+    // However hurried, spend no more than CPU_BUDGET; a dropout report that
+    // comes in meanwhile waits for the next snapshot like any other.
+    const double cost_ms = (ThreadCpuNanoseconds() - start_ns) * 1e-6;
+    const int budget_ms = int(cost_ms / CPU_BUDGET);
+    while (!threadShouldExit() && int(Time::getMillisecondCounter() - start_ms) < budget_ms) {
+      sleep(jmin(50, budget_ms - int(Time::getMillisecondCounter() - start_ms)));
+    }
+    const bool hurrying = Time::currentTimeMillis() < hurry_until_ms_.load(std::memory_order_relaxed);
+    const int interval_ms = hurrying ? FAST_INTERVAL_MS : INTERVAL_MS;
+    const int elapsed_ms = int(Time::getMillisecondCounter() - start_ms);
+    if (elapsed_ms < interval_ms) wait(interval_ms - elapsed_ms);
+  }
+#endif
+}
+
+void SystemSampler::TakeSnapshot(Snapshot* snapshot) {
+  snapshot->ticks = Time::getHighResolutionTicks();
+  snapshot->wall_ms = Time::currentTimeMillis();
+  ReadStat(snapshot);
+  ReadInterrupts(snapshot);
+  ReadCpus(snapshot);
+  ReadPressure(snapshot);
+}
+
+void SystemSampler::ReadStat(Snapshot* snapshot) {
+  snapshot->have_stat = false;
+  const char* text = stat_file_ ? stat_file_->Read() : nullptr;
+  if (text == nullptr) return;
+  zeromem(snapshot->cpu, sizeof(snapshot->cpu));
+  snapshot->context_switches = 0;
+  snapshot->interrupts = 0;
+  for (const char* line = text; *line; ) {
+    const char* p = line;
+    if (strncmp(p, "cpu ", 4) == 0) {
+      p += 4;
+      for (int i = 0; i < CPU_FIELDS && ParseNumber(&p, &snapshot->cpu[i]); i++) {}
+      snapshot->have_stat = true;
+    } else if (strncmp(p, "ctxt ", 5) == 0) {
+      p += 5;
+      ParseNumber(&p, &snapshot->context_switches);
+    } else if (strncmp(p, "intr ", 5) == 0) {
+      p += 5;
+      ParseNumber(&p, &snapshot->interrupts);
+    }
+    line = strchr(p, '\n');
+    if (line == nullptr) break;
+    line++;
+  }
+}
+
+// The first line names the CPU columns; each later one is a label, a count
+// per CPU, and a description. Lines for device interrupts are named by the
+// device (the last word), the rest (LOC, RES, TLB...) by their label.
+void SystemSampler::ReadInterrupts(Snapshot* snapshot) {
+  snapshot->num_irqs = 0;
+  snapshot->irq_layout = irq_layout_;
+  const char* text = interrupts_file_ ? interrupts_file_->Read() : nullptr;
+  if (text == nullptr) return;
+  const char* line_end = strchr(text, '\n');
+  if (line_end == nullptr) return;
+  int columns = 0;
+  for (const char* p = strstr(text, "CPU"); p != nullptr && p < line_end; p = strstr(p + 3, "CPU")) columns++;
+
+  int count = 0;
+  bool changed = false;
+  for (const char* line = line_end + 1; *line && count < MAX_IRQS; ) {
+    line_end = strchr(line, '\n');
+    if (line_end == nullptr) line_end = line + strlen(line);
+    const char* label = SkipSpaces(line);
+    const char* colon = strchr(label, ':');
+    if (colon != nullptr && colon < line_end) {
+      const char* p = colon + 1;
+      uint64 total = 0;
+      uint64 value;
+      for (int i = 0; i < columns && ParseNumber(&p, &value); i++) total += value;
+
+      char name[sizeof(irq_names_[0])];
+      if (*label >= '0' && *label <= '9') {
+        const char* end = line_end;
+        while (end > p && (end[-1] == ' ' || end[-1] == '\r')) end--;
+        const char* begin = end;
+        while (begin > p && begin[-1] != ' ') begin--;
+        // "24 xhci_hcd": the number keeps apart devices sharing a driver.
+        char label_text[8];
+        CopyName(label_text, sizeof(label_text), label, colon);
+        char device[sizeof(name)];
+        CopyName(device, sizeof(device), begin, end);
+        snprintf(name, sizeof(name), "%s %s", label_text, device);
+      } else {
+        CopyName(name, sizeof(name), label, colon);
+      }
+      if (count >= num_irqs_ || strcmp(name, irq_names_[count]) != 0) {
+        strcpy(irq_names_[count], name);
+        changed = true;
+      }
+      snapshot->irq_counts[count++] = total;
+    }
+    if (*line_end == 0) break;
+    line = line_end + 1;
+  }
+  if (changed || count != num_irqs_) {
+    num_irqs_ = count;
+    irq_layout_++;
+  }
+  snapshot->num_irqs = count;
+  snapshot->irq_layout = irq_layout_;
+}
+
+void SystemSampler::ReadCpus(Snapshot* snapshot) {
+  snapshot->min_khz = -1;
+  snapshot->max_khz = -1;
+  snapshot->idle_cpus = 0;
+  zeromem(snapshot->idle_us, sizeof(snapshot->idle_us));
+#if DROPOUTSPY_HAVE_PROCFS
+  char path[96];
+  char text[32];
+  for (int cpu = 0; cpu < num_cpus_; cpu++) {
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", cpu);
+    if (ReadSmallFile(path, text, sizeof(text))) {
+      const int32 khz = int32(atoi(text));
+      snapshot->min_khz = snapshot->min_khz < 0 ? khz : jmin(snapshot->min_khz, khz);
+      snapshot->max_khz = jmax(snapshot->max_khz, khz);
+    }
+    bool have_idle = false;
+    for (int state = 0; state < num_idle_states_; state++) {
+      snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpuidle/state%d/time", cpu, state);
+      uint64 us;
+      const char* p = text;
+      if (!ReadSmallFile(path, text, sizeof(text)) || !ParseNumber(&p, &us)) break;
+      snapshot->idle_us[state] += us;
+      have_idle = true;
+    }
+    if (have_idle) snapshot->idle_cpus++;
+  }
+#endif
+}
+
+void SystemSampler::ReadPressure(Snapshot* snapshot) {
+  for (int i = 0; i < 3; i++) {
+    snapshot->pressure_us[i] = -1;
+    const char* text = pressure_files_[i] ? pressure_files_[i]->Read() : nullptr;
+    if (text == nullptr || strncmp(text, "some ", 5) != 0) continue;
+    const char* total = strstr(text, "total=");
+    const char* line_end = strchr(text, '\n');
+    if (total == nullptr || (line_end != nullptr && total > line_end)) continue;
+    total += 6;
+    uint64 value;
+    if (ParseNumber(&total, &value)) snapshot->pressure_us[i] = int64(value);
+  }
+}
+
+void SystemSampler::ScanProcesses() {
+#if DROPOUTSPY_HAVE_PROCFS
+  processes_[0].swap(processes_[1]);
+  process_scan_ticks_[0] = process_scan_ticks_[1];
+  std::vector<ProcessSample>& scan = processes_[1];
+  scan.clear();
+  DIR* dir = opendir("/proc");
+  if (dir == nullptr) return;
+  char path[64];
+  char text[1024];
+  while (const dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] < '1' || entry->d_name[0] > '9') continue;
+    snprintf(path, sizeof(path), "/proc/%s/stat", entry->d_name);
+    if (!ReadSmallFile(path, text, sizeof(text))) continue;
+    // "pid (comm) state ppid ..."; comm may hold spaces and parentheses,
+    // so fields are counted from the last ')'.
+    const char* open_paren = strchr(text, '(');
+    const char* close_paren = strrchr(text, ')');
+    if (open_paren == nullptr || close_paren == nullptr || close_paren < open_paren) continue;
+    const char* p = close_paren + 1;
+    // utime and stime are the 12th and 13th fields after comm.
+    for (int field = 0; field < 11 && *p; field++) {
+      p = SkipSpaces(p);
+      while (*p && *p != ' ') p++;
+    }
+    uint64 utime;
+    uint64 stime;
+    if (!ParseNumber(&p, &utime) || !ParseNumber(&p, &stime)) continue;
+    ProcessSample sample;
+    sample.pid = int32(atoi(entry->d_name));
+    sample.cpu_ticks = int64(utime + stime);
+    CopyName(sample.name, sizeof(sample.name), open_paren + 1, close_paren);
+    scan.push_back(sample);
+  }
+  closedir(dir);
+  std::sort(scan.begin(), scan.end(),
+            [](const ProcessSample& a, const ProcessSample& b) { return a.pid < b.pid; });
+  process_scan_ticks_[1] = Time::getHighResolutionTicks();
+  process_scans_++;
+#endif
+}
+
+void SystemSampler::DeliverReports() {
+  ScopedLock l(lock_);
+  const int64 oldest = jmax<int64>(0, snapshot_count_ - RING_SIZE);
+  const Snapshot& newest = ring_[int((snapshot_count_ - 1) % RING_SIZE)];
+  for (int i = 0; i < pending_.size(); ) {
+    const Request request = pending_.getReference(i);
+    if (newest.ticks < request.ticks) {
+      i++;
+      continue;
+    }
+    // The newest snapshot at or before the dropout (or the oldest there is,
+    // if the dropout is older still), and the first one after.
+    const Snapshot* before = &ring_[int(oldest % RING_SIZE)];
+    const Snapshot* after = &newest;
+    for (int64 n = snapshot_count_ - 1; n >= oldest; n--) {
+      const Snapshot& snapshot = ring_[int(n % RING_SIZE)];
+      if (snapshot.ticks <= request.ticks) {
+        before = &snapshot;
+        break;
+      }
+      after = &snapshot;
+    }
+    SystemEventReport report;
+    MakeReport(request, *before, *after, &report);
+    request.log->AddReport(report);
+    pending_.remove(i);
+  }
+}
+
+void SystemSampler::MakeReport(const Request& request, const Snapshot& before, const Snapshot& after,
+                               SystemEventReport* report) const {
+  zerostruct(*report);
+  report->ticks = request.ticks;
+  report->wall_ms = after.wall_ms - int64((after.ticks - request.ticks) * 1000.0 /
+                                          Time::getHighResolutionTicksPerSecond());
+  report->dropouts = request.dropouts;
+  const double seconds = jmax(1e-3, Time::highResolutionTicksToSeconds(after.ticks - before.ticks));
+  report->seconds = float(seconds);
+
+  report->busy_percent = -1;
+  report->iowait_percent = -1;
+  report->irq_percent = -1;
+  report->steal_percent = -1;
+  report->context_switches_per_second = -1;
+  report->interrupts_per_second = -1;
+  if (before.have_stat && after.have_stat) {
+    uint64 delta[CPU_FIELDS];
+    uint64 total = 0;
+    for (int i = 0; i < CPU_FIELDS; i++) {
+      delta[i] = after.cpu[i] >= before.cpu[i] ? after.cpu[i] - before.cpu[i] : 0;
+      total += delta[i];
+    }
+    if (total > 0) {
+      const double scale = 100.0 / total;
+      report->busy_percent = float((total - delta[CPU_IDLE] - delta[CPU_IOWAIT]) * scale);
+      report->iowait_percent = float(delta[CPU_IOWAIT] * scale);
+      report->irq_percent = float((delta[CPU_IRQ] + delta[CPU_SOFTIRQ]) * scale);
+      report->steal_percent = float(delta[CPU_STEAL] * scale);
+    }
+    report->context_switches_per_second = float((after.context_switches - before.context_switches) / seconds);
+    report->interrupts_per_second = float((after.interrupts - before.interrupts) / seconds);
+  }
+
+  // Busiest interrupt lines, by insertion into a short sorted list.
+  int num_irqs = 0;
+  if (before.irq_layout == after.irq_layout && before.num_irqs == after.num_irqs) {
+    for (int i = 0; i < after.num_irqs; i++) {
+      if (after.irq_counts[i] <= before.irq_counts[i]) continue;
+      const float rate = float((after.irq_counts[i] - before.irq_counts[i]) / seconds);
+      int j = jmin(num_irqs, int(SystemEventReport::TOP_IRQS) - 1);
+      if (num_irqs == SystemEventReport::TOP_IRQS && rate <= report->irqs[j].per_second) continue;
+      for (; j > 0 && report->irqs[j - 1].per_second < rate; j--) report->irqs[j] = report->irqs[j - 1];
+      strcpy(report->irqs[j].name, irq_names_[i]);
+      report->irqs[j].per_second = rate;
+      num_irqs = jmin(num_irqs + 1, int(SystemEventReport::TOP_IRQS));
+    }
+  }
+
+  report->min_mhz = after.min_khz < 0 ? -1 : after.min_khz / 1000;
+  report->max_mhz = after.max_khz < 0 ? -1 : after.max_khz / 1000;
+
+  if (before.idle_cpus > 0 && before.idle_cpus == after.idle_cpus) {
+    report->num_idle_states = num_idle_states_;
+    const double scale = 100.0 / (seconds * 1e6 * after.idle_cpus);
+    for (int i = 0; i < num_idle_states_; i++) {
+      strcpy(report->idle[i].name, idle_names_[i]);
+      const uint64 us = after.idle_us[i] >= before.idle_us[i] ? after.idle_us[i] - before.idle_us[i] : 0;
+      report->idle[i].percent = float(jmin(100.0, us * scale));
+    }
+  }
+
+  float* pressure[3] = { &report->pressure_cpu_percent, &report->pressure_io_percent,
+                         &report->pressure_memory_percent };
+  for (int i = 0; i < 3; i++) {
+    *pressure[i] = -1;
+    if (before.pressure_us[i] >= 0 && after.pressure_us[i] >= before.pressure_us[i]) {
+      *pressure[i] = float(jmin(100.0, (after.pressure_us[i] - before.pressure_us[i]) * 1e-4 / seconds));
+    }
+  }
+
+  // Busiest processes between the last two scans; both are sorted by pid.
+  report->process_seconds = -1;
+  if (process_scans_ >= 2) {
+#if DROPOUTSPY_HAVE_PROCFS
+    const double process_seconds =
+        jmax(1e-3, Time::highResolutionTicksToSeconds(process_scan_ticks_[1] - process_scan_ticks_[0]));
+    const double scale = 100.0 / (process_seconds * sysconf(_SC_CLK_TCK));
+    report->process_seconds = float(process_seconds);
+    int num_processes = 0;
+    const std::vector<ProcessSample>& old_scan = processes_[0];
+    size_t k = 0;
+    for (const ProcessSample& sample : processes_[1]) {
+      while (k < old_scan.size() && old_scan[k].pid < sample.pid) k++;
+      if (k == old_scan.size()) break;
+      if (old_scan[k].pid != sample.pid || sample.cpu_ticks <= old_scan[k].cpu_ticks) continue;
+      const float percent = float((sample.cpu_ticks - old_scan[k].cpu_ticks) * scale);
+      int j = jmin(num_processes, int(SystemEventReport::TOP_PROCESSES) - 1);
+      if (num_processes == SystemEventReport::TOP_PROCESSES && percent <= report->processes[j].cpu_percent) {
+        continue;
+      }
+      for (; j > 0 && report->processes[j - 1].cpu_percent < percent; j--) {
+        report->processes[j] = report->processes[j - 1];
+      }
+      strcpy(report->processes[j].name, sample.name);
+      report->processes[j].pid = sample.pid;
+      report->processes[j].cpu_percent = percent;
+      num_processes = jmin(num_processes + 1, int(SystemEventReport::TOP_PROCESSES));
+    }
+#endif
+  }
+}
+
+const char* FormatSystemEventReport(const SystemEventReport& report, bool brief, char* buffer, int size) {
+  char rate[16];
+  int length = 0;
+  buffer[0] = 0;
+  if (report.busy_percent >= 0) {
+    Append(buffer, size, &length, "cpu %.0f%%", report.busy_percent);
+    if (!brief) {
+      Append(buffer, size, &length, " (irq %.0f%%, iowait %.0f%%, steal %.0f%%), %s int/s",
+             report.irq_percent, report.iowait_percent, report.steal_percent,
+             FormatRate(rate, sizeof(rate), report.interrupts_per_second));
+      Append(buffer, size, &length, ", %s cs/s", FormatRate(rate, sizeof(rate), report.context_switches_per_second));
+    }
+  }
+  for (int i = 0; i < (brief ? 1 : int(SystemEventReport::TOP_IRQS)) && report.irqs[i].name[0]; i++) {
+    Append(buffer, size, &length, "%s%s %s/s", i == 0 ? (length ? "; " : "") : ", ", report.irqs[i].name,
+           FormatRate(rate, sizeof(rate), report.irqs[i].per_second));
+  }
+  if (!brief) {
+    if (report.min_mhz >= 0) {
+      Append(buffer, size, &length, "; %d-%d MHz", int(report.min_mhz), int(report.max_mhz));
+    }
+    for (int i = 0; i < report.num_idle_states; i++) {
+      Append(buffer, size, &length, "%s %s %.0f%%", i == 0 ? "; idle" : ",", report.idle[i].name,
+             report.idle[i].percent);
+    }
+    if (report.pressure_cpu_percent >= 0) {
+      Append(buffer, size, &length, "; psi cpu %.0f%%, io %.0f%%, mem %.0f%%", report.pressure_cpu_percent,
+             jmax(0.0f, report.pressure_io_percent), jmax(0.0f, report.pressure_memory_percent));
+    }
+  }
+  for (int i = 0; i < (brief ? 1 : int(SystemEventReport::TOP_PROCESSES)) && report.processes[i].name[0]; i++) {
+    if (brief) {
+      Append(buffer, size, &length, "%s%s %.0f%%", length ? "; " : "", report.processes[i].name,
+             report.processes[i].cpu_percent);
+    } else {
+      Append(buffer, size, &length, "%s%s[%d] %.0f%%", i == 0 ? (length ? "; top " : "top ") : ", ",
+             report.processes[i].name, int(report.processes[i].pid), report.processes[i].cpu_percent);
+    }
+  }
+  if (length == 0) Append(buffer, size, &length, "no system data");
+  return buffer;
+}
+
+SystemEventLog::SystemEventLog() {
+  zeromem(reports_, sizeof(reports_));
+}
+
+SystemEventLog::~SystemEventLog() {
+  sampler_->Cancel(this);
+}
+
+void SystemEventLog::TimingRecordsReceived(const TimingRecord* records, int count) {
+  for (int i = 0; i < count; i++) {
+    const TimingRecord& record = records[i];
+    if ((record.flags & TIMING_FLAG_SUB_BLOCK) || record.ticks < 0) continue;
+    if (record.flags & TIMING_FLAG_DROPOUT) sampler_->RequestReport(this, record.ticks);
+    if (record.spread > HURRY_SPREAD && record.spread > last_spread_) sampler_->Hurry();
+    last_spread_ = record.spread;
+  }
+}
+
+int64 SystemEventLog::GetReportCount() const {
+  ScopedLock l(lock_);
+  return count_;
+}
+
+bool SystemEventLog::GetReport(int64 index, SystemEventReport* report) const {
+  ScopedLock l(lock_);
+  if (index < 0 || index >= count_ || index < count_ - CAPACITY) return false;
+  *report = reports_[int(index % CAPACITY)];
+  return true;
+}
+
+void SystemEventLog::AddReport(const SystemEventReport& report) {
+  ScopedLock l(lock_);
+  reports_[int(count_ % CAPACITY)] = report;
+  count_++;
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "TimingRecord.h"
+
+#include <atomic>
+#include <vector>
+
+// What the machine was doing around a dropout: the difference between the
+// system snapshots taken just before and just after it. Percentages are of
+// the whole machine (all CPUs) over the snapshot interval. Fields a source
+// couldn't provide are negative (or empty names).
+struct SystemEventReport {
+  enum { TOP_IRQS = 3, TOP_PROCESSES = 3, MAX_IDLE_STATES = 8 };
+
+  int64 ticks;                // Of the first dropout it covers.
+  int64 wall_ms;
+  int32 dropouts;             // Dropouts of this instance that fell in the interval.
+  float seconds;              // Between the two snapshots.
+
+  // /proc/stat.
+  float busy_percent;         // Everything but idle and iowait.
+  float iowait_percent;
+  float irq_percent;          // Hard and soft interrupts.
+  float steal_percent;        // Taken by the hypervisor.
+  float context_switches_per_second;
+  float interrupts_per_second;
+
+  // /proc/interrupts, busiest first.
+  struct Irq {
+    char name[24];
+    float per_second;
+  } irqs[TOP_IRQS];
+
+  // cpufreq, after: the slowest and fastest CPU.
+  int32 min_mhz;
+  int32 max_mhz;
+
+  // cpuidle: share of CPU time spent in each idle state.
+  int32 num_idle_states;
+  struct IdleState {
+    char name[12];
+    float percent;
+  } idle[MAX_IDLE_STATES];
+
+  // /proc/pressure: share of the interval some task was stalled on each.
+  float pressure_cpu_percent;
+  float pressure_io_percent;
+  float pressure_memory_percent;
+
+  // /proc/<pid>/stat, busiest first, over process_seconds (the process
+  // scans are further apart than the snapshots).
+  float process_seconds;
+  struct Process {
+    char name[16];
+    int32 pid;
+    float cpu_percent;        // Of one CPU.
+  } processes[TOP_PROCESSES];
+};
+
+// One line describing a report, for logs and consoles; `brief` keeps only
+// CPU load, the busiest interrupt and the busiest process. Returns buffer.
+const char* FormatSystemEventReport(const SystemEventReport& report, bool brief, char* buffer, int size);
+
+class SystemEventLog;
+
+// Samples Linux system state into a ring of snapshots, so a dropout can be
+// annotated with what changed around it: interrupt counts, CPU time,
+// cpufreq, cpuidle residency, pressure stall information, and (less often)
+// the busiest processes.
+//
+// One thread per process, shared by every instance through
+// SharedResourcePointer. It samples once a second, ten times a second for
+// a few seconds after any instance reports a rising spread, and at once
+// when a dropout report is waiting on the snapshot after it. It measures
+// its own CPU time and stretches the interval to stay under CPU_BUDGET of
+// one core. The few /proc files read every time are kept open and re-read
+// with pread(). Elsewhere than Linux it never starts, and no reports are
+// made.
+class SystemSampler : public Thread {
+public:
+  enum {
+    RING_SIZE = 32,
+    MAX_CPUS = 256,
+    MAX_IRQS = 256,
+    MAX_PENDING = 64,
+    INTERVAL_MS = 1000,
+    FAST_INTERVAL_MS = 100,
+    HURRY_MS = 5000,            // Fast sampling lasts this long after Hurry().
+    PROCESS_SCAN_MS = 5000,
+  };
+  static constexpr double CPU_BUDGET = 0.004;
+
+  SystemSampler();
+  ~SystemSampler();
+
+  // Drain thread (or any thread but the audio thread). Asks for a report
+  // on a dropout at `ticks`; it is delivered to log->AddReport() on the
+  // sampler thread once the snapshot after it exists. Requests from the
+  // same log before then are folded into one report.
+  void RequestReport(SystemEventLog* log, int64 ticks);
+
+  // After this returns, no more reports are delivered to log.
+  void Cancel(SystemEventLog* log);
+
+  // Sample fast for the next HURRY_MS.
+  void Hurry();
+
+  void run() override;
+
+private:
+  struct Snapshot;
+  struct ProcessSample {
+    int32 pid;
+    int64 cpu_ticks;  // utime + stime, in clock ticks.
+    char name[16];
+  };
+  struct Request {
+    SystemEventLog* log;
+    int64 ticks;
+    int32 dropouts;
+  };
+  class ProcFile;
+
+  void TakeSnapshot(Snapshot* snapshot);
+  void ReadStat(Snapshot* snapshot);
+  void ReadInterrupts(Snapshot* snapshot);
+  void ReadCpus(Snapshot* snapshot);
+  void ReadPressure(Snapshot* snapshot);
+  void ScanProcesses();
+  void DeliverReports();
+  void MakeReport(const Request& request, const Snapshot& before, const Snapshot& after,
+                  SystemEventReport* report) const;
+
+  // Sampler thread.
+  HeapBlock<Snapshot> ring_;
+  int64 snapshot_count_ = 0;
+  int num_cpus_ = 0;
+  int num_idle_states_ = 0;
+  char idle_names_[SystemEventReport::MAX_IDLE_STATES][12];
+  int num_irqs_ = 0;
+  uint32 irq_layout_ = 0;     // Bumped whenever the /proc/interrupts lines change.
+  char irq_names_[MAX_IRQS][24];
+  ScopedPointer<ProcFile> stat_file_;
+  ScopedPointer<ProcFile> interrupts_file_;
+  ScopedPointer<ProcFile> pressure_files_[3];
+  std::vector<ProcessSample> processes_[2];  // Previous and latest scan.
+  int64 process_scan_ticks_[2] = { 0, 0 };
+  int64 process_scans_ = 0;
+
+  CriticalSection lock_;
+  Array<Request> pending_;
+  std::atomic<int64> hurry_until_ms_{0};
+
+  JUCE_DECLARE_NON_COPYABLE(SystemSampler)
+};
+
+// An instance's dropout reports. A TimingRecordStream listener: it watches
+// the records for dropouts, which it asks the SystemSampler to report on,
+// and for a rising spread, which makes the sampler hurry.
+class SystemEventLog : public TimingRecordStream::Listener {
+public:
+  enum { CAPACITY = 16 };
+
+  // Spread, in blocks, above which a rise makes the sampler hurry.
+  static constexpr float HURRY_SPREAD = 0.25f;
+
+  SystemEventLog();
+  ~SystemEventLog();
+
+  // Drain thread.
+  void TimingRecordsReceived(const TimingRecord* records, int count) override;
+
+  // Any thread. Reports so far; report i is kept until CAPACITY newer ones
+  // have arrived.
+  int64 GetReportCount() const;
+  bool GetReport(int64 index, SystemEventReport* report) const;
+
+private:
+  friend class SystemSampler;
+
+  // Sampler thread.
+  void AddReport(const SystemEventReport& report);
+
+  SharedResourcePointer<SystemSampler> sampler_;
+  float last_spread_ = 0;     // Drain thread.
+
+  CriticalSection lock_;
+  SystemEventReport reports_[CAPACITY];
+  int64 count_ = 0;
+
+  JUCE_DECLARE_NON_COPYABLE(SystemEventLog)
+};
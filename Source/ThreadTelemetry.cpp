@@ -0,0 +1,141 @@
+#include "ThreadTelemetry.h"
+
+#include <limits>
+
+#if JUCE_LINUX
+ #include <sched.h>
+ #include <sys/resource.h>
+ #define DROPOUTSPY_HAVE_THREAD_RUSAGE 1
+#else
+ #define DROPOUTSPY_HAVE_THREAD_RUSAGE 0
+#endif
+
+namespace {
+
+const uint32 LATE_FLAGS = TIMING_FLAG_WARNING | TIMING_FLAG_DROPOUT;
+
+// Single writer, so a relaxed load and store; the audio thread never does
+// a read-modify-write.
+void Add(std::atomic<int64>* counter, int64 amount) {
+  counter->store(counter->load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+template <typename T>
+T Saturate(int64 value) {
+  return T(jlimit<int64>(0, std::numeric_limits<T>::max(), value));
+}
+
+}  // namespace
+
+void ThreadTelemetry::Reset() {
+  countdown_ = 0;
+  have_baseline_ = false;
+  last_cpu_ = -1;
+  samples_.store(0, std::memory_order_relaxed);
+  cpu_.store(-1, std::memory_order_relaxed);
+  migrations_.store(0, std::memory_order_relaxed);
+  voluntary_switches_.store(0, std::memory_order_relaxed);
+  involuntary_switches_.store(0, std::memory_order_relaxed);
+  minor_faults_.store(0, std::memory_order_relaxed);
+  major_faults_.store(0, std::memory_order_relaxed);
+  thread_changes_.store(0, std::memory_order_relaxed);
+  late_.store(0, std::memory_order_relaxed);
+  late_migrated_.store(0, std::memory_order_relaxed);
+  late_preempted_.store(0, std::memory_order_relaxed);
+  late_faulted_.store(0, std::memory_order_relaxed);
+}
+
+void ThreadTelemetry::Process(TimingRecord* record) {
+  record->cpu = -1;
+  record->voluntary_switches = 0;
+  record->involuntary_switches = 0;
+  record->minor_faults = 0;
+  record->major_faults = 0;
+  record->reserved = 0;
+
+  const int interval = interval_.load(std::memory_order_relaxed);
+  if (interval == 0) {
+    // Samples from before the pause would make the first deltas after it
+    // cover the pause.
+    have_baseline_ = false;
+    return;
+  }
+  const bool late = (record->flags & LATE_FLAGS) && !(record->flags & TIMING_FLAG_SUB_BLOCK);
+  if (--countdown_ > 0 && !late) return;
+  countdown_ = interval;
+  if (!Sample(record) || !late) return;
+
+  Add(&late_, 1);
+  if (record->flags & TIMING_FLAG_MIGRATED) Add(&late_migrated_, 1);
+  if (record->flags & TIMING_FLAG_PREEMPTED) Add(&late_preempted_, 1);
+  if (record->flags & TIMING_FLAG_PAGE_FAULT) Add(&late_faulted_, 1);
+}
+
+// Returns true if the record got deltas, i.e. there was a baseline on this
+// thread to take them from.
+bool ThreadTelemetry::Sample(TimingRecord* record) {
+#if DROPOUTSPY_HAVE_THREAD_RUSAGE
+  const int32 cpu = int32(sched_getcpu());
+  rusage usage;
+  if (getrusage(RUSAGE_THREAD, &usage) != 0) return false;
+  const int64 voluntary = usage.ru_nvcsw;
+  const int64 involuntary = usage.ru_nivcsw;
+  const int64 minor = usage.ru_minflt;
+  const int64 major = usage.ru_majflt;
+
+  const Thread::ThreadID thread = Thread::getCurrentThreadId();
+  const bool have_deltas = have_baseline_ && thread == thread_;
+  if (have_baseline_ && thread != thread_) Add(&thread_changes_, 1);
+  record->cpu = int16(cpu);
+  record->flags |= TIMING_FLAG_TELEMETRY;
+  if (have_deltas) {
+    const int64 d_voluntary = voluntary - last_voluntary_;
+    const int64 d_involuntary = involuntary - last_involuntary_;
+    const int64 d_minor = minor - last_minor_;
+    const int64 d_major = major - last_major_;
+    record->voluntary_switches = Saturate<uint8>(d_voluntary);
+    record->involuntary_switches = Saturate<uint8>(d_involuntary);
+    record->minor_faults = Saturate<uint16>(d_minor);
+    record->major_faults = Saturate<uint8>(d_major);
+    if (cpu != last_cpu_) {
+      record->flags |= TIMING_FLAG_MIGRATED;
+      Add(&migrations_, 1);
+    }
+    if (d_involuntary > 0) record->flags |= TIMING_FLAG_PREEMPTED;
+    if (d_minor + d_major > 0) record->flags |= TIMING_FLAG_PAGE_FAULT;
+    Add(&voluntary_switches_, d_voluntary);
+    Add(&involuntary_switches_, d_involuntary);
+    Add(&minor_faults_, d_minor);
+    Add(&major_faults_, d_major);
+  }
+
+  have_baseline_ = true;
+  thread_ = thread;
+  last_cpu_ = cpu;
+  last_voluntary_ = voluntary;
+  last_involuntary_ = involuntary;
+  last_minor_ = minor;
+  last_major_ = major;
+  Add(&samples_, 1);
+  cpu_.store(cpu, std::memory_order_relaxed);
+  return have_deltas;
+#else
+  ignoreUnused(record);
+  return false;
+#endif
+}
+
+void ThreadTelemetry::GetStats(ThreadTelemetryStats* stats) const {
+  stats->samples = samples_.load(std::memory_order_relaxed);
+  stats->cpu = cpu_.load(std::memory_order_relaxed);
+  stats->migrations = migrations_.load(std::memory_order_relaxed);
+  stats->voluntary_switches = voluntary_switches_.load(std::memory_order_relaxed);
+  stats->involuntary_switches = involuntary_switches_.load(std::memory_order_relaxed);
+  stats->minor_faults = minor_faults_.load(std::memory_order_relaxed);
+  stats->major_faults = major_faults_.load(std::memory_order_relaxed);
+  stats->thread_changes = thread_changes_.load(std::memory_order_relaxed);
+  stats->late = late_.load(std::memory_order_relaxed);
+  stats->late_migrated = late_migrated_.load(std::memory_order_relaxed);
+  stats->late_preempted = late_preempted_.load(std::memory_order_relaxed);
+  stats->late_faulted = late_faulted_.load(std::memory_order_relaxed);
+}
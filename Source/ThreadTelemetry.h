@@ -0,0 +1,97 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "TimingRecord.h"
+
+#include <atomic>
+
+// What ThreadTelemetry has seen of the audio thread since the last reset.
+struct ThreadTelemetryStats {
+  int64 samples;
+  int32 cpu;                    // Of the latest sample, or -1.
+  int64 migrations;             // Samples on a different CPU from the one before.
+  int64 voluntary_switches;     // The thread blocked.
+  int64 involuntary_switches;   // The thread was preempted.
+  int64 minor_faults;
+  int64 major_faults;           // Needed disk I/O.
+  int64 thread_changes;         // The host called from a different thread.
+
+  // Late (warning or dropout) device periods, and how many of them came
+  // right after a migration, a preemption or a page fault.
+  int64 late;
+  int64 late_migrated;
+  int64 late_preempted;
+  int64 late_faulted;
+};
+
+// Which CPU the audio thread is on, and its context switches and page
+// faults, from sched_getcpu() and getrusage(RUSAGE_THREAD). These tell
+// "the scheduler moved or preempted us" apart from "something in the
+// chain touched cold memory".
+//
+// Sampled on entry to every Nth block, and always on a late one, so late
+// blocks are never missed; each sample's deltas cover everything since the
+// sample before, which at an interval of 1 is the gap between the previous
+// callback and this one -- exactly where lateness comes from. The deltas
+// go into the block's TimingRecord, and the late blocks that followed a
+// migration, preemption or fault are counted. getrusage costs about a
+// microsecond, sched_getcpu a few nanoseconds (it's in the vDSO).
+//
+// Hosts that call processBlock from a pool of threads would make the
+// deltas meaningless, so a sample on a different thread only rebases.
+// Linux only; elsewhere it samples nothing. Off by default.
+class ThreadTelemetry {
+public:
+  enum { DEFAULT_INTERVAL = 1, MAX_INTERVAL = 255 };
+
+  ThreadTelemetry() {}
+
+  // Any thread; takes effect at the next block. 0 turns it off.
+  void SetInterval(int blocks) {
+    interval_.store(jlimit(0, int(MAX_INTERVAL), blocks), std::memory_order_relaxed);
+  }
+
+  int GetInterval() const {
+    return interval_.load(std::memory_order_relaxed);
+  }
+
+  // Audio thread.
+  void Reset();
+
+  // Audio thread, after the detector has classified the record. Samples if
+  // it is time to, filling in the record's telemetry fields and flags.
+  void Process(TimingRecord* record);
+
+  // Any thread.
+  void GetStats(ThreadTelemetryStats* stats) const;
+
+private:
+  bool Sample(TimingRecord* record);
+
+  std::atomic<int> interval_{0};
+
+  // Audio thread.
+  int countdown_ = 0;
+  bool have_baseline_ = false;
+  Thread::ThreadID thread_ = nullptr;
+  int32 last_cpu_ = -1;
+  int64 last_voluntary_ = 0;
+  int64 last_involuntary_ = 0;
+  int64 last_minor_ = 0;
+  int64 last_major_ = 0;
+
+  std::atomic<int64> samples_{0};
+  std::atomic<int32> cpu_{-1};
+  std::atomic<int64> migrations_{0};
+  std::atomic<int64> voluntary_switches_{0};
+  std::atomic<int64> involuntary_switches_{0};
+  std::atomic<int64> minor_faults_{0};
+  std::atomic<int64> major_faults_{0};
+  std::atomic<int64> thread_changes_{0};
+  std::atomic<int64> late_{0};
+  std::atomic<int64> late_migrated_{0};
+  std::atomic<int64> late_preempted_{0};
+  std::atomic<int64> late_faulted_{0};
+
+  JUCE_DECLARE_NON_COPYABLE(ThreadTelemetry)
+};
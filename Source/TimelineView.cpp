@@ -0,0 +1,204 @@
+#include "TimelineView.h"
+
+namespace {
+
+// Wheel movement per level step, so trackpads don't fly through the levels.
+const float WHEEL_STEP = 0.15f;
+
+const float WARNING_DELTA = 0.5f;
+
+// "250 ms", "4.1 s", "17.5 min" and so on.
+void FormatDuration(char* buffer, int size, double seconds) {
+  if (seconds < 1) {
+    snprintf(buffer, size, "%.3g ms", seconds * 1e3);
+  } else if (seconds < 120) {
+    snprintf(buffer, size, "%.3g s", seconds);
+  } else if (seconds < 7200) {
+    snprintf(buffer, size, "%.3g min", seconds / 60);
+  } else {
+    snprintf(buffer, size, "%.3g h", seconds / 3600);
+  }
+}
+
+}  // namespace
+
+TimelineView::TimelineView(const LatenessTimeline& timeline) : timeline_(timeline) {
+  setOpaque(true);
+}
+
+void TimelineView::resized() {
+  plot_ = Image(Image::RGB, jlimit(1, int(MAX_WIDTH), getWidth()), jmax(1, GetPlotHeight()), true);
+  right_column_ = -1;
+  UpdateReadout();
+}
+
+// No lateness at the bottom, a whole block at the top.
+int TimelineView::DeltaToY(float delta) const {
+  const int height = plot_.getHeight();
+  return jlimit(0, height - 1, int((1.0f - delta) * (height - 1) + 0.5f));
+}
+
+// Redraws the given columns of the current level, those of them that are
+// in view.
+void TimelineView::DrawColumns(int64 first, int64 last) {
+  const int width = plot_.getWidth();
+  const int height = plot_.getHeight();
+  first = jmax(first, right_column_ - width + 1);
+  if (first > last) return;
+  const int count = int(last - first + 1);
+  timeline_.GetColumns(level_, first, count, columns_);
+
+  Graphics g(plot_);
+  const int warning_y = DeltaToY(WARNING_DELTA);
+  for (int i = 0; i < count; i++) {
+    const TimelineColumn& column = columns_[i];
+    const int x = width - 1 - int(right_column_ - (first + i));
+    g.setColour(Colour(16, 16, 16));
+    g.fillRect(x, 0, 1, height);
+    // Dotted line at the warning threshold, dotted by column number so it
+    // scrolls with the plot.
+    if (((first + i) & 3) == 0) {
+      g.setColour(Colour(80, 80, 80));
+      g.fillRect(x, warning_y, 1, 1);
+    }
+    if (column.index < 0) continue;
+
+    const bool dropout = (column.flags & TIMING_FLAG_DROPOUT) != 0;
+    const bool warning = (column.flags & TIMING_FLAG_WARNING) != 0 || column.max_delta >= WARNING_DELTA;
+    const int top = DeltaToY(column.max_delta);
+    const int bottom = DeltaToY(column.min_delta);
+    g.setColour(dropout ? Colour(255, 40, 40) : warning ? Colour(255, 255, 0) : Colour(0, 192, 0));
+    g.fillRect(x, top, 1, bottom - top + 1);
+    if (dropout) {
+      g.fillRect(x, 0, 1, 4);
+    } else if (column.flags & TIMING_FLAG_WARNING) {
+      g.fillRect(x, 0, 1, 2);
+    }
+  }
+}
+
+void TimelineView::Update() {
+  if (!plot_.isValid()) return;
+  const int width = plot_.getWidth();
+  const int height = plot_.getHeight();
+  int64 records = 0;
+  const int64 newest = timeline_.GetNewestColumn(level_, &records);
+  const int64 right = jmax(Time::getHighResolutionTicks() / timeline_.GetColumnTicks(level_), newest);
+  if (right == right_column_ && records == drawn_records_) return;
+
+  if (right_column_ < 0 || right < right_column_ || right - right_column_ >= width) {
+    right_column_ = right;
+    DrawColumns(right - width + 1, right);
+    repaint(0, 0, width, height);
+  } else {
+    // Columns past the newest one last time were drawn empty, or not yet
+    // drawn at all; the newest one may have got more records since.
+    const int64 first = drawn_newest_ >= 0 ? jmin(drawn_newest_, right_column_ + 1) : right - width + 1;
+    const int shift = int(right - right_column_);
+    if (shift > 0) plot_.moveImageSection(0, 0, shift, 0, width - shift, height);
+    right_column_ = right;
+    DrawColumns(first, right);
+    if (shift > 0) {
+      repaint(0, 0, width, height);
+    } else {
+      const int x = width - 1 - int(right - jmax(first, right - width + 1));
+      repaint(x, 0, width - x, height);
+    }
+  }
+  drawn_newest_ = newest;
+  drawn_records_ = records;
+  if (hover_x_ >= 0) UpdateReadout();
+}
+
+void TimelineView::UpdateReadout() {
+  char buffer[128];
+  const int width = plot_.getWidth();
+  const int64 column_ticks = timeline_.GetColumnTicks(level_);
+  const double ticks_per_second = double(Time::getHighResolutionTicksPerSecond());
+  if (hover_x_ < 0 || right_column_ < 0) {
+    char span[32];
+    char column[32];
+    FormatDuration(span, sizeof(span), width * column_ticks / ticks_per_second);
+    FormatDuration(column, sizeof(column), column_ticks / ticks_per_second);
+    snprintf(buffer, sizeof(buffer), "last %s  (%s/px, scroll to zoom)", span, column);
+  } else {
+    const int64 index = right_column_ - (width - 1 - hover_x_);
+    TimelineColumn column;
+    timeline_.GetColumns(level_, index, 1, &column);
+    // Wall clock at the start of the column.
+    const int64 age_ticks = Time::getHighResolutionTicks() - index * column_ticks;
+    const Time time(Time::currentTimeMillis() - int64(age_ticks * 1000 / ticks_per_second));
+    int length = snprintf(buffer, sizeof(buffer), "%02d:%02d:%02d.%03d  ", time.getHours(), time.getMinutes(),
+                          time.getSeconds(), time.getMilliseconds());
+    if (column.index < 0) {
+      snprintf(buffer + length, sizeof(buffer) - length, "no callbacks");
+    } else {
+      if (column.count == 1) {
+        length += snprintf(buffer + length, sizeof(buffer) - length, "late %.3f blocks", column.max_delta);
+      } else {
+        length += snprintf(buffer + length, sizeof(buffer) - length, "late %.3f-%.3f blocks, %d callbacks",
+                           column.min_delta, column.max_delta, int(column.count));
+      }
+      length = jmin(length, int(sizeof(buffer)) - 1);
+      if (column.flags & TIMING_FLAG_DROPOUT) {
+        snprintf(buffer + length, sizeof(buffer) - length, ", dropout");
+      } else if (column.flags & TIMING_FLAG_WARNING) {
+        snprintf(buffer + length, sizeof(buffer) - length, ", warning");
+      }
+    }
+  }
+
+  if (strcmp(buffer, readout_.toRawUTF8()) == 0) return;
+  readout_ = buffer;
+  readout_glyphs_.clear();
+  readout_glyphs_.addFittedText(Font(float(READOUT_HEIGHT)), readout_, 0, float(GetPlotHeight()),
+                                float(getWidth()), float(READOUT_HEIGHT), Justification::centredLeft, 1);
+  repaint(0, GetPlotHeight(), getWidth(), READOUT_HEIGHT);
+}
+
+void TimelineView::SetHover(int x) {
+  if (x >= plot_.getWidth()) x = -1;
+  if (x == hover_x_) return;
+  if (hover_x_ >= 0) repaint(hover_x_, 0, 1, plot_.getHeight());
+  hover_x_ = x;
+  if (hover_x_ >= 0) repaint(hover_x_, 0, 1, plot_.getHeight());
+  UpdateReadout();
+}
+
+void TimelineView::mouseMove(const MouseEvent& e) {
+  SetHover(e.y < plot_.getHeight() ? e.x : -1);
+}
+
+void TimelineView::mouseExit(const MouseEvent&) {
+  SetHover(-1);
+}
+
+void TimelineView::mouseWheelMove(const MouseEvent&, const MouseWheelDetails& wheel) {
+  wheel_ += wheel.deltaY;
+  int step = 0;
+  if (wheel_ >= WHEEL_STEP) {
+    step = -1;  // Up zooms in, to a finer level.
+  } else if (wheel_ <= -WHEEL_STEP) {
+    step = 1;
+  }
+  if (step == 0) return;
+  wheel_ = 0;
+  const int level = jlimit(0, LatenessTimeline::LEVELS - 1, level_ + step);
+  if (level == level_) return;
+  level_ = level;
+  right_column_ = -1;
+  drawn_newest_ = -1;
+  Update();
+  UpdateReadout();
+}
+
+void TimelineView::paint(Graphics& g) {
+  g.fillAll(Colour(16, 16, 16));
+  g.drawImageAt(plot_, 0, 0);
+  if (hover_x_ >= 0) {
+    g.setColour(Colour(255, 255, 255).withAlpha(0.5f));
+    g.fillRect(hover_x_, 0, 1, plot_.getHeight());
+  }
+  g.setColour(Colours::white);
+  readout_glyphs_.draw(g);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LatenessTimeline.h"
+
+// Scrolling plot of per-callback lateness, with now at the right edge.
+// Each pixel column is one LatenessTimeline column: a bar from the lowest
+// to the highest lateness in it, and a mark along the top for warnings and
+// dropouts. The mouse wheel steps through the timeline's levels, from
+// single callbacks to a day across; hovering reads out a column.
+//
+// The plot lives in an image that Update() scrolls and then only draws the
+// columns that came into view or got new records since the last frame.
+class TimelineView : public Component {
+public:
+  enum {
+    MAX_WIDTH = 512,
+    READOUT_HEIGHT = 12,
+    DEFAULT_LEVEL = 5,    // About a minute across.
+  };
+
+  explicit TimelineView(const LatenessTimeline& timeline);
+
+  // Message thread, once per frame.
+  void Update();
+
+  void paint(Graphics& g) override;
+  void resized() override;
+  void mouseMove(const MouseEvent& e) override;
+  void mouseExit(const MouseEvent& e) override;
+  void mouseWheelMove(const MouseEvent& e, const MouseWheelDetails& wheel) override;
+
+private:
+  int GetPlotHeight() const {
+    return getHeight() - READOUT_HEIGHT;
+  }
+
+  int DeltaToY(float delta) const;
+  void DrawColumns(int64 first, int64 last);
+  void UpdateReadout();
+  void SetHover(int x);
+
+  const LatenessTimeline& timeline_;
+  int level_ = DEFAULT_LEVEL;
+  float wheel_ = 0;          // Wheel movement not yet turned into a level step.
+
+  Image plot_;
+  int64 right_column_ = -1;  // Column at the right edge of plot_, or -1 to redraw it all.
+  int64 drawn_newest_ = -1;  // Newest column with records when plot_ was last drawn.
+  int64 drawn_records_ = -1; // Records the timeline had by then.
+  int hover_x_ = -1;
+
+  String readout_;
+  GlyphArrangement readout_glyphs_;
+
+  // Filled in by DrawColumns(); a member so drawing doesn't allocate.
+  TimelineColumn columns_[MAX_WIDTH];
+
+  JUCE_DECLARE_NON_COPYABLE(TimelineView)
+};
@@ -0,0 +1,78 @@
+#include "TimingRecord.h"
+
+// One thread per process services every TimingRecordStream, so running
+// hundreds of instances doesn't mean hundreds of extra threads.
+class TimingRecordDrain : public Thread {
+public:
+  TimingRecordDrain() : Thread("dropoutspy drain") {
+    startThread(4);
+  }
+
+  ~TimingRecordDrain() {
+    stopThread(1000);
+  }
+
+  void Add(TimingRecordStream* stream) {
+    ScopedLock l(lock_);
+    streams_.add(stream);
+  }
+
+  void Remove(TimingRecordStream* stream) {
+    ScopedLock l(lock_);
+    streams_.removeFirstMatchingValue(stream);
+  }
+
+  void run() override {
+    while (!threadShouldExit()) {
+      {
+        ScopedLock l(lock_);
+        for (int i = 0; i < streams_.size(); i++) {
+          streams_.getReference(i)->Drain();
+        }
+      }
+      // Poll rather than have the audio thread signal us; waking a thread
+      // from the callback can mean a syscall.
+      wait(DRAIN_INTERVAL_MS);
+    }
+  }
+
+private:
+  enum { DRAIN_INTERVAL_MS = 10 };
+
+  CriticalSection lock_;
+  Array<TimingRecordStream*> streams_;
+};
+
+TimingRecordStream::TimingRecordStream(int capacity) : ring_(capacity) {
+  drain_->Add(this);
+}
+
+TimingRecordStream::~TimingRecordStream() {
+  drain_->Remove(this);
+}
+
+void TimingRecordStream::AddListener(Listener* listener) {
+  ScopedLock l(listener_lock_);
+  listeners_.addIfNotAlreadyThere(listener);
+}
+
+void TimingRecordStream::RemoveListener(Listener* listener) {
+  ScopedLock l(listener_lock_);
+  listeners_.removeFirstMatchingValue(listener);
+}
+
+void TimingRecordStream::Drain() {
+  ScopedLock l(listener_lock_);
+  if (listeners_.size() == 0) {
+    ring_.DiscardAll();
+    return;
+  }
+  for (;;) {
+    int count = ring_.PopBatch(batch_, BATCH_SIZE);
+    if (count == 0) break;
+    for (int i = 0; i < listeners_.size(); i++) {
+      listeners_.getReference(i)->TimingRecordsReceived(batch_, count);
+    }
+    if (count < BATCH_SIZE) break;
+  }
+}
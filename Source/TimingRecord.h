@@ -0,0 +1,100 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "SpscRing.h"
+
+// Flags describing what processBlock concluded about one callback.
+const uint32 TIMING_FLAG_WARNING = 1 << 0;
+const uint32 TIMING_FLAG_DROPOUT = 1 << 1;
+const uint32 TIMING_FLAG_RESET = 1 << 2;
+// A later piece of a device period the host split into several callbacks;
+// not a timing event of its own, and delta/spread are carried over.
+const uint32 TIMING_FLAG_SUB_BLOCK = 1 << 3;
+// ThreadTelemetry sampled this callback: cpu and the counts below are set.
+const uint32 TIMING_FLAG_TELEMETRY = 1 << 4;
+// Since the previous sample the thread moved to another CPU, was
+// preempted, or took a page fault.
+const uint32 TIMING_FLAG_MIGRATED = 1 << 5;
+const uint32 TIMING_FLAG_PREEMPTED = 1 << 6;
+const uint32 TIMING_FLAG_PAGE_FAULT = 1 << 7;
+// The host's timeline jumped (transport start or stop, a seek, a loop) and
+// the detector found a new baseline instead of judging this callback.
+const uint32 TIMING_FLAG_TRANSPORT = 1 << 8;
+// While playing, the host's position moved on by more than the samples it
+// delivered: it skipped audio of its own.
+const uint32 TIMING_FLAG_HOST_GAP = 1 << 9;
+
+// One record per processBlock call. Kept small and POD so the audio thread
+// can push it into a ring with a single copy.
+struct TimingRecord {
+  int64 ticks;        // Time::getHighResolutionTicks() on entry.
+  float delta;        // Lateness, in blocks.
+  float spread;       // Spread of the start-time window, in blocks.
+  int32 num_samples;  // buffer.getNumSamples().
+  uint32 flags;       // TIMING_FLAG_*.
+
+  // With TIMING_FLAG_TELEMETRY, the CPU the callback started on and the
+  // audio thread's counts since the previous sample, saturated; else -1
+  // and zeros.
+  int16 cpu;
+  uint8 voluntary_switches;
+  uint8 involuntary_switches;
+  uint16 minor_faults;
+  uint8 major_faults;
+  uint8 reserved;
+};
+
+class TimingRecordDrain;
+
+// Per-processor stream of TimingRecords. The audio thread pushes into a
+// preallocated SPSC ring; a single process-wide background thread drains
+// every live stream in batches and hands the records to listeners.
+class TimingRecordStream {
+public:
+  class Listener {
+  public:
+    virtual ~Listener() {}
+
+    // Called on the drain thread, never on the audio thread.
+    virtual void TimingRecordsReceived(const TimingRecord* records, int count) = 0;
+  };
+
+  // The drain runs every 10 ms, which is 60 records at 16 samples/96 kHz.
+  // This leaves most of a second for a listener that holds up the drain
+  // thread, at 128 KB per instance.
+  enum { DEFAULT_CAPACITY = 4096 };
+
+  explicit TimingRecordStream(int capacity = DEFAULT_CAPACITY);
+  ~TimingRecordStream();
+
+  // Audio thread only. Never blocks; drops and counts the record if the
+  // consumer has fallen behind.
+  void Push(const TimingRecord& record) {
+    ring_.Push(record);
+  }
+
+  int64 GetOverflowCount() const {
+    return ring_.GetOverflowCount();
+  }
+
+  void AddListener(Listener* listener);
+  void RemoveListener(Listener* listener);
+
+private:
+  friend class TimingRecordDrain;
+
+  // Drain thread only.
+  void Drain();
+
+  enum { BATCH_SIZE = 256 };
+
+  SpscRing<TimingRecord> ring_;
+  TimingRecord batch_[BATCH_SIZE];
+
+  CriticalSection listener_lock_;
+  Array<Listener*> listeners_;
+
+  SharedResourcePointer<TimingRecordDrain> drain_;
+
+  JUCE_DECLARE_NON_COPYABLE(TimingRecordStream)
+};
@@ -0,0 +1,202 @@
+#include "TscClock.h"
+
+#if JUCE_INTEL && (JUCE_LINUX || JUCE_MAC)
+ #define DROPOUTSPY_HAVE_TSC 1
+ #include <cpuid.h>
+ #include <x86intrin.h>
+#else
+ #define DROPOUTSPY_HAVE_TSC 0
+#endif
+
+namespace {
+
+#if DROPOUTSPY_HAVE_TSC
+bool CpuidBit(unsigned int leaf, int edx_bit) {
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid_max(leaf & 0x80000000u, nullptr) < leaf) return false;
+  if (!__get_cpuid(leaf, &eax, &ebx, &ecx, &edx)) return false;
+  return (edx >> edx_bit) & 1;
+}
+
+inline int64 ReadTsc(bool use_rdtscp) {
+  if (use_rdtscp) {
+    unsigned int aux;
+    return int64(__rdtscp(&aux));
+  }
+  _mm_lfence();
+  return int64(__rdtsc());
+}
+#else
+inline int64 ReadTsc(bool) {
+  return 0;
+}
+#endif
+
+bool HasRdtscp() {
+#if DROPOUTSPY_HAVE_TSC
+  return CpuidBit(0x80000001u, 27);
+#else
+  return false;
+#endif
+}
+
+// One simultaneous reading of the TSC and the reference clock.
+struct ClockSample {
+  int64 tsc;
+  int64 ticks;
+};
+
+}  // namespace
+
+// Process-wide calibration thread shared by every TscClock.
+class TscCalibrator : public Thread {
+public:
+  TscCalibrator() : Thread("dropoutspy tsc"), use_rdtscp_(HasRdtscp()) {
+    if (TscClock::IsSupported()) startThread(3);
+  }
+
+  ~TscCalibrator() {
+    stopThread(1000);
+  }
+
+  const SeqLock<TscCalibration>& GetCalibration() const {
+    return calibration_;
+  }
+
+  bool IsReliable() const {
+    return reliable_.load(std::memory_order_relaxed);
+  }
+
+  void RequestRecalibration() {
+    notify();
+  }
+
+  void run() override {
+    ClockSample first = Sample();
+    double last_rate = 0;
+    TscCalibration current = { 0, 0, 0 };
+
+    // The rate estimate gets better as the baseline grows, so recalibrate
+    // often at first and back off to the steady interval.
+    int interval_ms = INITIAL_CALIBRATION_MS;
+    wait(interval_ms);
+    while (!threadShouldExit()) {
+      ClockSample s = Sample();
+      if (s.tsc > first.tsc && s.ticks > first.ticks) {
+        // Against the ticks everything else uses, slewing included, so TSC
+        // timestamps stay comparable with the timeline and other instances.
+        double rate = double(s.ticks - first.ticks) / double(s.tsc - first.tsc);
+
+        if (last_rate > 0 && std::abs(rate / last_rate - 1.0) > MAX_RATE_CHANGE) {
+          // No crystal drifts this much; the TSC is being throttled or
+          // rewritten (suspend, VM migration). Stop trusting it and start
+          // measuring again from here.
+          reliable_.store(false, std::memory_order_relaxed);
+          first = s;
+          last_rate = 0;
+          current.ticks_per_tsc = 0;  // Readers are back on the ticks; rejoin them there.
+          interval_ms = INITIAL_CALIBRATION_MS;
+          wait(interval_ms);
+          continue;
+        }
+
+        interval_ms = jmin(interval_ms * 2, int(RECALIBRATION_INTERVAL_MS));
+        TscCalibration next;
+        next.base_tsc = s.tsc;
+        next.ticks_per_tsc = rate;
+        if (current.ticks_per_tsc > 0) {
+          // Keep the mapping continuous at the switch-over point, so readers
+          // never see time step backwards or forwards, and slew away
+          // whatever it has drifted from the ticks over the next interval.
+          next.base_ticks = current.base_ticks + int64((s.tsc - current.base_tsc) * current.ticks_per_tsc);
+          const double interval_ticks = interval_ms * 1e-3 * Time::getHighResolutionTicksPerSecond();
+          const double slew = jlimit(-MAX_SLEW, MAX_SLEW, (s.ticks - next.base_ticks) / interval_ticks);
+          next.ticks_per_tsc *= 1.0 + slew;
+        } else {
+          next.base_ticks = s.ticks;
+        }
+        calibration_.Write(next);
+        current = next;
+        last_rate = rate;
+        reliable_.store(true, std::memory_order_relaxed);
+      } else {
+        interval_ms = jmin(interval_ms * 2, int(RECALIBRATION_INTERVAL_MS));
+      }
+      wait(interval_ms);
+    }
+  }
+
+private:
+  enum {
+    INITIAL_CALIBRATION_MS = 50,
+    RECALIBRATION_INTERVAL_MS = 10000,
+    SAMPLE_ATTEMPTS = 5,
+  };
+  static constexpr double MAX_RATE_CHANGE = 1e-3;
+  static constexpr double MAX_SLEW = 5e-4;  // Like NTP's; 5 ms per 10 s interval.
+
+  // Brackets the reference clock reads between two TSC reads and keeps the
+  // attempt with the tightest bracket, to keep preemption out of the pair.
+  ClockSample Sample() const {
+    ClockSample best = { 0, 0 };
+    int64 best_window = -1;
+    for (int i = 0; i < SAMPLE_ATTEMPTS; i++) {
+      int64 t0 = ReadTsc(use_rdtscp_);
+      int64 ticks = Time::getHighResolutionTicks();
+      int64 t1 = ReadTsc(use_rdtscp_);
+      if (best_window < 0 || t1 - t0 < best_window) {
+        best_window = t1 - t0;
+        best.tsc = t0 + (t1 - t0) / 2;
+        best.ticks = ticks;
+      }
+    }
+    return best;
+  }
+
+  const bool use_rdtscp_;
+  SeqLock<TscCalibration> calibration_;
+  std::atomic<bool> reliable_{false};
+};
+
+constexpr double TscCalibrator::MAX_RATE_CHANGE;
+constexpr double TscCalibrator::MAX_SLEW;
+
+TscClock::TscClock() : use_rdtscp_(HasRdtscp()) {
+  cached_.base_tsc = 0;
+  cached_.base_ticks = 0;
+  cached_.ticks_per_tsc = 0;
+}
+
+TscClock::~TscClock() {
+}
+
+bool TscClock::IsSupported() {
+#if DROPOUTSPY_HAVE_TSC
+  // CPUID 0x80000007, EDX bit 8: invariant TSC (constant rate across
+  // P-, C- and T-states).
+  return CpuidBit(0x80000007u, 8);
+#else
+  return false;
+#endif
+}
+
+bool TscClock::IsCalibrated() const {
+  return calibrator_->IsReliable();
+}
+
+void TscClock::Prepare() {
+  calibrator_->RequestRecalibration();
+}
+
+int64 TscClock::GetTicks() {
+  if (!calibrator_->IsReliable()) {
+    return Time::getHighResolutionTicks();
+  }
+  // If the calibrator is mid-update, keep using the previous calibration.
+  calibrator_->GetCalibration().TryRead(&cached_);
+  if (cached_.ticks_per_tsc <= 0) {
+    return Time::getHighResolutionTicks();
+  }
+  int64 tsc = ReadTsc(use_rdtscp_);
+  return cached_.base_ticks + int64((tsc - cached_.base_tsc) * cached_.ticks_per_tsc);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "ClockSource.h"
+#include "SeqLock.h"
+
+#include <atomic>
+
+// Linear map from TSC counts to Time::getHighResolutionTicks() units.
+struct TscCalibration {
+  int64 base_tsc;
+  int64 base_ticks;
+  double ticks_per_tsc;  // 0 until the first calibration completes.
+};
+
+class TscCalibrator;
+
+// ClockSource that reads the CPU's invariant time stamp counter instead of
+// going through clock_gettime. The TSC is calibrated against
+// Time::getHighResolutionTicks() itself by a shared background thread,
+// which keeps refining the rate and slews back onto the ticks without ever
+// making the clock jump. If the TSC
+// isn't invariant, or its measured rate moves more than a real crystal
+// could, GetTicks() falls back to Time::getHighResolutionTicks().
+class TscClock : public ClockSource {
+public:
+  TscClock();
+  ~TscClock();
+
+  // True on x86 CPUs that advertise an invariant TSC.
+  static bool IsSupported();
+
+  int64 GetTicks() override;
+
+  // True once calibrated and as long as the TSC looks trustworthy. When
+  // false, GetTicks() is just Time::getHighResolutionTicks().
+  bool IsCalibrated() const;
+
+  // Asks the calibrator for a fresh measurement. Call from prepareToPlay.
+  void Prepare();
+
+private:
+  TscCalibration cached_;
+  bool use_rdtscp_;
+  SharedResourcePointer<TscCalibrator> calibrator_;
+
+  JUCE_DECLARE_NON_COPYABLE(TscClock)
+};
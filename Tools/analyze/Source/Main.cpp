@@ -0,0 +1,437 @@
+// Offline analysis of session logs recorded by the plugin's Record mode.
+//
+// Replays every recorded callback through DropoutDetector, the same code
+// processBlock runs, and reports counts, lateness percentiles, the
+// intervals between dropouts, and the worst stretches of the session.
+//
+// Usage: dropoutspy_analyze [--threads N] [--window SECONDS] [--worst N]
+//                           [--warmup SECONDS] [--list] [--session]
+//                           segment.dsl...
+//
+// Segments are memory mapped and cut at keyframes into chunks that are
+// replayed on separate threads and merged. A chunk that starts mid-stream
+// first replays --warmup seconds before its start (without counting them)
+// so the drift estimate has settled; chunks that start at a stream reset
+// are exact. --threads 1 replays the whole capture in order, exactly as the
+// plugin saw it.
+
+// Only include the plugin's headers: they pull in the plugin's JuceHeader.h,
+// and including this project's one as well would define ProjectInfo twice.
+#include "../../../Source/DropoutDetector.h"
+#include "../../../Source/SessionLog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <vector>
+
+struct Segment {
+  File file;
+  SessionLogHeader header;
+  Array<SessionLogIndexEntry> index;
+  int64 base;       // Index of the segment's first record in this analysis.
+  bool new_stream;  // Doesn't continue the previous segment.
+};
+
+// A keyframe, where a chunk can start.
+struct KeyPoint {
+  int segment;
+  SessionLogIndexEntry entry;
+  int64 index;  // In this analysis.
+};
+
+struct Window {
+  int64 callbacks = 0;
+  int64 warnings = 0;
+  int64 dropouts = 0;
+  float max_delta = 0;
+};
+
+struct Dropout {
+  int64 index;
+  double wall_ms;
+  float spread;
+};
+
+struct ChunkResult {
+  int64 records = 0;
+  int64 period_starts = 0;
+  int64 resets = 0;
+  int64 warnings = 0;
+  int64 dropouts = 0;
+  int64 live_warnings = 0;
+  int64 live_dropouts = 0;
+  int64 disagreements = 0;  // Callbacks classified differently from live.
+  double drift_ppm = 0;
+  LogLinearHistogram lateness;  // ns, of every period start, as the plugin keeps it.
+  std::vector<Dropout> dropout_list;
+  std::map<int64, Window> windows;
+};
+
+// Reads records in order across a list of segments, each through its own
+// memory map.
+class SegmentCursor {
+public:
+  explicit SegmentCursor(const std::vector<Segment>& segments) : segments_(segments) {
+    for (size_t i = 0; i < segments_.size(); i++) readers_.add(nullptr);
+  }
+
+  void Seek(const KeyPoint& point) {
+    current_ = point.segment;
+    Reader(current_)->SeekToKeyframe(point.entry);
+  }
+
+  bool Next(TimingRecord* record, int* segment, int64* index) {
+    while (current_ < int(segments_.size())) {
+      SessionLogReader* reader = Reader(current_);
+      if (reader->Next(record)) {
+        const Segment& s = segments_[size_t(current_)];
+        *segment = current_;
+        *index = s.base + reader->GetPosition() - 1 - s.header.first_record_index;
+        return true;
+      }
+      current_++;
+      if (current_ < int(segments_.size())) Reader(current_)->Rewind();
+    }
+    return false;
+  }
+
+private:
+  SessionLogReader* Reader(int i) {
+    if (readers_[i] == nullptr) readers_.set(i, new SessionLogReader(segments_[size_t(i)].file));
+    return readers_[i];
+  }
+
+  const std::vector<Segment>& segments_;
+  OwnedArray<SessionLogReader> readers_;
+  int current_ = 0;
+};
+
+struct Analysis {
+  std::vector<Segment> segments;
+  std::vector<KeyPoint> keys;
+  std::vector<size_t> chunk_starts;  // Into keys, plus keys.size() at the end.
+  std::vector<ChunkResult> results;
+  double window_ms = 10000;
+  double warmup_seconds = 300;
+  std::atomic<int> next_chunk{0};
+};
+
+static double WallMs(const Segment& s, int64 ticks) {
+  // Wall clock from the segment's opening time plus elapsed ticks.
+  const int64 first_ticks = s.index.size() > 0 ? s.index.getReference(0).ticks : ticks;
+  return s.header.start_time_ms + (ticks - first_ticks) * 1000.0 / s.header.ticks_per_second;
+}
+
+static void AnalyzeChunk(Analysis* a, size_t chunk) {
+  const size_t first_key = a->chunk_starts[chunk];
+  const int64 begin = a->keys[first_key].index;
+  const int64 end = a->keys.size() > a->chunk_starts[chunk + 1]
+                        ? a->keys[a->chunk_starts[chunk + 1]].index
+                        : std::numeric_limits<int64>::max();
+
+  // Step back for the warm-up, but not past the start of the stream.
+  size_t start_key = first_key;
+  const KeyPoint& k0 = a->keys[first_key];
+  const int64 warmup_ticks = int64(a->warmup_seconds * a->segments[size_t(k0.segment)].header.ticks_per_second);
+  while (start_key > 0) {
+    const KeyPoint& prev = a->keys[start_key - 1];
+    const Segment& seg = a->segments[size_t(a->keys[start_key].segment)];
+    if (a->keys[start_key].index == seg.base && seg.new_stream) break;
+    if (k0.entry.ticks - prev.entry.ticks > warmup_ticks) break;
+    start_key--;
+  }
+
+  ChunkResult& r = a->results[chunk];
+  SegmentCursor cursor(a->segments);
+  cursor.Seek(a->keys[start_key]);
+
+  ScopedPointer<DropoutDetector> detector;
+  int current_segment = -1;
+  int64 window_key = std::numeric_limits<int64>::min();
+  Window* w = nullptr;
+  TimingRecord record;
+  int segment;
+  int64 index;
+  while (cursor.Next(&record, &segment, &index) && index < end) {
+    const Segment& seg = a->segments[size_t(segment)];
+    if (segment != current_segment) {
+      const bool starts_stream = index == seg.base && seg.new_stream;
+      if (detector == nullptr || starts_stream ||
+          seg.header.ticks_per_second != a->segments[size_t(current_segment)].header.ticks_per_second) {
+        detector = new DropoutDetector(seg.header.ticks_per_second);
+        detector->SetFormat(seg.header.sample_rate, seg.header.samples_per_block);
+      } else if (seg.header.sample_rate != a->segments[size_t(current_segment)].header.sample_rate ||
+                 seg.header.samples_per_block != a->segments[size_t(current_segment)].header.samples_per_block) {
+        detector->SetFormat(seg.header.sample_rate, seg.header.samples_per_block);
+      }
+      current_segment = segment;
+    }
+
+    // A recorded reset means the live detector started over here, and a
+    // transport jump that processBlock re-anchored it.
+    const uint32 live_flags = record.flags;
+    if (live_flags & TIMING_FLAG_RESET) detector->ResetTracking();
+    if (live_flags & TIMING_FLAG_TRANSPORT) detector->Reanchor();
+    record.flags = 0;
+    detector->Process(&record);
+
+    if (index < begin) continue;  // Warm-up.
+
+    const uint32 EVENTS = TIMING_FLAG_WARNING | TIMING_FLAG_DROPOUT;
+    r.records++;
+    if (record.flags & TIMING_FLAG_RESET) r.resets++;
+    if (live_flags & TIMING_FLAG_WARNING) r.live_warnings++;
+    if (live_flags & TIMING_FLAG_DROPOUT) r.live_dropouts++;
+    if ((live_flags & EVENTS) != (record.flags & EVENTS)) r.disagreements++;
+
+    const double wall_ms = WallMs(seg, record.ticks);
+    const int64 key = int64(std::floor(wall_ms / a->window_ms));
+    if (key != window_key) {
+      window_key = key;
+      w = &r.windows[key];
+    }
+    w->callbacks++;
+    if (record.flags & TIMING_FLAG_SUB_BLOCK) continue;
+
+    r.period_starts++;
+    r.lateness.Record(detector->GetLastLatenessNs());
+    w->max_delta = std::max(w->max_delta, record.delta);
+    if (record.flags & TIMING_FLAG_DROPOUT) {
+      r.dropouts++;
+      w->dropouts++;
+      Dropout d = { index, wall_ms, record.spread };
+      r.dropout_list.push_back(d);
+    } else if (record.flags & TIMING_FLAG_WARNING) {
+      r.warnings++;
+      w->warnings++;
+    }
+  }
+  if (detector != nullptr) r.drift_ppm = detector->GetDriftPpm();
+}
+
+class Worker : public Thread {
+public:
+  explicit Worker(Analysis* analysis) : Thread("analyze"), analysis_(analysis) {
+  }
+
+  void run() override {
+    for (;;) {
+      int chunk = analysis_->next_chunk++;
+      if (chunk >= int(analysis_->results.size())) break;
+      AnalyzeChunk(analysis_, size_t(chunk));
+    }
+  }
+
+private:
+  Analysis* analysis_;
+};
+
+static String FormatWallTime(double wall_ms) {
+  return Time(int64(wall_ms)).formatted("%Y-%m-%d %H:%M:%S");
+}
+
+// Value at fraction q of the sorted data; reorders data.
+static float Percentile(std::vector<float>* data, double q) {
+  size_t k = std::min(data->size() - 1, size_t(q * (data->size() - 1) + 0.5));
+  std::nth_element(data->begin(), data->begin() + k, data->end());
+  return (*data)[k];
+}
+
+static bool LoadSegments(const Array<File>& files, std::vector<Segment>* segments) {
+  int64 base = 0;
+  for (int i = 0; i < files.size(); i++) {
+    SessionLogReader reader(files[i]);
+    if (!reader.IsValid()) {
+      fprintf(stderr, "%s: not a dropoutspy session log\n", files[i].getFullPathName().toRawUTF8());
+      return false;
+    }
+    Segment s;
+    s.file = files[i];
+    s.header = reader.GetHeader();
+    s.index = reader.GetIndex();
+    s.base = base;
+    s.new_stream = segments->empty() ||
+                   s.header.first_record_index !=
+                       segments->back().header.first_record_index + segments->back().header.record_count;
+    base += s.header.record_count;
+    segments->push_back(s);
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  int num_threads = SystemStats::getNumCpus();
+  int worst = 5;
+  bool list = false;
+  bool whole_session = false;
+  Analysis a;
+  Array<File> files;
+
+  for (int i = 1; i < argc; i++) {
+    String arg(argv[i]);
+    if (arg == "--threads" && i + 1 < argc) {
+      num_threads = jmax(1, String(argv[++i]).getIntValue());
+    } else if (arg == "--window" && i + 1 < argc) {
+      a.window_ms = jmax(0.001, String(argv[++i]).getDoubleValue()) * 1000;
+    } else if (arg == "--worst" && i + 1 < argc) {
+      worst = jmax(0, String(argv[++i]).getIntValue());
+    } else if (arg == "--warmup" && i + 1 < argc) {
+      a.warmup_seconds = jmax(0.0, String(argv[++i]).getDoubleValue());
+    } else if (arg == "--list") {
+      list = true;
+    } else if (arg == "--session") {
+      whole_session = true;
+    } else if (!arg.startsWith("--")) {
+      files.add(File::getCurrentWorkingDirectory().getChildFile(arg));
+    } else {
+      files.clear();
+      break;
+    }
+  }
+  if (files.size() == 0) {
+    fprintf(stderr, "usage: %s [--threads N] [--window SECONDS] [--worst N] [--warmup SECONDS]\n"
+                    "       [--list] [--session] segment.dsl...\n", argv[0]);
+    return 2;
+  }
+  if (whole_session) {
+    File first = files[0];
+    SessionLog::FindSegments(first, &files);
+  }
+
+  const double start_ms = Time::getMillisecondCounterHiRes();
+  if (!LoadSegments(files, &a.segments)) return 1;
+
+  int64 total_records = 0;
+  double duration_seconds = 0;
+  for (size_t i = 0; i < a.segments.size(); i++) {
+    const Segment& s = a.segments[i];
+    total_records += s.header.record_count;
+    for (int k = 0; k < s.index.size(); k++) {
+      KeyPoint key = { int(i), s.index.getReference(k), s.base + s.index.getReference(k).record_index - s.header.first_record_index };
+      a.keys.push_back(key);
+    }
+    if (s.index.size() > 0) {
+      duration_seconds += double(s.index.getLast().ticks - s.index.getFirst().ticks) / s.header.ticks_per_second;
+    }
+  }
+  if (total_records == 0 || a.keys.empty()) {
+    printf("no records\n");
+    return 0;
+  }
+
+  // A few chunks per thread for balance, but each several times longer
+  // than its warm-up.
+  int64 num_chunks = int64(num_threads) * 4;
+  if (a.warmup_seconds > 0) {
+    num_chunks = jmin(num_chunks, jmax<int64>(1, int64(duration_seconds / (a.warmup_seconds * 4))));
+  }
+  if (num_threads == 1) num_chunks = 1;
+  for (int64 c = 0; c < num_chunks; c++) {
+    size_t key = size_t(c * int64(a.keys.size()) / num_chunks);
+    if (a.chunk_starts.empty() || key > a.chunk_starts.back()) a.chunk_starts.push_back(key);
+  }
+  a.chunk_starts.push_back(a.keys.size());
+  a.results.resize(a.chunk_starts.size() - 1);
+
+  OwnedArray<Worker> workers;
+  for (int i = 0; i < jmin(num_threads, int(a.results.size())); i++) {
+    workers.add(new Worker(&a))->startThread();
+  }
+  for (int i = 0; i < workers.size(); i++) {
+    workers[i]->waitForThreadToExit(-1);
+  }
+
+  // Merge, in chunk order.
+  ChunkResult total;
+  for (size_t c = 0; c < a.results.size(); c++) {
+    ChunkResult& r = a.results[c];
+    total.records += r.records;
+    total.period_starts += r.period_starts;
+    total.resets += r.resets;
+    total.warnings += r.warnings;
+    total.dropouts += r.dropouts;
+    total.live_warnings += r.live_warnings;
+    total.live_dropouts += r.live_dropouts;
+    total.disagreements += r.disagreements;
+    total.drift_ppm = r.drift_ppm;
+    total.lateness.Add(r.lateness);
+    total.dropout_list.insert(total.dropout_list.end(), r.dropout_list.begin(), r.dropout_list.end());
+    for (std::map<int64, Window>::const_iterator it = r.windows.begin(); it != r.windows.end(); ++it) {
+      Window& w = total.windows[it->first];
+      w.callbacks += it->second.callbacks;
+      w.warnings += it->second.warnings;
+      w.dropouts += it->second.dropouts;
+      w.max_delta = std::max(w.max_delta, it->second.max_delta);
+    }
+  }
+  const double elapsed_s = (Time::getMillisecondCounterHiRes() - start_ms) / 1000;
+
+  const Segment& first = a.segments.front();
+  printf("segments:    %d, %lld records, %.1f hours from %s\n",
+         int(a.segments.size()), (long long) total.records, duration_seconds / 3600,
+         FormatWallTime(first.header.start_time_ms).toRawUTF8());
+  printf("format:      %.0f Hz, %d samples/block (first segment)\n",
+         first.header.sample_rate, first.header.samples_per_block);
+  printf("analyzed:    %.2f s on %d threads, %d chunks (%.1f M records/s)\n",
+         elapsed_s, workers.size(), int(a.results.size()), total.records / elapsed_s / 1e6);
+  printf("callbacks:   %lld period starts, %lld resets\n",
+         (long long) total.period_starts, (long long) total.resets);
+  printf("warnings:    %lld (live %lld)\n", (long long) total.warnings, (long long) total.live_warnings);
+  printf("dropouts:    %lld (live %lld)\n", (long long) total.dropouts, (long long) total.live_dropouts);
+  printf("disagree:    %lld callbacks classified differently from live\n", (long long) total.disagreements);
+  printf("drift:       %+.1f ppm at end\n", total.drift_ppm);
+
+  if (total.lateness.GetTotalCount() > 0) {
+    static const double PERCENTILES[] = { 50, 90, 99, 99.9, 99.99 };
+    static const char* NAMES[] = { "p50", "p90", "p99", "p99.9", "p99.99" };
+    printf("lateness (ms):");
+    for (size_t i = 0; i < sizeof(PERCENTILES) / sizeof(PERCENTILES[0]); i++) {
+      printf(" %s %.3f", NAMES[i], total.lateness.GetValueAtPercentile(PERCENTILES[i]) * 1e-6);
+    }
+    printf(" max %.3f\n", total.lateness.GetMax() * 1e-6);
+  }
+
+  if (total.dropout_list.size() > 1) {
+    std::vector<float> intervals;
+    double sum = 0;
+    for (size_t i = 1; i < total.dropout_list.size(); i++) {
+      double s = (total.dropout_list[i].wall_ms - total.dropout_list[i - 1].wall_ms) / 1000;
+      intervals.push_back(float(s));
+      sum += s;
+    }
+    float min_s = *std::min_element(intervals.begin(), intervals.end());
+    float max_s = *std::max_element(intervals.begin(), intervals.end());
+    printf("between dropouts (s): min %.1f p50 %.1f mean %.1f max %.1f\n",
+           min_s, Percentile(&intervals, 0.5), sum / intervals.size(), max_s);
+  }
+
+  if (list) {
+    for (size_t i = 0; i < total.dropout_list.size(); i++) {
+      const Dropout& d = total.dropout_list[i];
+      printf("dropout %s.%03d  record %lld  spread %.2f\n",
+             FormatWallTime(d.wall_ms).toRawUTF8(), int(std::fmod(d.wall_ms, 1000.0)),
+             (long long) d.index, d.spread);
+    }
+  }
+
+  if (worst > 0) {
+    std::vector<std::pair<int64, Window> > windows(total.windows.begin(), total.windows.end());
+    std::sort(windows.begin(), windows.end(),
+              [](const std::pair<int64, Window>& x, const std::pair<int64, Window>& y) {
+                if (x.second.dropouts != y.second.dropouts) return x.second.dropouts > y.second.dropouts;
+                if (x.second.warnings != y.second.warnings) return x.second.warnings > y.second.warnings;
+                return x.second.max_delta > y.second.max_delta;
+              });
+    printf("worst %g s windows:\n", a.window_ms / 1000);
+    for (size_t i = 0; i < windows.size() && int(i) < worst; i++) {
+      const Window& w = windows[i].second;
+      printf("  %s  dropouts %lld  warnings %lld  max lateness %.3f  callbacks %lld\n",
+             FormatWallTime(windows[i].first * a.window_ms).toRawUTF8(),
+             (long long) w.dropouts, (long long) w.warnings, w.max_delta, (long long) w.callbacks);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,212 @@
+// Headless benchmark for the cost of DropoutspyAudioProcessor::processBlock.
+//
+// Drives one or many processor instances with a SteppingClock, so the
+// detector always sees perfectly on-time callbacks and takes its steady-state
+// path, and reports what the plugin itself costs per block.
+//
+// Usage: dropoutspy_bench [--instances N[,N...]] [--blocks N] [--max-ns N]
+//                         [--signal]
+//
+// With --max-ns, exits non-zero if the mean cost of any configuration exceeds
+// the given number of nanoseconds per block, so a build script can catch
+// regressions. With --signal, the input is a quiet sine and the signal scan
+// is on, so its cost is included.
+
+// Only include the plugin's headers: they pull in the plugin's JuceHeader.h,
+// and including this project's one as well would define ProjectInfo twice.
+#include "../../../Source/PluginProcessor.h"
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static uint64 ReadCycles() {
+  return __rdtsc();
+}
+static const bool HAVE_CYCLES = true;
+#else
+static uint64 ReadCycles() {
+  return 0;
+}
+static const bool HAVE_CYCLES = false;
+#endif
+
+static const double SAMPLE_RATE = 48000.0;
+static const int NUM_CHANNELS = 2;
+static const int BLOCK_SIZES[] = { 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+static const int WARMUP_BLOCKS = 1000;
+
+struct Instance {
+  DropoutspyAudioProcessor processor;
+  SteppingClock clock;
+  AudioSampleBuffer buffer;
+  MidiBuffer midi;
+
+  Instance(int block_size, bool signal)
+    : clock(Time::secondsToHighResolutionTicks(block_size / SAMPLE_RATE)),
+      buffer(NUM_CHANNELS, block_size) {
+    buffer.clear();
+    if (signal) {
+      // Never exactly zero, and quiet enough that the repeating block
+      // doesn't look like a jump at the boundary.
+      for (int c = 0; c < NUM_CHANNELS; c++) {
+        for (int i = 0; i < block_size; i++) {
+          buffer.getWritePointer(c)[i] = 0.01f * std::sin(0.1f * i + 0.3f);
+        }
+      }
+      processor.setSignalScan(true);
+    }
+    processor.setClockSource(&clock);
+    processor.setPlayConfigDetails(NUM_CHANNELS, NUM_CHANNELS, SAMPLE_RATE, block_size);
+    processor.prepareToPlay(SAMPLE_RATE, block_size);
+  }
+};
+
+// JUCE's high resolution ticks are microseconds on Linux, coarser than a
+// small block costs, so blocks are timed with the steady clock in ns.
+typedef std::chrono::steady_clock BenchClock;
+
+static int64 ElapsedNs(BenchClock::time_point t0, BenchClock::time_point t1) {
+  return int64(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+}
+
+// Cost of an empty timed region, subtracted from every sample.
+struct TimerOverhead {
+  int64 ns;        // The clock reads, and the cycle reads between them.
+  uint64 cycles;   // The cycle reads.
+};
+
+struct RunResult {
+  double mean_ns;
+  double p50_ns;
+  double p99_ns;
+  double p999_ns;
+  double max_ns;
+  double mean_cycles;
+};
+
+static TimerOverhead MeasureTimerOverhead() {
+  std::vector<int64> ns(10000);
+  std::vector<uint64> cycles(ns.size());
+  for (size_t i = 0; i < ns.size(); i++) {
+    BenchClock::time_point t0 = BenchClock::now();
+    uint64 c0 = ReadCycles();
+    uint64 c1 = ReadCycles();
+    BenchClock::time_point t1 = BenchClock::now();
+    ns[i] = ElapsedNs(t0, t1);
+    cycles[i] = c1 - c0;
+  }
+  std::sort(ns.begin(), ns.end());
+  std::sort(cycles.begin(), cycles.end());
+  TimerOverhead overhead;
+  overhead.ns = ns[ns.size() / 2];
+  overhead.cycles = cycles[cycles.size() / 2];
+  return overhead;
+}
+
+static RunResult Run(int num_instances, int block_size, bool signal, int total_blocks,
+                     const TimerOverhead& overhead) {
+  std::vector<Instance*> instances;
+  for (int i = 0; i < num_instances; i++) {
+    instances.push_back(new Instance(block_size, signal));
+  }
+
+  // Round-robin across instances, like a host running one plugin per track.
+  for (int b = 0; b < WARMUP_BLOCKS; b++) {
+    Instance* inst = instances[b % num_instances];
+    inst->processor.processBlock(inst->buffer, inst->midi);
+  }
+
+  std::vector<int64> ns((size_t) total_blocks);
+  uint64 total_cycles = 0;
+  for (int b = 0; b < total_blocks; b++) {
+    Instance* inst = instances[b % num_instances];
+    BenchClock::time_point t0 = BenchClock::now();
+    uint64 c0 = ReadCycles();
+    inst->processor.processBlock(inst->buffer, inst->midi);
+    uint64 c1 = ReadCycles();
+    BenchClock::time_point t1 = BenchClock::now();
+    ns[size_t(b)] = std::max<int64>(0, ElapsedNs(t0, t1) - overhead.ns);
+    total_cycles += c1 - c0 - std::min(c1 - c0, overhead.cycles);
+  }
+
+  for (size_t i = 0; i < instances.size(); i++) delete instances[i];
+
+  int64 sum = 0;
+  for (size_t i = 0; i < ns.size(); i++) sum += ns[i];
+  std::sort(ns.begin(), ns.end());
+  const size_t n = ns.size();
+
+  RunResult r;
+  r.mean_ns = double(sum) / n;
+  r.p50_ns = double(ns[n / 2]);
+  r.p99_ns = double(ns[std::min(n - 1, n * 99 / 100)]);
+  r.p999_ns = double(ns[std::min(n - 1, n * 999 / 1000)]);
+  r.max_ns = double(ns[n - 1]);
+  r.mean_cycles = double(total_cycles) / n;
+  return r;
+}
+
+static std::vector<int> ParseList(const char* arg) {
+  std::vector<int> values;
+  StringArray tokens = StringArray::fromTokens(String(arg), ",", "");
+  for (int i = 0; i < tokens.size(); i++) {
+    int v = tokens[i].getIntValue();
+    if (v > 0) values.push_back(v);
+  }
+  return values;
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<int> instance_counts;
+  instance_counts.push_back(1);
+  instance_counts.push_back(256);
+  int total_blocks = 200000;
+  double max_ns = 0;
+  bool signal = false;
+
+  for (int i = 1; i < argc; i++) {
+    String arg(argv[i]);
+    if (arg == "--instances" && i + 1 < argc) {
+      instance_counts = ParseList(argv[++i]);
+    } else if (arg == "--blocks" && i + 1 < argc) {
+      total_blocks = std::max(1, String(argv[++i]).getIntValue());
+    } else if (arg == "--max-ns" && i + 1 < argc) {
+      max_ns = String(argv[++i]).getDoubleValue();
+    } else if (arg == "--signal") {
+      signal = true;
+    } else {
+      fprintf(stderr, "usage: %s [--instances N[,N...]] [--blocks N] [--max-ns N] [--signal]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  const TimerOverhead overhead = MeasureTimerOverhead();
+  printf("timer overhead: %lld ns, %llu cycles (subtracted)\n", (long long) overhead.ns,
+         (unsigned long long) overhead.cycles);
+  printf("%9s %6s %10s %10s %10s %10s %10s %12s\n",
+         "instances", "block", "mean_ns", "p50_ns", "p99_ns", "p99.9_ns", "max_ns", "cycles/block");
+
+  bool failed = false;
+  for (size_t i = 0; i < instance_counts.size(); i++) {
+    for (size_t j = 0; j < sizeof(BLOCK_SIZES) / sizeof(BLOCK_SIZES[0]); j++) {
+      RunResult r = Run(instance_counts[i], BLOCK_SIZES[j], signal, total_blocks, overhead);
+      char cycles[32];
+      if (HAVE_CYCLES) snprintf(cycles, sizeof(cycles), "%.0f", r.mean_cycles);
+      else snprintf(cycles, sizeof(cycles), "n/a");
+      printf("%9d %6d %10.1f %10.1f %10.1f %10.1f %10.1f %12s\n",
+             instance_counts[i], BLOCK_SIZES[j],
+             r.mean_ns, r.p50_ns, r.p99_ns, r.p999_ns, r.max_ns, cycles);
+      if (max_ns > 0 && r.mean_ns > max_ns) failed = true;
+    }
+  }
+
+  if (failed) {
+    printf("FAIL: mean cost exceeded %.1f ns/block\n", max_ns);
+    return 1;
+  }
+  return 0;
+}
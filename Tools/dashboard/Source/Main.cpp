@@ -0,0 +1,142 @@
+// Live view of every dropoutspy instance running on this machine, across
+// all host processes.
+//
+// Maps the shared memory table the plugins publish into (see InstanceTable)
+// and prints one line per instance, worst lateness over the last minute
+// first, redrawing like top.
+//
+// Usage: dropoutspy_dashboard [--interval MS] [--limit N] [--once]
+//
+// Each refresh only re-reads slots whose version changed since the last
+// one, so watching hundreds of instances costs a few microseconds per
+// refresh plus the terminal output.
+
+// Only include the plugin's headers: they pull in the plugin's JuceHeader.h,
+// and including this project's one as well would define ProjectInfo twice.
+#include "../../../Source/InstanceRegistry.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <unistd.h>
+
+// An instance that hasn't published for this long is shown as stale: its
+// host is hung, or it's stopping.
+const int64 STALE_MS = 2000;
+
+struct Row {
+  uint64 version = 0;
+  bool valid = false;
+  InstanceSnapshot snapshot;
+};
+
+// Worst recent lateness, in ms.
+static double RecentLateMs(const InstanceSnapshot& s) {
+  return s.max_delta_1m * s.period_ms;
+}
+
+static bool WorseThan(const Row* a, const Row* b) {
+  const double late_a = RecentLateMs(a->snapshot);
+  const double late_b = RecentLateMs(b->snapshot);
+  if (late_a != late_b) return late_a > late_b;
+  if (a->snapshot.dropouts_1m != b->snapshot.dropouts_1m) {
+    return a->snapshot.dropouts_1m > b->snapshot.dropouts_1m;
+  }
+  if (a->snapshot.pid != b->snapshot.pid) return a->snapshot.pid < b->snapshot.pid;
+  return a->snapshot.instance < b->snapshot.instance;
+}
+
+// Brings rows up to date with the table. Returns the live ones, worst first.
+static void Refresh(const InstanceTable& table, std::vector<Row>* rows, std::vector<const Row*>* live) {
+  const int64 now_ms = Time::currentTimeMillis();
+  const int limit = table.GetSlotLimit();
+  live->clear();
+  for (int i = 0; i < limit; i++) {
+    Row& row = (*rows)[i];
+    const uint64 version = table.GetSlotVersion(i);
+    // Unchanged slots are skipped, except stale ones, whose owner may have
+    // died without releasing them.
+    if (version != row.version || (row.valid && now_ms - row.snapshot.updated_ms > STALE_MS)) {
+      row.valid = table.ReadSlot(i, &row.snapshot);
+      row.version = version;
+    }
+    if (row.valid) live->push_back(&row);
+  }
+  std::sort(live->begin(), live->end(), WorseThan);
+}
+
+static void Print(const std::vector<const Row*>& live, int limit, bool clear_screen) {
+  const int64 now_ms = Time::currentTimeMillis();
+  if (clear_screen) printf("\x1b[H\x1b[2J");
+  int64 dropouts_1m = 0;
+  for (size_t i = 0; i < live.size(); i++) dropouts_1m += live[i]->snapshot.dropouts_1m;
+  printf("dropoutspy: %d instances, %lld dropouts in the last minute   %s\n\n",
+         int(live.size()), (long long) dropouts_1m,
+         Time::getCurrentTime().formatted("%H:%M:%S").toRawUTF8());
+  printf("%-7s %-3s %-16s %6s %5s %8s %8s %8s %6s %6s %8s %8s %5s\n",
+         "PID", "#", "HOST", "RATE", "BLOCK", "LATE 1s", "LATE 1m", "P99", "WARN/m", "DROP/m",
+         "WARN", "DROP", "AGE");
+  const int rows = limit > 0 ? jmin(limit, int(live.size())) : int(live.size());
+  for (int i = 0; i < rows; i++) {
+    const InstanceSnapshot& s = live[i]->snapshot;
+    const int64 age_ms = now_ms - s.updated_ms;
+    char host[sizeof(s.host) + 1];
+    memcpy(host, s.host, sizeof(s.host));
+    host[sizeof(s.host)] = 0;
+    printf("%-7d %-3u %-16.16s %6.0f %5d %8.2f %8.2f %8.2f %6lld %6lld %8lld %8lld %5s\n",
+           s.pid, s.instance, host, s.sample_rate, s.samples_per_block,
+           s.max_delta_1s * s.period_ms, RecentLateMs(s), s.late_p99_ns * 1e-6,
+           (long long) s.warnings_1m, (long long) s.dropouts_1m,
+           (long long) s.warning_count, (long long) s.overflow_count,
+           age_ms > STALE_MS ? "stale" : "");
+  }
+  if (rows < int(live.size())) printf("... %d more\n", int(live.size()) - rows);
+  printf("\nlateness in ms\n");
+  fflush(stdout);
+}
+
+int main(int argc, char* argv[]) {
+  int interval_ms = 1000;
+  int limit = 0;
+  bool once = false;
+
+  for (int i = 1; i < argc; i++) {
+    String arg(argv[i]);
+    if (arg == "--interval" && i + 1 < argc) {
+      interval_ms = jmax(50, String(argv[++i]).getIntValue());
+    } else if (arg == "--limit" && i + 1 < argc) {
+      limit = jmax(0, String(argv[++i]).getIntValue());
+    } else if (arg == "--once") {
+      once = true;
+    } else {
+      fprintf(stderr, "usage: %s [--interval MS] [--limit N] [--once]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  const bool clear_screen = !once && isatty(STDOUT_FILENO);
+  ScopedPointer<InstanceTable> table;
+  std::vector<Row> rows(InstanceTable::MAX_SLOTS);
+  std::vector<const Row*> live;
+  live.reserve(InstanceTable::MAX_SLOTS);
+  for (;;) {
+    if (table == nullptr || !table->IsValid()) {
+      // No instance has run since boot yet; keep trying.
+      table = new InstanceTable(false);
+      for (size_t i = 0; i < rows.size(); i++) rows[i] = Row();
+    }
+    if (table->IsValid()) {
+      Refresh(*table, &rows, &live);
+      Print(live, limit, clear_screen);
+    } else if (once) {
+      fprintf(stderr, "no dropoutspy instances (%s not found)\n", InstanceTable::GetName());
+      return 1;
+    } else {
+      if (clear_screen) printf("\x1b[H\x1b[2J");
+      printf("waiting for dropoutspy instances...\n");
+      fflush(stdout);
+    }
+    if (once) return 0;
+    Thread::sleep(interval_ms);
+  }
+}
@@ -0,0 +1,302 @@
+// Prometheus exporter for every dropoutspy instance running on this machine,
+// across all host processes.
+//
+// Reads the shared memory table the plugins publish into (see
+// InstanceTable), like the dashboard, and serves it on
+// http://127.0.0.1:PORT/metrics in the Prometheus text format, or in
+// OpenMetrics if the scraper asks for it. The plugins themselves never open
+// a socket, and the audio thread's only part is the stats it already
+// publishes.
+//
+// Usage: dropoutspy_exporter [--port N]
+//
+// Series are labelled with the host process's name and pid and the
+// instance's number within the process. Counters count from the last
+// reset in the plugin, which Prometheus sees as a counter reset. Each
+// scrape re-reads only the slots whose version changed, and formats into a
+// buffer that is kept between scrapes, so a steady scrape allocates
+// nothing.
+
+// Only include the plugin's headers: they pull in the plugin's JuceHeader.h,
+// and including this project's one as well would define ProjectInfo twice.
+#include "../../../Source/InstanceRegistry.h"
+
+#include <vector>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+const int DEFAULT_PORT = 9467;
+const int MAX_REQUEST_BYTES = 4096;
+const int REQUEST_TIMEOUT_MS = 2000;
+
+// An instance that hasn't published for this long is left out: its host
+// is hung or stopping, and Prometheus would rather see the series go.
+const int64 STALE_MS = 10000;
+
+struct Row {
+  uint64 version = 0;
+  bool valid = false;
+  InstanceSnapshot snapshot;
+  char labels[128];  // host="...",pid="...",instance_id="...".
+};
+
+static std::atomic<bool> stop_requested{false};
+
+static void HandleSignal(int) {
+  stop_requested.store(true);
+}
+
+// Text appended into a buffer that only ever grows.
+class Output {
+public:
+  void Clear() {
+    length_ = 0;
+  }
+
+  void Printf(const char* format, ...) {
+    for (;;) {
+      va_list args;
+      va_start(args, format);
+      const int written = vsnprintf(&data_[length_], data_.size() - length_, format, args);
+      va_end(args);
+      if (written < 0) return;
+      if (length_ + size_t(written) < data_.size()) {
+        length_ += size_t(written);
+        return;
+      }
+      data_.resize(jmax(data_.size() * 2, length_ + size_t(written) + 1));
+    }
+  }
+
+  const char* GetData() const {
+    return data_.data();
+  }
+
+  size_t GetLength() const {
+    return length_;
+  }
+
+private:
+  std::vector<char> data_ = std::vector<char>(64 << 10);
+  size_t length_ = 0;
+};
+
+static void MakeLabels(Row* row) {
+  const InstanceSnapshot& s = row->snapshot;
+  // Label values escape backslash, quote and newline.
+  char host[2 * sizeof(s.host) + 1];
+  int length = 0;
+  for (size_t i = 0; i < sizeof(s.host) && s.host[i]; i++) {
+    const char c = s.host[i];
+    if (c == '\\' || c == '"') {
+      host[length++] = '\\';
+      host[length++] = c;
+    } else if (c == '\n') {
+      host[length++] = '\\';
+      host[length++] = 'n';
+    } else {
+      host[length++] = c;
+    }
+  }
+  host[length] = 0;
+  snprintf(row->labels, sizeof(row->labels), "host=\"%s\",pid=\"%d\",instance_id=\"%u\"", host, int(s.pid),
+           s.instance);
+}
+
+// Brings rows up to date with the table, as the dashboard does.
+static void Refresh(const InstanceTable& table, std::vector<Row>* rows, std::vector<const Row*>* live) {
+  const int64 now_ms = Time::currentTimeMillis();
+  const int limit = table.GetSlotLimit();
+  live->clear();
+  for (int i = 0; i < limit; i++) {
+    Row& row = (*rows)[i];
+    const uint64 version = table.GetSlotVersion(i);
+    if (version != row.version || (row.valid && now_ms - row.snapshot.updated_ms > STALE_MS)) {
+      row.valid = table.ReadSlot(i, &row.snapshot);
+      row.version = version;
+      if (row.valid) MakeLabels(&row);
+    }
+    // A freshly claimed slot is all zeros until its first publish.
+    if (row.valid && row.snapshot.updated_ms > 0 && now_ms - row.snapshot.updated_ms <= STALE_MS) {
+      live->push_back(&row);
+    }
+  }
+}
+
+enum MetricType { COUNTER, GAUGE };
+
+// One family: its header, then a sample per instance.
+template <typename Value>
+static void WriteFamily(Output* out, bool openmetrics, const std::vector<const Row*>& live, const char* name,
+                        MetricType type, const char* help, Value value) {
+  const bool counter = type == COUNTER;
+  // OpenMetrics names the counter family without the _total its samples
+  // carry; the Prometheus format names it with.
+  const char* family_suffix = counter && !openmetrics ? "_total" : "";
+  out->Printf("# HELP dropoutspy_%s%s %s\n", name, family_suffix, help);
+  out->Printf("# TYPE dropoutspy_%s%s %s\n", name, family_suffix, counter ? "counter" : "gauge");
+  for (size_t i = 0; i < live.size(); i++) {
+    out->Printf("dropoutspy_%s%s{%s} %.15g\n", name, counter ? "_total" : "", live[i]->labels,
+                double(value(live[i]->snapshot)));
+  }
+}
+
+static void WriteMetrics(Output* out, bool openmetrics, const std::vector<const Row*>& live) {
+  out->Clear();
+  out->Printf("# HELP dropoutspy_instances Running dropoutspy instances on this machine.\n");
+  out->Printf("# TYPE dropoutspy_instances gauge\n");
+  out->Printf("dropoutspy_instances %d\n", int(live.size()));
+
+  typedef const InstanceSnapshot& S;
+  WriteFamily(out, openmetrics, live, "warnings", COUNTER, "Callbacks more than half a period late.",
+              [](S s) { return s.warning_count; });
+  WriteFamily(out, openmetrics, live, "dropouts", COUNTER, "Times the stream slipped by a whole period or more.",
+              [](S s) { return s.overflow_count; });
+  WriteFamily(out, openmetrics, live, "periods", COUNTER, "Device periods processed.",
+              [](S s) { return s.periods; });
+  WriteFamily(out, openmetrics, live, "spread_blocks", GAUGE, "Spread of the recent start times, in periods.",
+              [](S s) { return s.spread; });
+  WriteFamily(out, openmetrics, live, "block_size_samples", GAUGE, "Samples per device period.",
+              [](S s) { return s.samples_per_block; });
+  WriteFamily(out, openmetrics, live, "sample_rate_hertz", GAUGE, "Sample rate.",
+              [](S s) { return s.sample_rate; });
+  WriteFamily(out, openmetrics, live, "drift_ppm", GAUGE, "Device clock against the host clock.",
+              [](S s) { return s.drift_ppm; });
+  WriteFamily(out, openmetrics, live, "lateness_max_1m_blocks", GAUGE, "Worst lateness in the last minute, in periods.",
+              [](S s) { return s.max_delta_1m; });
+  WriteFamily(out, openmetrics, live, "rendering", GAUGE, "1 while the host renders offline.",
+              [](S s) { return s.rendering; });
+  WriteFamily(out, openmetrics, live, "renders", COUNTER, "Offline renders started.",
+              [](S s) { return s.renders; });
+  WriteFamily(out, openmetrics, live, "render_realtime_factor", GAUGE, "Audio time per wall time of the latest offline render.",
+              [](S s) { return s.render_realtime_factor; });
+  WriteFamily(out, openmetrics, live, "render_slowest_realtime_factor", GAUGE,
+              "Audio time per wall time of the slowest second of the latest offline render.",
+              [](S s) { return s.render_slowest_factor; });
+  WriteFamily(out, openmetrics, live, "last_publish_timestamp_seconds", GAUGE, "When the instance last published.",
+              [](S s) { return s.updated_ms * 1e-3; });
+
+  out->Printf("# HELP dropoutspy_lateness_seconds Lateness of each device period.\n");
+  out->Printf("# TYPE dropoutspy_lateness_seconds histogram\n");
+  for (size_t i = 0; i < live.size(); i++) {
+    const InstanceSnapshot& s = live[i]->snapshot;
+    const char* labels = live[i]->labels;
+    for (int b = 0; b < InstanceSnapshot::LATE_BUCKETS; b++) {
+      out->Printf("dropoutspy_lateness_seconds_bucket{%s,le=\"%g\"} %lld\n", labels,
+                  INSTANCE_LATE_BOUNDS_US[b] * 1e-6, (long long) s.late_buckets[b]);
+    }
+    out->Printf("dropoutspy_lateness_seconds_bucket{%s,le=\"+Inf\"} %lld\n", labels, (long long) s.periods);
+    out->Printf("dropoutspy_lateness_seconds_sum{%s} %.9g\n", labels, s.late_sum_ns * 1e-9);
+    out->Printf("dropoutspy_lateness_seconds_count{%s} %lld\n", labels, (long long) s.periods);
+  }
+  if (openmetrics) out->Printf("# EOF\n");
+}
+
+static bool WriteAll(int fd, const char* data, size_t length) {
+  while (length > 0) {
+    const ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    length -= size_t(n);
+  }
+  return true;
+}
+
+// Reads the request head, up to the blank line. Returns its length, or -1.
+static int ReadRequest(int fd, char* buffer, int size) {
+  int length = 0;
+  const int64 deadline = Time::currentTimeMillis() + REQUEST_TIMEOUT_MS;
+  while (length < size - 1) {
+    pollfd p = { fd, POLLIN, 0 };
+    const int wait_ms = int(deadline - Time::currentTimeMillis());
+    if (wait_ms <= 0 || poll(&p, 1, wait_ms) <= 0) return -1;
+    const ssize_t n = recv(fd, buffer + length, size_t(size - 1 - length), 0);
+    if (n <= 0) return -1;
+    length += int(n);
+    buffer[length] = 0;
+    if (strstr(buffer, "\r\n\r\n") != nullptr || strstr(buffer, "\n\n") != nullptr) return length;
+  }
+  return -1;
+}
+
+int main(int argc, char* argv[]) {
+  int port = DEFAULT_PORT;
+  for (int i = 1; i < argc; i++) {
+    String arg(argv[i]);
+    if (arg == "--port" && i + 1 < argc) {
+      port = String(argv[++i]).getIntValue();
+    } else {
+      fprintf(stderr, "usage: %s [--port N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  const int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  const int reuse = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in address;
+  zerostruct(address);
+  address.sin_family = AF_INET;
+  address.sin_port = htons(uint16(port));
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (listener < 0 || bind(listener, (const sockaddr*) &address, sizeof(address)) != 0 || listen(listener, 16) != 0) {
+    fprintf(stderr, "can't listen on 127.0.0.1:%d: %s\n", port, strerror(errno));
+    return 1;
+  }
+  signal(SIGINT, HandleSignal);
+  signal(SIGTERM, HandleSignal);
+  printf("serving http://127.0.0.1:%d/metrics\n", port);
+  fflush(stdout);
+
+  ScopedPointer<InstanceTable> table;
+  std::vector<Row> rows(InstanceTable::MAX_SLOTS);
+  std::vector<const Row*> live;
+  live.reserve(InstanceTable::MAX_SLOTS);
+  Output body;
+  char request[MAX_REQUEST_BYTES];
+  char head[256];
+  while (!stop_requested.load()) {
+    pollfd p = { listener, POLLIN, 0 };
+    if (poll(&p, 1, 1000) <= 0) continue;
+    const int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client < 0) continue;
+
+    if (ReadRequest(client, request, sizeof(request)) < 0) {
+      close(client);
+      continue;
+    }
+    const char* status = "200 OK";
+    const char* content_type = "text/plain; version=0.0.4; charset=utf-8";
+    if (strncmp(request, "GET /metrics ", 13) != 0 && strncmp(request, "GET / ", 6) != 0) {
+      status = "404 Not Found";
+      body.Clear();
+      body.Printf("not found; try /metrics\n");
+    } else {
+      if (table == nullptr || !table->IsValid()) {
+        // No instance has run since boot yet.
+        table = new InstanceTable(false);
+        for (size_t i = 0; i < rows.size(); i++) rows[i] = Row();
+      }
+      live.clear();
+      if (table->IsValid()) Refresh(*table, &rows, &live);
+      const bool openmetrics = strstr(request, "application/openmetrics-text") != nullptr;
+      if (openmetrics) content_type = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+      WriteMetrics(&body, openmetrics, live);
+    }
+    const int head_length = snprintf(head, sizeof(head),
+                                     "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %d\r\n"
+                                     "Connection: close\r\n\r\n",
+                                     status, content_type, int(body.GetLength()));
+    if (WriteAll(client, head, size_t(head_length))) WriteAll(client, body.GetData(), body.GetLength());
+    close(client);
+  }
+  close(listener);
+  return 0;
+}
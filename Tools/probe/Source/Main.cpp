@@ -0,0 +1,444 @@
+// Headless realtime-latency probe: qualifies a Linux machine for audio
+// without a DAW or an audio interface.
+//
+// Runs a SCHED_FIFO thread that wakes on an absolute CLOCK_MONOTONIC
+// schedule, once per buffer at the chosen sample rate and buffer size, the
+// way an audio driver's callback thread does, and calls
+// DropoutspyAudioProcessor::processBlock with real buffers plus a synthetic
+// DSP load. Reports the plugin's own warning and dropout counts, lateness
+// histogram and percentiles, and (like cyclictest) how late each wakeup
+// was.
+//
+// Usage: dropoutspy_probe [--rate HZ] [--block N] [--seconds N]
+//                         [--priority N] [--cpu N] [--load PERCENT]
+//                         [--interval SECONDS] [--telemetry BLOCKS]
+//                         [--prewarn MINUTES] [--target PER_DAY]
+//
+// --seconds 0 runs until interrupted. --load spends that share of each
+// period in a filter loop, calibrated at startup, so it is a fixed amount
+// of work per block, like a real plugin chain. If the wakeup falls more
+// than a whole period behind, the missed periods are skipped, as the
+// hardware would have played them out already; the detector sees that as
+// a dropout. Exits with status 1 if there were any dropouts. Each dropout
+// is followed, a second or so later, by a line saying what the system was
+// doing around it (see SystemSampler). --telemetry samples the callback
+// thread's CPU, context switches and page faults every that many blocks
+// (default 1, 0 for never) and counts the late blocks that followed each.
+// The progress lines carry the headroom left in the block, and a
+// PRE-WARNING when the lateness trend makes a dropout likely within
+// --prewarn minutes (see DropoutForecaster). The summary ends with the
+// dropouts an hour to expect at each buffer size, from this run and
+// earlier ones at the same rate and size, and the smallest size under
+// --target dropouts a day (see BufferAdvisor).
+//
+// Setting SCHED_FIFO needs root, CAP_SYS_NICE or an rtprio limit (e.g. in
+// /etc/security/limits.d); without it the probe runs at normal priority
+// and says so.
+
+// Only include the plugin's headers: they pull in the plugin's JuceHeader.h,
+// and including this project's one as well would define ProjectInfo twice.
+#include "../../../Source/PluginProcessor.h"
+
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+static const int NUM_CHANNELS = 2;
+static const int64 NS_PER_SECOND = 1000000000;
+
+struct Options {
+  double sample_rate = 48000;
+  int block_size = 64;
+  double seconds = 60;
+  int priority = 80;
+  int cpu = -1;
+  double load_percent = 0;
+  double interval_seconds = 10;
+  int telemetry_blocks = ThreadTelemetry::DEFAULT_INTERVAL;
+  double prewarn_minutes = DropoutForecaster::DEFAULT_PREWARN_MINUTES;
+  double target_per_day = BufferAdvisor::DEFAULT_TARGET_PER_DAY;
+};
+
+static std::atomic<bool> stop_requested{false};
+
+static void HandleSignal(int) {
+  stop_requested.store(true);
+}
+
+static int64 TimespecToNs(const timespec& t) {
+  return int64(t.tv_sec) * NS_PER_SECOND + t.tv_nsec;
+}
+
+static timespec NsToTimespec(int64 ns) {
+  timespec t;
+  t.tv_sec = time_t(ns / NS_PER_SECOND);
+  t.tv_nsec = long(ns % NS_PER_SECOND);
+  return t;
+}
+
+static int64 NowNs() {
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return TimespecToNs(t);
+}
+
+// Stand-in for a plugin chain: one pass is a biquad low-pass over every
+// channel of the buffer.
+class SyntheticLoad {
+public:
+  SyntheticLoad() {
+    zerostruct(state_);
+  }
+
+  void Pass(AudioSampleBuffer& buffer) {
+    const float b0 = 0.0675f, b1 = 0.135f, b2 = 0.0675f, a1 = -1.143f, a2 = 0.413f;
+    for (int c = 0; c < jmin(buffer.getNumChannels(), NUM_CHANNELS); c++) {
+      float* data = buffer.getWritePointer(c);
+      float* s = state_[c];
+      for (int i = 0; i < buffer.getNumSamples(); i++) {
+        const float x = data[i];
+        const float y = b0 * x + b1 * s[0] + b2 * s[1] - a1 * s[2] - a2 * s[3];
+        s[1] = s[0];
+        s[0] = x;
+        s[3] = s[2];
+        s[2] = y;
+        data[i] = y;
+      }
+    }
+  }
+
+  // How many passes take `ns`, measured on this thread.
+  int Calibrate(AudioSampleBuffer& buffer, int64 ns) {
+    if (ns <= 0) return 0;
+    const int trial = 2000;
+    int64 best = std::numeric_limits<int64>::max();
+    for (int repeat = 0; repeat < 5; repeat++) {
+      const int64 t0 = NowNs();
+      for (int i = 0; i < trial; i++) Pass(buffer);
+      best = jmin(best, NowNs() - t0);
+    }
+    return jmax(1, int(ns * double(trial) / jmax<int64>(1, best)));
+  }
+
+private:
+  float state_[NUM_CHANNELS][4];
+};
+
+// Everything the callback thread owns or publishes.
+struct Probe {
+  Options options;
+  DropoutspyAudioProcessor processor;
+  AudioSampleBuffer buffer;
+  MidiBuffer midi;
+  SyntheticLoad load;
+  int load_passes = 0;
+  int64 period_ns = 0;
+
+  bool realtime = false;           // SCHED_FIFO was granted.
+  bool pinned = false;
+  HistogramRecorder wake_latency;  // ns past the scheduled wakeup.
+  std::atomic<int64> callbacks{0};
+  std::atomic<int64> skipped_periods{0};
+  std::atomic<bool> done{false};
+
+  explicit Probe(const Options& o) : options(o), buffer(NUM_CHANNELS, o.block_size) {
+    period_ns = int64(o.block_size * double(NS_PER_SECOND) / o.sample_rate);
+    processor.setPlayConfigDetails(NUM_CHANNELS, NUM_CHANNELS, o.sample_rate, o.block_size);
+    processor.prepareToPlay(o.sample_rate, o.block_size);
+    processor.setThreadTelemetry(o.telemetry_blocks);
+    processor.setPrewarnMinutes(float(o.prewarn_minutes));
+    processor.setDropoutTarget(o.target_per_day);
+  }
+
+  void FillInput() {
+    // A quiet sine, so the buffers carry real data.
+    for (int c = 0; c < NUM_CHANNELS; c++) {
+      float* data = buffer.getWritePointer(c);
+      for (int i = 0; i < buffer.getNumSamples(); i++) data[i] = 0.01f * std::sin(0.05f * i + c);
+    }
+  }
+
+  void Run() {
+    FillInput();
+    load_passes = load.Calibrate(buffer, int64(period_ns * options.load_percent / 100));
+
+    const int64 end_ns = options.seconds > 0 ? NowNs() + int64(options.seconds * NS_PER_SECOND) : 0;
+    int64 next = NowNs() + period_ns;
+    while (!stop_requested.load(std::memory_order_relaxed)) {
+      const timespec wake = NsToTimespec(next);
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, nullptr) == EINTR) {
+      }
+      const int64 now = NowNs();
+      wake_latency.Record(now - next);
+
+      FillInput();
+      processor.processBlock(buffer, midi);
+      for (int i = 0; i < load_passes; i++) load.Pass(buffer);
+      callbacks.store(callbacks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+      next += period_ns;
+      const int64 after = NowNs();
+      if (after - next >= period_ns) {
+        // Those periods are gone; carry on from the next one still ahead.
+        const int64 missed = (after - next) / period_ns;
+        next += missed * period_ns;
+        skipped_periods.store(skipped_periods.load(std::memory_order_relaxed) + missed,
+                              std::memory_order_relaxed);
+      }
+      if (end_ns != 0 && after >= end_ns) break;
+    }
+    done.store(true);
+  }
+};
+
+static void* ThreadMain(void* arg) {
+  static_cast<Probe*>(arg)->Run();
+  return nullptr;
+}
+
+// Starts the callback thread as SCHED_FIFO at the given priority, pinned if
+// asked, falling back to a normal thread if that isn't allowed.
+static bool StartThread(Probe* probe, pthread_t* thread) {
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+  pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+  sched_param param;
+  zerostruct(param);
+  param.sched_priority = jlimit(sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO),
+                                probe->options.priority);
+  pthread_attr_setschedparam(&attr, &param);
+  if (probe->options.cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(probe->options.cpu, &cpus);
+    probe->pinned = pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus) == 0;
+  }
+
+  probe->realtime = true;
+  int error = pthread_create(thread, &attr, ThreadMain, probe);
+  if (error == EPERM) {
+    probe->realtime = false;
+    pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+    error = pthread_create(thread, &attr, ThreadMain, probe);
+  }
+  pthread_attr_destroy(&attr);
+  if (error != 0) {
+    fprintf(stderr, "can't start the callback thread: %s\n", strerror(error));
+    return false;
+  }
+  return true;
+}
+
+static void PrintPercentiles(const char* label, const LogLinearHistogram& histo) {
+  const double us = 1e-3;
+  printf("%-9s us  p50 %8.1f  p99 %8.1f  p99.9 %8.1f  p99.99 %8.1f  max %8.1f\n", label,
+         histo.GetValueAtPercentile(50) * us, histo.GetValueAtPercentile(99) * us,
+         histo.GetValueAtPercentile(99.9) * us, histo.GetValueAtPercentile(99.99) * us,
+         histo.GetMax() * us);
+}
+
+// The plugin's meter as text: lateness over one device period in
+// METER_BUCKETS buckets, the last one for a whole period or more.
+static void PrintMeter(const LogLinearHistogram& lateness, double period_ms) {
+  int64 histo[METER_BUCKETS] = { 0 };
+  const double meter_buckets_per_ns = (METER_BUCKETS - 1) / (period_ms * 1e6);
+  for (int i = 0; i < LogLinearHistogram::NUM_BUCKETS; i++) {
+    const uint64 n = lateness.GetCount(i);
+    if (n == 0) continue;
+    double mid = 0.5 * (LogLinearHistogram::BucketLow(i) + LogLinearHistogram::BucketHigh(i) - 1);
+    histo[jlimit(0, METER_BUCKETS - 1, int(mid * meter_buckets_per_ns))] += int64(n);
+  }
+  int64 max_bar = 1;
+  for (int i = 0; i < METER_BUCKETS; i++) max_bar = jmax(max_bar, histo[i]);
+  printf("lateness, in 1/%d of a period:\n", METER_BUCKETS - 1);
+  for (int i = 0; i < METER_BUCKETS; i++) {
+    if (histo[i] == 0) continue;
+    char bar[41];
+    const int length = jmax(1, int(40 * histo[i] / max_bar));
+    memset(bar, '#', size_t(length));
+    bar[length] = 0;
+    printf("  %3d%s %12lld %s\n", i, i == METER_BUCKETS - 1 ? "+" : " ", (long long) histo[i], bar);
+  }
+}
+
+static void PrintProgress(Probe* probe, double elapsed) {
+  DropoutStats stats;
+  probe->processor.getStats(&stats);
+  LogLinearHistogram wake;
+  probe->wake_latency.GetSnapshot(&wake);
+  WindowStats recent;
+  probe->processor.getWindowStats(RollingStats::LAST_MINUTE, &recent);
+  DropoutForecast forecast;
+  probe->processor.getForecast(&forecast);
+  printf("%8.0f s  callbacks %10lld  warnings %6lld  dropouts %6lld  1m %lld/%lld  worst 1m %.2f  wake max %.1f us"
+         "  headroom %.0f%%",
+         elapsed, (long long) probe->callbacks.load(), (long long) stats.warning_count,
+         (long long) stats.overflow_count, (long long) recent.warnings, (long long) recent.dropouts,
+         recent.max_delta, wake.GetMax() * 1e-3, forecast.headroom_percent);
+  if (forecast.prewarning) {
+    printf("  PRE-WARNING: dropout %.0f%% likely within %.0f min",
+           forecast.dropout_probability * 100, probe->processor.getPrewarnMinutes());
+  }
+  printf("\n");
+  fflush(stdout);
+}
+
+// Prints the system reports that arrived since the last call.
+static void PrintSystemReports(Probe* probe, int64* printed) {
+  const int64 count = probe->processor.getSystemReportCount();
+  for (int64 i = jmax(*printed, count - SystemEventLog::CAPACITY); i < count; i++) {
+    SystemEventReport report;
+    if (!probe->processor.getSystemReport(i, &report)) continue;
+    char buffer[512];
+    printf("  dropout x%d: %s\n", int(report.dropouts), FormatSystemEventReport(report, false, buffer, sizeof(buffer)));
+  }
+  if (count != *printed) fflush(stdout);
+  *printed = count;
+}
+
+static void PrintSummary(Probe* probe, double elapsed) {
+  DropoutStats stats;
+  probe->processor.getStats(&stats);
+  LogLinearHistogram histo;
+
+  printf("\n%.0f s, %lld callbacks of %d samples at %.0f Hz (%.3f ms), load %.0f%% (%d passes)\n", elapsed,
+         (long long) probe->callbacks.load(), probe->options.block_size, probe->options.sample_rate,
+         probe->period_ns * 1e-6, probe->options.load_percent, probe->load_passes);
+  printf("warnings %lld  dropouts %lld  skipped periods %lld  drift %+.1f ppm\n",
+         (long long) stats.warning_count, (long long) stats.overflow_count,
+         (long long) probe->skipped_periods.load(), stats.drift_ppm);
+  probe->wake_latency.GetSnapshot(&histo);
+  PrintPercentiles("wake", histo);
+  probe->processor.getIntervalHistogram(&histo);
+  PrintPercentiles("interval", histo);
+  probe->processor.getLatenessHistogram(&histo);
+  PrintPercentiles("late", histo);
+  PrintMeter(histo, stats.period_ms > 0 ? stats.period_ms : probe->period_ns * 1e-6);
+
+  DropoutForecast forecast;
+  probe->processor.getForecast(&forecast);
+  printf("headroom %.0f%%  spread %.3f sd %.3f  tail %.3f/%.3f trend %+.4f/min  pre-warnings %lld\n",
+         forecast.headroom_percent, forecast.mean_spread, forecast.sd_spread, forecast.tail_location,
+         forecast.tail_scale, forecast.trend_per_minute, (long long) forecast.prewarnings);
+
+  ThreadTelemetryStats thread;
+  probe->processor.getThreadTelemetryStats(&thread);
+  if (thread.samples > 0) {
+    printf("callback thread: %lld migrations, %lld preemptions, %lld blocking switches, "
+           "%lld minor / %lld major faults\n",
+           (long long) thread.migrations, (long long) thread.involuntary_switches,
+           (long long) thread.voluntary_switches, (long long) thread.minor_faults, (long long) thread.major_faults);
+    printf("late blocks %lld: after a migration %lld, a preemption %lld, a page fault %lld\n",
+           (long long) thread.late, (long long) thread.late_migrated, (long long) thread.late_preempted,
+           (long long) thread.late_faulted);
+  }
+
+  BufferAdvice advice;
+  probe->processor.getBufferAdvice(&advice);
+  printf("evidence at %d: %.2f h, %lld dropouts", int(advice.samples_per_block), advice.hours,
+         (long long) advice.dropouts);
+  if (advice.tail_periods == 0) {
+    printf(", not enough of a tail to fit\n");
+    return;
+  }
+  printf(", tail above %.1f us: scale %.1f us, shape %.2f\n", advice.threshold_us, advice.scale_us, advice.shape);
+  printf("dropouts/h");
+  for (int i = 0; i < NUM_ADVICE_SIZES; i++) printf("  %d: %.3g", ADVICE_SIZES[i], advice.dropouts_per_hour[i]);
+  printf("\n");
+  if (advice.recommended > 0) {
+    printf("recommended buffer: %d (under %g dropouts a day)\n", int(advice.recommended), advice.target_per_hour * 24);
+  } else {
+    printf("recommended buffer: none up to %d meets %g dropouts a day\n", ADVICE_SIZES[NUM_ADVICE_SIZES - 1],
+           advice.target_per_hour * 24);
+  }
+}
+
+static void Usage(const char* name) {
+  fprintf(stderr, "usage: %s [--rate HZ] [--block N] [--seconds N] [--priority N] [--cpu N]\n"
+                  "       [--load PERCENT] [--interval SECONDS] [--telemetry BLOCKS]\n"
+                  "       [--prewarn MINUTES] [--target PER_DAY]\n", name);
+}
+
+int main(int argc, char* argv[]) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    String arg(argv[i]);
+    if (i + 1 >= argc) {
+      Usage(argv[0]);
+      return 2;
+    }
+    const String value(argv[++i]);
+    if (arg == "--rate") {
+      options.sample_rate = jmax(1000.0, value.getDoubleValue());
+    } else if (arg == "--block") {
+      options.block_size = jlimit(1, 65536, value.getIntValue());
+    } else if (arg == "--seconds") {
+      options.seconds = jmax(0.0, value.getDoubleValue());
+    } else if (arg == "--priority") {
+      options.priority = value.getIntValue();
+    } else if (arg == "--cpu") {
+      options.cpu = value.getIntValue();
+    } else if (arg == "--load") {
+      options.load_percent = jlimit(0.0, 100.0, value.getDoubleValue());
+    } else if (arg == "--interval") {
+      options.interval_seconds = jmax(0.1, value.getDoubleValue());
+    } else if (arg == "--telemetry") {
+      options.telemetry_blocks = jlimit(0, int(ThreadTelemetry::MAX_INTERVAL), value.getIntValue());
+    } else if (arg == "--prewarn") {
+      options.prewarn_minutes = jlimit(1.0, double(DropoutForecaster::HORIZON_MINUTES), value.getDoubleValue());
+    } else if (arg == "--target") {
+      options.target_per_day = jmax(1e-3, value.getDoubleValue());
+    } else {
+      Usage(argv[0]);
+      return 2;
+    }
+  }
+
+  // Page faults on the callback thread would show up as lateness that an
+  // audio application with locked memory wouldn't have.
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    fprintf(stderr, "warning: can't lock memory (%s)\n", strerror(errno));
+  }
+  signal(SIGINT, HandleSignal);
+  signal(SIGTERM, HandleSignal);
+
+  ScopedPointer<Probe> probe(new Probe(options));
+  pthread_t thread;
+  if (!StartThread(probe, &thread)) return 1;
+  if (probe->realtime) {
+    printf("SCHED_FIFO priority %d", options.priority);
+  } else {
+    printf("warning: not allowed SCHED_FIFO, running at normal priority");
+  }
+  if (options.cpu >= 0) {
+    printf(probe->pinned ? ", CPU %d" : ", can't pin to CPU %d", options.cpu);
+  }
+  printf("\n");
+
+  const int64 start_ns = NowNs();
+  int64 next_report = start_ns + int64(options.interval_seconds * NS_PER_SECOND);
+  int64 system_reports = 0;
+  while (!probe->done.load()) {
+    Thread::sleep(50);
+    PrintSystemReports(probe, &system_reports);
+    if (NowNs() >= next_report) {
+      PrintProgress(probe, (NowNs() - start_ns) * 1e-9);
+      next_report += int64(options.interval_seconds * NS_PER_SECOND);
+    }
+  }
+  pthread_join(thread, nullptr);
+
+  PrintSummary(probe, (NowNs() - start_ns) * 1e-9);
+  DropoutStats stats;
+  probe->processor.getStats(&stats);
+  return stats.overflow_count > 0 ? 1 : 0;
+}